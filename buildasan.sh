@@ -0,0 +1,28 @@
+#!/bin/bash
+
+BUILD_DIR="./build_asan"
+
+if [ ! -d "$BUILD_DIR" ] ; then
+	mkdir "$BUILD_DIR"
+fi
+
+CC="/usr/bin/gcc"
+CXX="/usr/bin/g++"
+
+# AddressSanitizer detects use after free and leaks, for example of coroutine frames.
+ASAN_COMPILE_FLAGS="-g -O1 -fsanitize=address -fno-omit-frame-pointer"
+ASAN_LINK_FLAGS="-fsanitize=address"
+
+# Configure and build everything:
+cd "$BUILD_DIR"
+cmake ../ -DCMAKE_EXPORT_COMPILE_COMMANDS=1 -DCMAKE_BUILD_TYPE="Debug" -DCMAKE_C_COMPILER="$CC" -DCMAKE_CXX_COMPILER="$CXX" -DCMAKE_CXX_FLAGS="$ASAN_COMPILE_FLAGS" -DCMAKE_EXE_LINKER_FLAGS="$ASAN_LINK_FLAGS"
+make -j1 # Use one job to improve error detection and exit early.
+
+if [ "$?" -ne 0 ] ; then
+	exit 1
+fi
+
+# Delete all unit test log files and run all unit tests:
+rm -r "./Testing" || true
+# Valgrind cannot run binaries with AddressSanitizer, so there is no memcheck:
+ctest -T test --timeout 5000
@@ -0,0 +1,445 @@
+#ifndef ADV_ACTOR_H
+#define ADV_ACTOR_H
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <optional>
+#include <thread>
+#include <type_traits>
+#include <utility>
+
+#include "future.h"
+#include "mvar/core.h"
+
+namespace adv
+{
+
+/**
+ * An actor owns a state which is only accessed by the messages sent to it.
+ * A message is a function which is called with a reference to the state.
+ * Messages are executed one after another in the order in which they have been
+ * enqueued, so the state requires no synchronization.
+ *
+ * The mailbox is a lock-free multiple producer single consumer queue. Instead
+ * of submitting one task per message, the actor submits one task to its
+ * executor whenever the mailbox becomes non-empty. This task executes up to
+ * batchSize messages and submits itself again if there are more messages, so
+ * other tasks of the executor are not starved.
+ *
+ * Copies of an actor share the same mailbox and state. Messages which have
+ * been enqueued are still executed after the last copy has been destroyed.
+ *
+ * Exceptions thrown by messages sent with \ref tell() are passed to
+ * onException. Without a handler, they terminate the program like the
+ * exceptions of tasks of \ref ThreadPoolExecutor.
+ */
+template <typename State>
+class Actor
+{
+	public:
+	Actor(Executor *ex, State state = State(), std::size_t batchSize = 64,
+	      Executor::ExceptionHandler onException = nullptr)
+	    : mailbox(std::make_shared<Mailbox>(ex, std::move(state), batchSize,
+	                                        std::move(onException)))
+	{
+	}
+
+	Executor *getExecutor() const
+	{
+		return mailbox->ex;
+	}
+
+	/**
+	 * Enqueues f without waiting for its result. Exceptions thrown by f are
+	 * passed to the exception handler of the actor.
+	 */
+	template <typename Func>
+	void tell(Func &&f)
+	{
+		using F = typename std::decay<Func>::type;
+
+		struct Tell : Node
+		{
+			explicit Tell(Func &&f) : f(std::forward<Func>(f))
+			{
+			}
+
+			void run(State &s) override
+			{
+				f(s);
+			}
+
+			F f;
+		};
+
+		Mailbox::push(mailbox, new Tell(std::forward<Func>(f)));
+	}
+
+	/**
+	 * Enqueues f. Use \ref tell() for functions which do not return anything.
+	 * The core of the returned future is stored in the node of the message, so
+	 * an ask allocates only its node.
+	 *
+	 * @return Returns a future which is completed with the result of f. It fails
+	 * with BrokenPromise if the message is never executed.
+	 */
+	template <typename Func>
+	Future<typename std::result_of<Func(State &)>::type> ask(Func &&f)
+	{
+		using F = typename std::decay<Func>::type;
+		using T = typename std::result_of<Func(State &)>::type;
+
+		struct Ask : Reply<T>
+		{
+			Ask(Func &&f, Executor *ex) : Reply<T>(ex), f(std::forward<Func>(f))
+			{
+			}
+
+			void run(State &s) override
+			{
+				try
+				{
+					this->result.emplace(f(s));
+				}
+				catch (...)
+				{
+					this->result.emplace(std::current_exception());
+				}
+			}
+
+			F f;
+		};
+
+		auto n = new Ask(std::forward<Func>(f), mailbox->ex);
+		Future<T> r(n->core);
+		Mailbox::push(mailbox, n);
+
+		return r;
+	}
+
+	/**
+	 * @return Returns the number of messages which have been enqueued but not
+	 * executed yet.
+	 */
+	std::size_t pendingMessages() const
+	{
+		return mailbox->pending.load(std::memory_order_acquire);
+	}
+
+	private:
+	struct Node
+	{
+		virtual ~Node()
+		{
+		}
+
+		virtual void run(State &s)
+		{
+		}
+
+		/**
+		 * Is called after the message does not count as pending anymore.
+		 */
+		virtual void complete()
+		{
+		}
+
+		/**
+		 * Is called instead of deleting the node when the mailbox does not need it
+		 * anymore.
+		 */
+		virtual void destroy()
+		{
+			delete this;
+		}
+
+		std::atomic<Node *> next{nullptr};
+	};
+
+	/**
+	 * The node of a message whose result completes a future. The core of the
+	 * future, its state and the control blocks of their shared pointers are
+	 * stored in the node like the core of \ref Task is stored in the coroutine
+	 * frame. The node is deleted when the mailbox does not need it anymore and
+	 * both control blocks have been deallocated.
+	 */
+	template <typename T>
+	struct Reply : Node
+	{
+		using CoreImpl = adv_mvar::Core<T>;
+
+		explicit Reply(Executor *ex)
+		{
+			auto c = new (&storage)
+			    CoreImpl(ex, NodeAllocator<CoreImpl>(this, stateBlock,
+			                                         sizeof(stateBlock)));
+			core = std::shared_ptr<CoreImpl>(
+			    c, Deleter(),
+			    NodeAllocator<CoreImpl>(this, controlBlock, sizeof(controlBlock)));
+		}
+
+		void complete() override
+		{
+			core->tryComplete(std::move(*result));
+		}
+
+		/**
+		 * Breaks the promise of a message which has not been executed.
+		 */
+		void destroy() override
+		{
+			if (!result)
+			{
+				core->decrementPromiseCounter();
+			}
+
+			core.reset();
+			release();
+		}
+
+		void release()
+		{
+			if (references.fetch_sub(1, std::memory_order_acq_rel) == 1)
+			{
+				delete this;
+			}
+		}
+
+		struct Deleter
+		{
+			void operator()(CoreImpl *core) const
+			{
+				core->~CoreImpl();
+			}
+		};
+
+		/**
+		 * Allocates in the given block of the node if possible and releases the
+		 * node when deallocating.
+		 */
+		template <typename U>
+		struct NodeAllocator
+		{
+			using value_type = U;
+
+			NodeAllocator(Reply *node, unsigned char *block, std::size_t size)
+			    : node(node), block(block), size(size)
+			{
+			}
+
+			template <typename V>
+			NodeAllocator(const NodeAllocator<V> &other)
+			    : node(other.node), block(other.block), size(other.size)
+			{
+			}
+
+			U *allocate(std::size_t n)
+			{
+				if (sizeof(U) * n <= size && alignof(U) <= alignof(std::max_align_t))
+				{
+					return reinterpret_cast<U *>(block);
+				}
+
+				return static_cast<U *>(::operator new(sizeof(U) * n));
+			}
+
+			void deallocate(U *p, std::size_t)
+			{
+				if (reinterpret_cast<unsigned char *>(p) != block)
+				{
+					::operator delete(p);
+				}
+
+				node->release();
+			}
+
+			template <typename V>
+			bool operator==(const NodeAllocator<V> &other) const
+			{
+				return block == other.block;
+			}
+
+			template <typename V>
+			bool operator!=(const NodeAllocator<V> &other) const
+			{
+				return block != other.block;
+			}
+
+			Reply *node;
+			unsigned char *block;
+			std::size_t size;
+		};
+
+		std::optional<Try<T>> result;
+		std::shared_ptr<CoreImpl> core;
+		// The mailbox and the control blocks of the core and its state.
+		std::atomic<int> references{3};
+		alignas(CoreImpl) unsigned char storage[sizeof(CoreImpl)];
+		alignas(std::max_align_t) unsigned char controlBlock[64];
+		alignas(std::max_align_t) unsigned char
+		    stateBlock[sizeof(typename CoreImpl::MVar) + 64];
+	};
+
+	/**
+	 * Vyukov's intrusive MPSC queue. Producers only exchange the head, so
+	 * enqueuing is wait-free. The counter of pending messages decides which
+	 * producer schedules the consumer: only the one which increments it from
+	 * zero. The consumer decrements it after each message and stops when it
+	 * drops to zero. After batchSize messages, it schedules itself again, so
+	 * there is at most one consumer.
+	 */
+	struct Mailbox
+	{
+		Mailbox(Executor *ex, State &&state, std::size_t batchSize,
+		        Executor::ExceptionHandler &&onException)
+		    : ex(ex), batchSize(batchSize), onException(std::move(onException)),
+		      state(std::move(state)), head(&stub), tail(&stub)
+		{
+		}
+
+		~Mailbox()
+		{
+			while (auto n = pop())
+			{
+				n->destroy();
+			}
+		}
+
+		Executor *const ex;
+		const std::size_t batchSize;
+		const Executor::ExceptionHandler onException;
+		State state;
+		std::atomic<std::size_t> pending{0};
+		Node stub;
+		std::atomic<Node *> head;
+		// Is only accessed by the consumer.
+		Node *tail;
+
+		static void push(const std::shared_ptr<Mailbox> &self, Node *n)
+		{
+			auto previous = self->head.exchange(n, std::memory_order_acq_rel);
+			previous->next.store(n, std::memory_order_release);
+
+			if (self->pending.fetch_add(1, std::memory_order_acq_rel) == 0)
+			{
+				schedule(self);
+			}
+		}
+
+		static void schedule(const std::shared_ptr<Mailbox> &self)
+		{
+			self->ex->add([self] { self->runBatch(self); });
+		}
+
+		/**
+		 * @return Returns nullptr if the queue is empty or a producer has not
+		 * linked its node yet.
+		 */
+		Node *pop()
+		{
+			auto t = tail;
+			auto next = t->next.load(std::memory_order_acquire);
+
+			if (t == &stub)
+			{
+				if (next == nullptr)
+				{
+					return nullptr;
+				}
+
+				tail = next;
+				t = next;
+				next = next->next.load(std::memory_order_acquire);
+			}
+
+			if (next != nullptr)
+			{
+				tail = next;
+
+				return t;
+			}
+
+			if (t != head.load(std::memory_order_acquire))
+			{
+				return nullptr;
+			}
+
+			// Reinserts the stub to detach the last node.
+			stub.next.store(nullptr, std::memory_order_relaxed);
+			auto previous = head.exchange(&stub, std::memory_order_acq_rel);
+			previous->next.store(&stub, std::memory_order_release);
+			next = t->next.load(std::memory_order_acquire);
+
+			if (next != nullptr)
+			{
+				tail = next;
+
+				return t;
+			}
+
+			return nullptr;
+		}
+
+		/**
+		 * Every counted message has been linked by its producer but a producer
+		 * which has not counted its message yet might not have linked its node to
+		 * the previous one. This window is only a few instructions long, so the
+		 * consumer yields until the link is visible.
+		 */
+		Node *popCounted()
+		{
+			auto n = pop();
+
+			while (n == nullptr)
+			{
+				std::this_thread::yield();
+				n = pop();
+			}
+
+			return n;
+		}
+
+		/**
+		 * The future of a message is completed after it has been uncounted, so
+		 * \ref pendingMessages() does not include messages whose futures have
+		 * been completed.
+		 */
+		void runBatch(const std::shared_ptr<Mailbox> &self)
+		{
+			for (std::size_t i = 0; i < batchSize; ++i)
+			{
+				auto node = popCounted();
+
+				try
+				{
+					node->run(state);
+				}
+				catch (...)
+				{
+					Executor::handleException(onException);
+				}
+
+				const bool last =
+				    pending.fetch_sub(1, std::memory_order_acq_rel) == 1;
+				// Another consumer might already run if this was the last message.
+				node->complete();
+				node->destroy();
+
+				if (last)
+				{
+					return;
+				}
+			}
+
+			schedule(self);
+		}
+	};
+
+	std::shared_ptr<Mailbox> mailbox;
+};
+
+} // namespace adv
+
+#endif
@@ -1,16 +1,37 @@
 #ifndef ADV_ADVANCEDFUTURESPROMISES_H
 #define ADV_ADVANCEDFUTURESPROMISES_H
 
+#include "actor.h"
+#include "async_cache.h"
+#include "async_semaphore.h"
 #include "core.h"
+#include "mvar/atomic_mvar.h"
+#include "mvar/chan.h"
 #include "mvar/core.h"
 #include "mvar/mvar.h"
 #include "core_impl.h"
+#include "coroutine.h"
 #include "executor.h"
+#include "fiber_executor.h"
 #include "follyexecutor.h"
+#include "fused_future.h"
 #include "future.h"
 #include "future_impl.h"
+#include "hedge.h"
+#include "latch.h"
+#include "lazy_future.h"
+#include "loop.h"
+#include "pipeline.h"
 #include "promise.h"
 #include "promise_impl.h"
+#include "rate_limiter.h"
+#include "retry.h"
+#include "select.h"
+#include "stream.h"
+#include "task_graph.h"
+#include "task_group.h"
+#include "thread_pool_executor.h"
+#include "timer_executor.h"
 #include "try.h"
 
 #endif
\ No newline at end of file
@@ -0,0 +1,458 @@
+#ifndef ADV_ASYNC_CACHE_H
+#define ADV_ASYNC_CACHE_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "future.h"
+#include "promise.h"
+
+namespace adv
+{
+
+/**
+ * Configures an \ref AsyncCache.
+ */
+struct CachePolicy
+{
+	using Clock = std::chrono::steady_clock;
+	using Duration = Clock::duration;
+
+	/**
+	 * The maximum total weight of the completed entries. It is split evenly
+	 * between the shards.
+	 */
+	std::size_t maxBytes{64 * 1024 * 1024};
+	/**
+	 * Keys are distributed between the shards by their hashes, so threads which
+	 * access different keys rarely wait for each other.
+	 */
+	std::size_t shards{16};
+	/**
+	 * Entries which are older are loaded again. Zero disables the expiry.
+	 */
+	Duration expireAfterWrite{Duration::zero()};
+	/**
+	 * Entries which are older are reloaded in the background when they are
+	 * accessed while the old value is still returned. Zero disables refreshing.
+	 */
+	Duration refreshAfterWrite{Duration::zero()};
+	/**
+	 * If it is empty, Clock::now() is used.
+	 */
+	std::function<Clock::time_point()> clock;
+};
+
+/**
+ * Caches shared futures of values which are loaded asynchronously.
+ * Concurrent calls of \ref get() with the same key which miss the cache share
+ * one call of the loader and one future (single flight). Since futures have
+ * multiple read semantics, all callers can read the same result.
+ *
+ * Completed entries are weighed by the weigher and the least recently used
+ * entries are evicted when the weight of a shard exceeds its part of
+ * \ref CachePolicy::maxBytes. Failed loads are removed, so the next access
+ * loads the value again.
+ *
+ * Hits only take the shared lock of their shard and mark their entries as
+ * referenced. The promotion in the LRU list is deferred until eviction: like
+ * the CLOCK algorithm, a referenced entry gets a second chance and is moved to
+ * the front instead of being evicted.
+ */
+template <typename K, typename V, typename Hash = std::hash<K>>
+class AsyncCache
+{
+	public:
+	using Loader = std::function<Future<V>(const K &)>;
+	using Weigher = std::function<std::size_t(const K &, const V &)>;
+	using Clock = CachePolicy::Clock;
+
+	/**
+	 * @param weigher If it is empty, every entry weighs sizeof(K) + sizeof(V).
+	 */
+	AsyncCache(Executor *ex, Loader loader, CachePolicy policy = CachePolicy(),
+	           Weigher weigher = Weigher())
+	    : state(std::make_shared<State>(ex, std::move(loader), std::move(policy),
+	                                    std::move(weigher)))
+	{
+	}
+
+	/**
+	 * @return Returns the cached future of key or starts loading it.
+	 */
+	Future<V> get(const K &key)
+	{
+		return State::get(state, key);
+	}
+
+	/**
+	 * @return Returns the cached future of key without loading it.
+	 */
+	std::optional<Future<V>> getIfPresent(const K &key)
+	{
+		auto &shard = state->shardOf(key);
+		std::shared_lock<std::shared_mutex> l(shard.m);
+		auto it = shard.entries.find(key);
+
+		if (it == shard.entries.end() || state->isExpired(it->second))
+		{
+			return std::nullopt;
+		}
+
+		it->second.touch();
+
+		return it->second.future;
+	}
+
+	void invalidate(const K &key)
+	{
+		auto &shard = state->shardOf(key);
+		std::lock_guard<std::shared_mutex> l(shard.m);
+		auto it = shard.entries.find(key);
+
+		if (it != shard.entries.end())
+		{
+			shard.erase(it);
+		}
+	}
+
+	/**
+	 * @return Returns the number of entries including the ones being loaded.
+	 */
+	std::size_t size() const
+	{
+		std::size_t r = 0;
+
+		for (auto &shard : state->shards)
+		{
+			std::shared_lock<std::shared_mutex> l(shard.m);
+			r += shard.entries.size();
+		}
+
+		return r;
+	}
+
+	/**
+	 * @return Returns the total weight of the completed entries.
+	 */
+	std::size_t weight() const
+	{
+		std::size_t r = 0;
+
+		for (auto &shard : state->shards)
+		{
+			std::shared_lock<std::shared_mutex> l(shard.m);
+			r += shard.weight;
+		}
+
+		return r;
+	}
+
+	private:
+	/**
+	 * Hits only modify the atomic members while holding the shared lock.
+	 */
+	struct Entry
+	{
+		explicit Entry(Future<V> future) : future(std::move(future))
+		{
+		}
+
+		/**
+		 * Marks the entry as recently used. It is only written if it is not marked
+		 * yet, so hits of a popular entry do not contend on its cache line.
+		 */
+		void touch()
+		{
+			if (!referenced.load(std::memory_order_relaxed))
+			{
+				referenced.store(true, std::memory_order_relaxed);
+			}
+		}
+
+		Future<V> future;
+		typename std::list<K>::iterator lru;
+		Clock::time_point written;
+		std::size_t weight = 0;
+		// Identifies the load which has created the entry.
+		std::uint64_t generation = 0;
+		std::atomic<bool> referenced{false};
+		std::atomic<bool> refreshing{false};
+	};
+
+	using Entries = std::unordered_map<K, Entry, Hash>;
+
+	struct Shard
+	{
+		mutable std::shared_mutex m;
+		Entries entries;
+		/*
+		 * The most recently inserted or promoted key is at the front. Requires
+		 * the exclusive lock.
+		 */
+		std::list<K> lru;
+		std::size_t weight = 0;
+
+		void erase(typename Entries::iterator it)
+		{
+			weight -= it->second.weight;
+			lru.erase(it->second.lru);
+			entries.erase(it);
+		}
+
+		/**
+		 * Evicts the least recently used completed entries. Entries which are
+		 * being loaded do not have any weight yet. Referenced entries are
+		 * promoted to the front and unmarked instead, so every entry is visited
+		 * at most twice.
+		 */
+		void evict(std::size_t maxWeight)
+		{
+			auto it = lru.end();
+
+			while (weight > maxWeight && it != lru.begin())
+			{
+				--it;
+				auto e = entries.find(*it);
+
+				if (e->second.weight == 0)
+				{
+					continue;
+				}
+
+				// The iterator of the moved or erased key is invalidated.
+				auto current = it;
+				it = std::next(it);
+
+				if (e->second.referenced.exchange(false, std::memory_order_relaxed))
+				{
+					lru.splice(lru.begin(), lru, current);
+				}
+				else
+				{
+					erase(e);
+				}
+			}
+		}
+	};
+
+	struct State
+	{
+		State(Executor *ex, Loader &&loader, CachePolicy &&policy,
+		      Weigher &&weigher)
+		    : ex(ex), loader(std::move(loader)), policy(std::move(policy)),
+		      weigher(std::move(weigher)),
+		      shards(std::max<std::size_t>(this->policy.shards, 1)),
+		      maxShardWeight(std::max<std::size_t>(
+		          this->policy.maxBytes / shards.size(), 1))
+		{
+		}
+
+		Executor *const ex;
+		const Loader loader;
+		const CachePolicy policy;
+		const Weigher weigher;
+		std::vector<Shard> shards;
+		const std::size_t maxShardWeight;
+		std::atomic<std::uint64_t> generations{0};
+
+		Shard &shardOf(const K &key)
+		{
+			return shards[Hash()(key) % shards.size()];
+		}
+
+		Clock::time_point now() const
+		{
+			return policy.clock ? policy.clock() : Clock::now();
+		}
+
+		bool isOlder(const Entry &e, CachePolicy::Duration d) const
+		{
+			// Only loaded entries have a weight and a write time.
+			return d != CachePolicy::Duration::zero() && e.weight > 0 &&
+			       now() - e.written >= d;
+		}
+
+		bool isExpired(const Entry &e) const
+		{
+			return isOlder(e, policy.expireAfterWrite);
+		}
+
+		std::size_t weigh(const K &key, const V &v) const
+		{
+			return weigher ? weigher(key, v) : sizeof(K) + sizeof(V);
+		}
+
+		/**
+		 * Hits only take the shared lock. A miss takes the exclusive lock and
+		 * looks the key up again, since another call might have inserted it in
+		 * the meantime.
+		 */
+		static Future<V> get(const std::shared_ptr<State> &self, const K &key)
+		{
+			auto &shard = self->shardOf(key);
+
+			{
+				std::shared_lock<std::shared_mutex> l(shard.m);
+				auto it = shard.entries.find(key);
+
+				if (it != shard.entries.end() && !self->isExpired(it->second))
+				{
+					return hit(self, key, it->second, l);
+				}
+			}
+
+			std::unique_lock<std::shared_mutex> l(shard.m);
+			auto it = shard.entries.find(key);
+
+			if (it != shard.entries.end() && !self->isExpired(it->second))
+			{
+				return hit(self, key, it->second, l);
+			}
+
+			if (it != shard.entries.end())
+			{
+				shard.erase(it);
+			}
+
+			// Concurrent calls find the entry and share the promise.
+			Promise<V> p(self->ex);
+			it = shard.entries.try_emplace(key, p.future()).first;
+			shard.lru.push_front(key);
+			it->second.lru = shard.lru.begin();
+			const auto generation = it->second.generation = ++self->generations;
+			l.unlock();
+
+			auto f = load(self, key);
+			p.tryCompleteWith(f);
+			std::weak_ptr<State> weak = self;
+			f.onComplete([weak, key, generation](const Try<V> &t) {
+				auto self = weak.lock();
+
+				if (self != nullptr)
+				{
+					self->loaded(key, generation, t, nullptr);
+				}
+			});
+
+			return p.future();
+		}
+
+		/**
+		 * Marks e as used and starts refreshing it without the lock if it is old.
+		 */
+		template <typename Lock>
+		static Future<V> hit(const std::shared_ptr<State> &self, const K &key,
+		                     Entry &e, Lock &l)
+		{
+			e.touch();
+			auto r = e.future;
+
+			if (self->isOlder(e, self->policy.refreshAfterWrite) &&
+			    !e.refreshing.exchange(true))
+			{
+				const auto generation = e.generation;
+				l.unlock();
+				refresh(self, key, generation);
+			}
+
+			return r;
+		}
+
+		/**
+		 * Starts the loader without the lock.
+		 */
+		static Future<V> load(const std::shared_ptr<State> &self, const K &key)
+		{
+			try
+			{
+				return self->loader(key);
+			}
+			catch (...)
+			{
+				Promise<V> p(self->ex);
+				p.tryFailure(std::current_exception());
+
+				return p.future();
+			}
+		}
+
+		static void refresh(const std::shared_ptr<State> &self, const K &key,
+		                    std::uint64_t generation)
+		{
+			auto f = load(self, key);
+			std::weak_ptr<State> weak = self;
+			f.onComplete([weak, key, generation, f](const Try<V> &t) {
+				auto self = weak.lock();
+
+				if (self != nullptr)
+				{
+					self->loaded(key, generation, t, &f);
+				}
+			});
+		}
+
+		/**
+		 * Updates the entry unless it has been replaced in the meantime.
+		 *
+		 * @param refreshed The future of a refresh or nullptr.
+		 */
+		void loaded(const K &key, std::uint64_t generation, const Try<V> &t,
+		            const Future<V> *refreshed)
+		{
+			auto &shard = shardOf(key);
+			std::lock_guard<std::shared_mutex> l(shard.m);
+			auto it = shard.entries.find(key);
+
+			if (it == shard.entries.end() || it->second.generation != generation)
+			{
+				return;
+			}
+
+			auto &e = it->second;
+
+			if (t.hasException())
+			{
+				// A failed refresh keeps the old value.
+				if (refreshed != nullptr)
+				{
+					e.refreshing = false;
+				}
+				else
+				{
+					shard.erase(it);
+				}
+
+				return;
+			}
+
+			if (refreshed != nullptr)
+			{
+				e.future = *refreshed;
+				e.refreshing = false;
+			}
+
+			shard.weight -= e.weight;
+			e.weight = std::max<std::size_t>(weigh(key, t.get()), 1);
+			e.written = now();
+			shard.weight += e.weight;
+			shard.evict(maxShardWeight);
+		}
+	};
+
+	std::shared_ptr<State> state;
+};
+
+} // namespace adv
+
+#endif
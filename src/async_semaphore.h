@@ -0,0 +1,335 @@
+#ifndef ADV_ASYNC_SEMAPHORE_H
+#define ADV_ASYNC_SEMAPHORE_H
+
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "future.h"
+#include "promise.h"
+
+namespace adv
+{
+
+/**
+ * A semaphore whose permits are acquired with futures instead of blocking
+ * threads. If there are enough permits and nobody is waiting, \ref acquire()
+ * returns a completed future. Otherwise, the request is queued and the
+ * permits are handed over directly to the oldest waiting request when they
+ * are released, so later requests cannot overtake it even if they need fewer
+ * permits. Requests for more permits than the semaphore has in total fail
+ * immediately, since they would block all later requests forever.
+ */
+class AsyncSemaphore
+{
+	private:
+	struct State;
+	struct Permits;
+
+	public:
+	/**
+	 * Holds the permits until it is destroyed or \ref release() is called.
+	 * Guards are move-only, so exactly one guard owns the permits.
+	 */
+	class Guard
+	{
+		public:
+		Guard() = default;
+
+		Guard(Guard &&other) noexcept : permits(std::move(other.permits))
+		{
+		}
+
+		Guard &operator=(Guard &&other) noexcept
+		{
+			release();
+			permits = std::move(other.permits);
+
+			return *this;
+		}
+
+		Guard(const Guard &) = delete;
+		Guard &operator=(const Guard &) = delete;
+
+		~Guard()
+		{
+			release();
+		}
+
+		/**
+		 * Releases the permits early.
+		 */
+		void release()
+		{
+			if (permits != nullptr)
+			{
+				auto p = std::move(permits);
+				p->release();
+			}
+		}
+
+		bool ownsPermits() const
+		{
+			return permits != nullptr;
+		}
+
+		private:
+		explicit Guard(std::shared_ptr<Permits> permits)
+		    : permits(std::move(permits))
+		{
+		}
+
+		std::shared_ptr<Permits> permits;
+
+		friend class AsyncSemaphore;
+	};
+
+	/**
+	 * The result of \ref acquire(). Since a future can be read and copied
+	 * multiple times, the permits are transferred out of the lease into a guard
+	 * by \ref take() exactly once. Hence, copies of the future do not keep the
+	 * permits after the guard has released them. The permits of a lease which
+	 * is never taken are released when its last copy has been destroyed.
+	 */
+	class Lease
+	{
+		public:
+		Lease() = default;
+
+		/**
+		 * @return Returns the guard which owns the permits on the first call on
+		 * any copy and an empty guard on every later call.
+		 */
+		Guard take() const
+		{
+			if (permits != nullptr && !permits->taken.exchange(true))
+			{
+				return Guard(permits);
+			}
+
+			return Guard();
+		}
+
+		private:
+		explicit Lease(std::shared_ptr<Permits> permits)
+		    : permits(std::move(permits))
+		{
+		}
+
+		std::shared_ptr<Permits> permits;
+
+		friend class AsyncSemaphore;
+	};
+
+	AsyncSemaphore(Executor *ex, std::size_t permits)
+	    : state(std::make_shared<State>(ex, permits))
+	{
+	}
+
+	Executor *getExecutor() const
+	{
+		return state->ex;
+	}
+
+	/**
+	 * @return Returns a future which is completed with a lease of n permits as
+	 * soon as they are available. It fails with std::invalid_argument if n
+	 * exceeds the total number of permits.
+	 */
+	Future<Lease> acquire(std::size_t n = 1)
+	{
+		Promise<Lease> p(state->ex);
+		auto r = p.future();
+
+		if (n > state->capacity)
+		{
+			p.tryFailure(std::invalid_argument(
+			    "The request exceeds the total number of permits."));
+
+			return r;
+		}
+
+		{
+			std::lock_guard<std::mutex> l(state->m);
+
+			if (!state->canAcquire(n))
+			{
+				state->waiters.emplace_back(n, std::move(p));
+
+				return r;
+			}
+
+			state->permits -= n;
+		}
+
+		p.trySuccess(Lease(std::make_shared<Permits>(state, n)));
+
+		return r;
+	}
+
+	/**
+	 * Does not wait and does not overtake waiting requests.
+	 */
+	std::optional<Guard> tryAcquire(std::size_t n = 1)
+	{
+		{
+			std::lock_guard<std::mutex> l(state->m);
+
+			if (!state->canAcquire(n))
+			{
+				return std::nullopt;
+			}
+
+			state->permits -= n;
+		}
+
+		return Guard(std::make_shared<Permits>(state, n));
+	}
+
+	std::size_t availablePermits() const
+	{
+		std::lock_guard<std::mutex> l(state->m);
+
+		return state->permits;
+	}
+
+	std::size_t waitingRequests() const
+	{
+		std::lock_guard<std::mutex> l(state->m);
+
+		return state->waiters.size();
+	}
+
+	private:
+	/**
+	 * The permits of one request. They are released once, either by their guard
+	 * or when nobody can take them anymore.
+	 */
+	struct Permits
+	{
+		Permits(std::shared_ptr<State> state, std::size_t n)
+		    : state(std::move(state)), n(n)
+		{
+		}
+
+		~Permits()
+		{
+			release();
+		}
+
+		void release()
+		{
+			if (!released.exchange(true))
+			{
+				state->release(n);
+			}
+		}
+
+		const std::shared_ptr<State> state;
+		const std::size_t n;
+		std::atomic<bool> taken{false};
+		std::atomic<bool> released{false};
+	};
+
+	struct State : std::enable_shared_from_this<State>
+	{
+		State(Executor *ex, std::size_t permits)
+		    : ex(ex), capacity(permits), permits(permits)
+		{
+		}
+
+		Executor *const ex;
+		// The total number of permits.
+		const std::size_t capacity;
+		mutable std::mutex m;
+		std::size_t permits;
+		std::deque<std::pair<std::size_t, Promise<Lease>>> waiters;
+
+		bool canAcquire(std::size_t n) const
+		{
+			return waiters.empty() && permits >= n;
+		}
+
+		/**
+		 * Hands the permits over to the oldest waiting requests. The futures are
+		 * completed without the lock since their callbacks might acquire permits
+		 * again.
+		 */
+		void release(std::size_t n)
+		{
+			std::vector<std::pair<std::size_t, Promise<Lease>>> granted;
+
+			{
+				std::lock_guard<std::mutex> l(m);
+				permits += n;
+
+				while (!waiters.empty() && permits >= waiters.front().first)
+				{
+					permits -= waiters.front().first;
+					granted.push_back(std::move(waiters.front()));
+					waiters.pop_front();
+				}
+			}
+
+			for (auto &g : granted)
+			{
+				g.second.trySuccess(
+				    Lease(std::make_shared<Permits>(shared_from_this(), g.first)));
+			}
+		}
+	};
+
+	std::shared_ptr<State> state;
+};
+
+/**
+ * A mutex which is locked with futures instead of blocking threads. It is an
+ * \ref AsyncSemaphore with one permit, so the waiting requests are served in
+ * FIFO order.
+ */
+class AsyncMutex
+{
+	public:
+	using Guard = AsyncSemaphore::Guard;
+	using Lease = AsyncSemaphore::Lease;
+
+	explicit AsyncMutex(Executor *ex) : semaphore(ex, 1)
+	{
+	}
+
+	Executor *getExecutor() const
+	{
+		return semaphore.getExecutor();
+	}
+
+	/**
+	 * @return Returns a future which is completed with a lease whose guard
+	 * unlocks the mutex when it is destroyed.
+	 */
+	Future<Lease> lock()
+	{
+		return semaphore.acquire();
+	}
+
+	std::optional<Guard> tryLock()
+	{
+		return semaphore.tryAcquire();
+	}
+
+	bool isLocked() const
+	{
+		return semaphore.availablePermits() == 0;
+	}
+
+	private:
+	AsyncSemaphore semaphore;
+};
+
+} // namespace adv
+
+#endif
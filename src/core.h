@@ -1,6 +1,11 @@
 #ifndef ADV_CORE_H
 #define ADV_CORE_H
 
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+
 #include "executor.h"
 #include "try.h"
 
@@ -16,15 +21,251 @@ class BrokenPromise : public std::exception
 {
 };
 
+/**
+ * Identifies a callback which has been registered at a core.
+ * The generation prevents removing another callback which has been registered
+ * later in the same slot.
+ */
+struct CallbackKey
+{
+	std::size_t index{0};
+	std::size_t generation{0};
+};
+
+/**
+ * The callbacks of a core which has not been completed yet.
+ * Slots of removed callbacks are reused by later registrations, so the memory
+ * is bounded by the maximum number of callbacks which are registered at the
+ * same time. The slots are linked in the order of the registrations, so the
+ * callbacks are visited in this order even if they reuse earlier slots.
+ * Adding and removing a callback takes O(1).
+ */
+template <typename Callback>
+class CallbackList
+{
+	public:
+	CallbackKey add(Callback &&h)
+	{
+		std::size_t i;
+
+		if (freeSlots.empty())
+		{
+			i = slots.size();
+			slots.push_back(Slot{std::move(h), 0, tail, none});
+		}
+		else
+		{
+			i = freeSlots.back();
+			freeSlots.pop_back();
+			slots[i].h = std::move(h);
+			slots[i].previous = tail;
+			slots[i].next = none;
+		}
+
+		(tail == none ? head : slots[tail].next) = i;
+		tail = i;
+
+		return CallbackKey{i, slots[i].generation};
+	}
+
+	/**
+	 * Moves the callback out of the list.
+	 * The caller should destroy it without holding any lock since the destructor
+	 * of the callback might complete other cores.
+	 * @return Returns an empty callback if there is no callback with the key.
+	 */
+	Callback remove(CallbackKey key)
+	{
+		if (key.index >= slots.size())
+		{
+			return Callback();
+		}
+
+		auto &slot = slots[key.index];
+
+		if (slot.generation != key.generation || !slot.h)
+		{
+			return Callback();
+		}
+
+		Callback r = std::move(slot.h);
+		slot.h = nullptr;
+		++slot.generation;
+		(slot.previous == none ? head : slots[slot.previous].next) = slot.next;
+		(slot.next == none ? tail : slots[slot.next].previous) = slot.previous;
+		freeSlots.push_back(key.index);
+
+		return r;
+	}
+
+	std::size_t size() const
+	{
+		return slots.size() - freeSlots.size();
+	}
+
+	/**
+	 * Calls f with every registered callback in the order of the registrations.
+	 */
+	template <typename Func>
+	void forEach(Func &&f)
+	{
+		for (auto i = head; i != none; i = slots[i].next)
+		{
+			f(std::move(slots[i].h));
+		}
+	}
+
+	/**
+	 * Calls f with the key and every registered callback in the order of the
+	 * registrations.
+	 */
+	template <typename Func>
+	void forEachWithKey(Func &&f)
+	{
+		for (auto i = head; i != none; i = slots[i].next)
+		{
+			f(CallbackKey{i, slots[i].generation}, std::move(slots[i].h));
+		}
+	}
+
+	private:
+	static constexpr std::size_t none = static_cast<std::size_t>(-1);
+
+	/**
+	 * Registered slots are linked by their indices in a doubly linked list.
+	 */
+	struct Slot
+	{
+		Callback h;
+		std::size_t generation;
+		std::size_t previous;
+		std::size_t next;
+	};
+
+	std::vector<Slot> slots;
+	std::vector<std::size_t> freeSlots;
+	std::size_t head{none};
+	std::size_t tail{none};
+};
+
+/**
+ * The type independent part of a core which allows removing callbacks.
+ * It is always owned by a shared pointer, so it can hand out handles to itself.
+ */
+class CallbackRegistry : public std::enable_shared_from_this<CallbackRegistry>
+{
+	public:
+	virtual ~CallbackRegistry() = default;
+
+	/**
+	 * @return Returns true if the callback has been removed before it was
+	 * executed. Otherwise, it returns false.
+	 */
+	virtual bool removeCallback(CallbackKey key) = 0;
+};
+
+/**
+ * Is returned when a callback is registered at a future and allows removing the
+ * callback again.
+ * It does not keep the core alive.
+ */
+class CallbackHandle
+{
+	public:
+	CallbackHandle() = default;
+
+	CallbackHandle(std::weak_ptr<CallbackRegistry> registry, CallbackKey key)
+	    : registry(std::move(registry)), key(key)
+	{
+	}
+
+	/**
+	 * Removes the callback in O(1) if it has not been executed yet.
+	 * Combinators use this to release their context from input futures which are
+	 * not required anymore.
+	 * @return Returns true if the callback has been removed.
+	 */
+	bool remove()
+	{
+		auto r = registry.lock();
+		registry.reset();
+
+		return r != nullptr && r->removeCallback(key);
+	}
+
+	private:
+	std::weak_ptr<CallbackRegistry> registry;
+	CallbackKey key;
+};
+
+/**
+ * Collects the callbacks which a combinator has registered at its input
+ * futures, so they can be removed as soon as the result is known.
+ */
+class CallbackHandles
+{
+	public:
+	explicit CallbackHandles(std::size_t n)
+	{
+		handles.reserve(n);
+	}
+
+	/**
+	 * Removes the callback immediately if \ref removeAll() has already been
+	 * called.
+	 */
+	void add(CallbackHandle &&h)
+	{
+		{
+			std::lock_guard<std::mutex> l(m);
+
+			if (!removed)
+			{
+				handles.push_back(std::move(h));
+
+				return;
+			}
+		}
+
+		h.remove();
+	}
+
+	void removeAll()
+	{
+		std::vector<CallbackHandle> hs;
+
+		{
+			std::lock_guard<std::mutex> l(m);
+
+			if (removed)
+			{
+				return;
+			}
+
+			removed = true;
+			hs.swap(handles);
+		}
+
+		for (auto &h : hs)
+		{
+			h.remove();
+		}
+	}
+
+	private:
+	std::mutex m;
+	bool removed{false};
+	std::vector<CallbackHandle> handles;
+};
+
 template <typename T>
-class Core
+class Core : public CallbackRegistry
 {
 	public:
 	using Type = T;
 	using Value = Try<T>;
 	using Callback = std::function<void(const Value &)>;
-	using Callbacks = std::vector<Callback>;
-	using State = std::variant<Value, Callbacks>;
+	using Callbacks = CallbackList<Callback>;
 	using Self = Core<T>;
 	using SharedPtr = std::shared_ptr<Self>;
 
@@ -46,12 +287,35 @@ class Core
 
 	virtual bool tryComplete(Value &&v) = 0;
 
-	virtual void onComplete(Callback &&h) = 0;
+	/**
+	 * @return Returns a handle which allows removing the callback again. It might
+	 * refer to another core if this core has been linked.
+	 */
+	virtual CallbackHandle onComplete(Callback &&h) = 0;
 
 	virtual const Value &get() = 0;
 
 	virtual bool isReady() const = 0;
 
+	/**
+	 * Links this core to the root of target like the DefaultPromise of Scala.
+	 * Afterwards, the result of this core completes the root and all operations
+	 * of this core are forwarded to the root.
+	 * The callbacks of this core are moved to the root and the promises of this
+	 * core keep the root from being broken.
+	 * Hence, nothing else may complete target and a chain of cores which are
+	 * linked to each other in turn has a constant length.
+	 *
+	 * @return Returns false if this core cannot be linked since it is already
+	 * linked, it is the root of target or the executors differ.
+	 */
+	virtual bool link(const SharedPtr &target) = 0;
+
+	/**
+	 * @return Returns the core at the end of the links of this core.
+	 */
+	virtual SharedPtr root() = 0;
+
 	Executor *getExecutor() const
 	{
 		return executor;
@@ -68,7 +332,7 @@ class Core
 
 		if (r == 0)
 		{
-			tryComplete(Try<T>(std::make_exception_ptr(BrokenPromise())));
+			breakPromise();
 		}
 	}
 
@@ -77,6 +341,14 @@ class Core
 	{
 	}
 
+	/**
+	 * Is called when the last promise has been deleted.
+	 */
+	virtual void breakPromise()
+	{
+		tryComplete(Try<T>(std::make_exception_ptr(BrokenPromise())));
+	}
+
 	private:
 	Executor *executor;
 	// We do always start with one promise.
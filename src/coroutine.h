@@ -0,0 +1,252 @@
+#ifndef ADV_COROUTINE_H
+#define ADV_COROUTINE_H
+
+/*
+ * The coroutine support requires C++20. The header is empty in C++17, so it can
+ * always be included.
+ */
+#if defined(__cpp_impl_coroutine) && __has_include(<coroutine>)
+
+#include <coroutine>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <type_traits>
+
+#include "future.h"
+#include "mvar/core.h"
+
+namespace adv
+{
+
+/**
+ * Suspends a coroutine until the future is completed. The coroutine is resumed
+ * by a callback of the future, so it is resumed on the executor of the future.
+ * If the future is already completed, the coroutine is not suspended at all.
+ */
+template <typename T>
+class FutureAwaiter
+{
+	public:
+	explicit FutureAwaiter(Future<T> future) : future(std::move(future))
+	{
+	}
+
+	bool await_ready() const
+	{
+		return future.isReady();
+	}
+
+	void await_suspend(std::coroutine_handle<> h)
+	{
+		/*
+		 * The callback might resume and finish the coroutine before onComplete
+		 * returns which destroys this awaiter, so the future is copied.
+		 */
+		Future<T> f = future;
+		f.onComplete([h](const Try<T> &) { h.resume(); });
+	}
+
+	/**
+	 * @return Returns the value of the future or throws its exception.
+	 */
+	T await_resume()
+	{
+		return future.get().get();
+	}
+
+	private:
+	Future<T> future;
+};
+
+template <typename T>
+FutureAwaiter<T> operator co_await(Future<T> f)
+{
+	return FutureAwaiter<T>(std::move(f));
+}
+
+namespace detail
+{
+
+template <typename A>
+Executor *coroutineExecutor(A &a)
+{
+	if constexpr (std::is_convertible<A &, Executor *>::value)
+	{
+		return a;
+	}
+	else
+	{
+		return nullptr;
+	}
+}
+
+} // namespace detail
+
+/**
+ * The return type of a coroutine which is a future of the value returned by
+ * co_return. The coroutine starts eagerly and requires a parameter of the type
+ * Executor * which executes the callbacks of the task.
+ *
+ * The core of the task is stored in the coroutine frame together with the
+ * control block of its shared pointer, so a task allocates nothing besides the
+ * frame and the state of the core. The frame is destroyed when the coroutine has
+ * finished and the last future and callback handle of the core are gone.
+ */
+template <typename T>
+class Task : public Future<T>
+{
+	public:
+	class promise_type;
+
+	private:
+	explicit Task(typename Future<T>::CoreType core) : Future<T>(core)
+	{
+	}
+};
+
+template <typename T>
+class Task<T>::promise_type
+{
+	public:
+	template <typename... Args>
+	explicit promise_type(Args &... args)
+	{
+		static_assert(
+		    (std::is_convertible<Args &, Executor *>::value || ...),
+		    "A coroutine returning adv::Task requires an adv::Executor * parameter.");
+		((ex = ex != nullptr ? ex : detail::coroutineExecutor(args)), ...);
+	}
+
+	Task<T> get_return_object()
+	{
+		auto core = new (&storage) CoreImpl(ex);
+		self = std::shared_ptr<CoreImpl>(core, Deleter{this},
+		                                 FrameAllocator<CoreImpl>(this));
+
+		return Task<T>(self);
+	}
+
+	std::suspend_never initial_suspend() noexcept
+	{
+		return {};
+	}
+
+	/**
+	 * Releases the reference of the running coroutine to its core.
+	 */
+	auto final_suspend() noexcept
+	{
+		struct Release
+		{
+			bool await_ready() noexcept
+			{
+				return false;
+			}
+
+			void await_suspend(std::coroutine_handle<promise_type> h) noexcept
+			{
+				// Might destroy the frame.
+				auto core = std::move(h.promise().self);
+			}
+
+			void await_resume() noexcept
+			{
+			}
+		};
+
+		return Release();
+	}
+
+	void return_value(T v)
+	{
+		self->tryComplete(Try<T>(std::move(v)));
+	}
+
+	void unhandled_exception()
+	{
+		self->tryComplete(Try<T>(std::current_exception()));
+	}
+
+	private:
+	using CoreImpl = adv_mvar::Core<T>;
+
+	/**
+	 * Destroys the core when its last shared pointer is gone.
+	 */
+	struct Deleter
+	{
+		promise_type *promise;
+
+		void operator()(CoreImpl *core) const
+		{
+			core->~CoreImpl();
+		}
+	};
+
+	/**
+	 * Allocates the control block of the shared pointer of the core in the
+	 * frame if possible. When the control block is deallocated, there is no
+	 * weak pointer to the core anymore and the frame is destroyed.
+	 */
+	template <typename U>
+	struct FrameAllocator
+	{
+		using value_type = U;
+
+		explicit FrameAllocator(promise_type *promise) : promise(promise)
+		{
+		}
+
+		template <typename V>
+		FrameAllocator(const FrameAllocator<V> &other) : promise(other.promise)
+		{
+		}
+
+		U *allocate(std::size_t n)
+		{
+			if (sizeof(U) * n <= sizeof(promise->controlBlock) &&
+			    alignof(U) <= alignof(std::max_align_t))
+			{
+				return reinterpret_cast<U *>(promise->controlBlock);
+			}
+
+			return static_cast<U *>(::operator new(sizeof(U) * n));
+		}
+
+		void deallocate(U *p, std::size_t)
+		{
+			if (reinterpret_cast<unsigned char *>(p) != promise->controlBlock)
+			{
+				::operator delete(p);
+			}
+
+			std::coroutine_handle<promise_type>::from_promise(*promise).destroy();
+		}
+
+		template <typename V>
+		bool operator==(const FrameAllocator<V> &other) const
+		{
+			return promise == other.promise;
+		}
+
+		template <typename V>
+		bool operator!=(const FrameAllocator<V> &other) const
+		{
+			return promise != other.promise;
+		}
+
+		promise_type *promise;
+	};
+
+	Executor *ex = nullptr;
+	typename Core<T>::SharedPtr self;
+	alignas(CoreImpl) unsigned char storage[sizeof(CoreImpl)];
+	alignas(std::max_align_t) unsigned char controlBlock[64];
+};
+
+} // namespace adv
+
+#endif
+
+#endif
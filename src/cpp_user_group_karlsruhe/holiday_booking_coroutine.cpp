@@ -0,0 +1,25 @@
+#include <folly/executors/InlineExecutor.h>
+
+#include "holiday_booking.h"
+
+using namespace adv;
+
+Task<Hotel> bookHoliday(Executor *ex)
+{
+	auto switzerland = async(ex, getHotelSwitzerland);
+	auto usa = async(ex, getHotelUSA);
+	auto hotel = co_await switzerland.fallbackTo(usa);
+	bookHotel(hotel);
+	informFriends(hotel);
+
+	co_return hotel;
+}
+
+int main()
+{
+	folly::InlineExecutor follyEx;
+	FollyExecutor ex(&follyEx);
+	bookHoliday(&ex).get();
+
+	return 0;
+}
@@ -1,21 +1,114 @@
 #ifndef ADV_EXECUTOR_H
 #define ADV_EXECUTOR_H
 
+#include <exception>
 #include <functional>
 
 namespace adv
 {
 
+/**
+ * A future which is waited for by \ref Future::get().
+ */
+class Awaited
+{
+	public:
+	virtual ~Awaited()
+	{
+	}
+
+	virtual bool isReady() const = 0;
+
+	/**
+	 * Calls f once when the future has been completed. f might be called on any
+	 * thread.
+	 */
+	virtual void onReady(std::function<void()> &&f) = 0;
+};
+
 class Executor
 {
 	public:
 	using Function = std::function<void()>;
+	/**
+	 * Is called with the exceptions thrown by tasks of executors which run the
+	 * tasks themselves.
+	 */
+	using ExceptionHandler = std::function<void(std::exception_ptr)>;
 
 	virtual ~Executor()
 	{
 	}
 
 	virtual void add(Function &&f) = 0;
+
+	/**
+	 * Is called by \ref Future::get() on a thread whose current executor is this
+	 * executor before it blocks the thread. An executor can wait without
+	 * blocking the thread, for example by suspending the current task.
+	 *
+	 * @return Returns true if a has been completed. Otherwise, the calling thread
+	 * blocks until a has been completed.
+	 */
+	virtual bool wait(Awaited &a)
+	{
+		return false;
+	}
+
+	/**
+	 * @return Returns the executor which runs the current task of the calling
+	 * thread or nullptr.
+	 */
+	static Executor *current()
+	{
+		return currentRef();
+	}
+
+	/**
+	 * Sets the current executor of the calling thread during its lifetime.
+	 */
+	class CurrentGuard
+	{
+		public:
+		explicit CurrentGuard(Executor *ex) : previous(currentRef())
+		{
+			currentRef() = ex;
+		}
+
+		~CurrentGuard()
+		{
+			currentRef() = previous;
+		}
+
+		CurrentGuard(const CurrentGuard &) = delete;
+		CurrentGuard &operator=(const CurrentGuard &) = delete;
+
+		private:
+		Executor *previous;
+	};
+
+	/**
+	 * Reports the current exception thrown by a task to onException.
+	 * Without a handler, the exception is not hidden but terminates the program
+	 * like an exception which leaves a thread.
+	 */
+	static void handleException(const ExceptionHandler &onException)
+	{
+		if (!onException)
+		{
+			std::terminate();
+		}
+
+		onException(std::current_exception());
+	}
+
+	private:
+	static Executor *&currentRef()
+	{
+		thread_local Executor *ex = nullptr;
+
+		return ex;
+	}
 };
 
 } // namespace adv
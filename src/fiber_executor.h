@@ -0,0 +1,221 @@
+#ifndef ADV_FIBER_EXECUTOR_H
+#define ADV_FIBER_EXECUTOR_H
+
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <boost/context/fiber.hpp>
+#include <boost/context/fixedsize_stack.hpp>
+
+#include "executor.h"
+
+namespace adv
+{
+
+/**
+ * Runs every task on its own fiber based on Boost.Context. The fibers are
+ * executed by a fixed number of threads.
+ *
+ * If a task calls \ref Future::get() on a future which has not been completed,
+ * only its fiber is suspended and the thread continues with other fibers. The
+ * fiber is resumed on any of the threads when the future has been completed.
+ * Hence, synchronous code can wait for many futures at the same time with only
+ * a few threads without deadlocking them. A fiber should not rely on thread
+ * local storage, since it might be resumed on another thread.
+ *
+ * Exceptions thrown by tasks are passed to onException. Without a handler,
+ * they terminate the program.
+ *
+ * The destructor waits until all fibers have finished.
+ */
+class FiberExecutor : public Executor
+{
+	public:
+	static constexpr std::size_t DEFAULT_STACK_SIZE = 64 * 1024;
+
+	explicit FiberExecutor(std::size_t threads,
+	                       std::size_t stackSize = DEFAULT_STACK_SIZE,
+	                       ExceptionHandler onException = nullptr)
+	    : stackSize(stackSize), onException(std::move(onException))
+	{
+		workers.reserve(threads);
+
+		for (std::size_t i = 0; i < threads; ++i)
+		{
+			workers.emplace_back([this] { run(); });
+		}
+	}
+
+	~FiberExecutor() override
+	{
+		{
+			std::unique_lock<std::mutex> l(m);
+			finished.wait(l, [this] { return fibers == 0; });
+			stopped = true;
+		}
+
+		ready.notify_all();
+
+		for (auto &t : workers)
+		{
+			t.join();
+		}
+	}
+
+	void add(Function &&f) override
+	{
+		auto fiber = std::make_shared<Fiber>(std::move(f));
+
+		{
+			std::lock_guard<std::mutex> l(m);
+			++fibers;
+		}
+
+		push(std::move(fiber));
+	}
+
+	/**
+	 * Suspends the current fiber until a has been completed.
+	 */
+	bool wait(Awaited &a) override
+	{
+		auto fiber = currentFiber();
+
+		if (fiber == nullptr)
+		{
+			return false;
+		}
+
+		// The thread registers the callback after the fiber has been suspended.
+		fiber->awaited = &a;
+		fiber->caller = std::move(fiber->caller).resume();
+
+		return true;
+	}
+
+	private:
+	struct Fiber
+	{
+		explicit Fiber(Function &&f) : f(std::move(f))
+		{
+		}
+
+		Function f;
+		boost::context::fiber context;
+		// The context of the thread which runs the fiber at the moment.
+		boost::context::fiber caller;
+		Awaited *awaited = nullptr;
+	};
+
+	const std::size_t stackSize;
+	const ExceptionHandler onException;
+	std::vector<std::thread> workers;
+	std::mutex m;
+	std::condition_variable ready;
+	std::condition_variable finished;
+	std::deque<std::shared_ptr<Fiber>> queue;
+	// The number of fibers which have not finished yet.
+	std::size_t fibers = 0;
+	bool stopped = false;
+
+	static Fiber *&currentFiber()
+	{
+		thread_local Fiber *fiber = nullptr;
+
+		return fiber;
+	}
+
+	void push(std::shared_ptr<Fiber> &&fiber)
+	{
+		{
+			std::lock_guard<std::mutex> l(m);
+			queue.push_back(std::move(fiber));
+		}
+
+		ready.notify_one();
+	}
+
+	void run()
+	{
+		CurrentGuard guard(this);
+
+		while (true)
+		{
+			std::shared_ptr<Fiber> fiber;
+
+			{
+				std::unique_lock<std::mutex> l(m);
+				ready.wait(l, [this] { return stopped || !queue.empty(); });
+
+				if (queue.empty())
+				{
+					return;
+				}
+
+				fiber = std::move(queue.front());
+				queue.pop_front();
+			}
+
+			resume(fiber);
+		}
+	}
+
+	void resume(const std::shared_ptr<Fiber> &fiber)
+	{
+		if (!fiber->context)
+		{
+			auto raw = fiber.get();
+			fiber->context = boost::context::fiber(
+			    std::allocator_arg, boost::context::fixedsize_stack(stackSize),
+			    [this, raw](boost::context::fiber &&caller) {
+				    raw->caller = std::move(caller);
+
+				    try
+				    {
+					    raw->f();
+				    }
+				    catch (const boost::context::detail::forced_unwind &)
+				    {
+					    throw;
+				    }
+				    catch (...)
+				    {
+					    handleException(onException);
+				    }
+
+				    raw->f = nullptr;
+
+				    return std::move(raw->caller);
+			    });
+		}
+
+		currentFiber() = fiber.get();
+		fiber->context = std::move(fiber->context).resume();
+		currentFiber() = nullptr;
+
+		if (fiber->context)
+		{
+			auto a = fiber->awaited;
+			fiber->awaited = nullptr;
+			// The callback keeps the suspended fiber alive.
+			a->onReady([this, f = fiber]() mutable { push(std::move(f)); });
+		}
+		else
+		{
+			std::lock_guard<std::mutex> l(m);
+
+			if (--fibers == 0)
+			{
+				finished.notify_all();
+			}
+		}
+	}
+};
+
+} // namespace adv
+
+#endif
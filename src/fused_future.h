@@ -0,0 +1,209 @@
+#ifndef ADV_FUSED_FUTURE_H
+#define ADV_FUSED_FUTURE_H
+
+#include <optional>
+#include <type_traits>
+
+#include "future.h"
+
+namespace adv
+{
+
+namespace detail
+{
+
+/**
+ * The function of a fused chain without any continuation.
+ */
+template <typename T>
+struct FuseIdentity
+{
+	T operator()(const Try<T> &t) const
+	{
+		return t.get();
+	}
+};
+
+/**
+ * Calls f with t and stores its result or exception like \ref Future::then().
+ */
+template <typename S, typename Func, typename T>
+Try<S> fuseApply(Func &f, const Try<T> &t)
+{
+	try
+	{
+		return Try<S>(S(f(t)));
+	}
+	catch (...)
+	{
+		return Try<S>(std::current_exception());
+	}
+}
+
+/**
+ * Calls g with the result of f, so two continuations are fused into one.
+ */
+template <typename S, typename F, typename G>
+struct FuseCompose
+{
+	F f;
+	G g;
+
+	template <typename T>
+	auto operator()(const Try<T> &t) -> decltype(g(std::declval<Try<S>>()))
+	{
+		return g(fuseApply<S>(f, t));
+	}
+};
+
+/**
+ * The function of a chain with Func after adding G. The identity is dropped.
+ */
+template <typename T, typename S, typename Func, typename G>
+using FuseNext =
+    typename std::conditional<std::is_same<Func, FuseIdentity<T>>::value, G,
+                              FuseCompose<S, Func, G>>::type;
+
+} // namespace detail
+
+/**
+ * A chain of continuations which has not been observed yet. It is returned by
+ * \ref Future::fuse().
+ * Calling \ref then() on a temporary chain composes the continuations into one
+ * callable at compile time instead of creating a promise, a core, a callback
+ * and an executor task per continuation. The chain is materialized into one
+ * future when it is observed by \ref future(), \ref get(), \ref onComplete() or
+ * \ref isReady() or when it is converted into a future. Calling \ref then() on
+ * a chain which is stored in a variable materializes it first, since the
+ * intermediate result might be shared. Continuations which are added to a
+ * chain after it has been materialized continue the materialized future.
+ *
+ * @tparam T The type of the source future.
+ * @tparam S The result type of the chain.
+ */
+template <typename T, typename S, typename Func>
+class FusedFuture
+{
+	public:
+	using Type = S;
+
+	FusedFuture(Future<T> source, Func &&f)
+	    : source(source), f(std::in_place, std::move(f))
+	{
+	}
+
+	template <typename G>
+	FusedFuture<T, typename std::result_of<G(const Try<S> &)>::type,
+	            detail::FuseNext<T, S, Func, typename std::decay<G>::type>>
+	then(G &&g) &&
+	{
+		using R = typename std::result_of<G(const Try<S> &)>::type;
+		using GF = typename std::decay<G>::type;
+		using Next = detail::FuseNext<T, S, Func, GF>;
+
+		if (materialized)
+		{
+			// f has already been attached to the source, so g continues the
+			// materialized future and the result has no function.
+			return FusedFuture<T, R, Next>(source,
+			                               materialized->then(std::forward<G>(g)));
+		}
+
+		return FusedFuture<T, R, Next>(source,
+		                               fuseNext(GF(std::forward<G>(g))));
+	}
+
+	template <typename G>
+	FusedFuture<S, typename std::result_of<G(const Try<S> &)>::type,
+	            typename std::decay<G>::type>
+	then(G &&g) &
+	{
+		return FusedFuture<S, S, detail::FuseIdentity<S>>(
+		           future(), detail::FuseIdentity<S>())
+		    .then(std::forward<G>(g));
+	}
+
+	/**
+	 * Materializes the chain with one promise and one callback at the source
+	 * future unless it has been materialized before.
+	 */
+	Future<S> future()
+	{
+		if (!materialized)
+		{
+			if constexpr (std::is_same<Func, detail::FuseIdentity<T>>::value)
+			{
+				materialized.emplace(source);
+			}
+			else
+			{
+				materialized.emplace(source.then(std::move(*f)));
+			}
+
+			f.reset();
+		}
+
+		return *materialized;
+	}
+
+	operator Future<S>()
+	{
+		return future();
+	}
+
+	Executor *getExecutor() const
+	{
+		return source.getExecutor();
+	}
+
+	const Try<S> &get()
+	{
+		future();
+
+		return materialized->get();
+	}
+
+	bool isReady()
+	{
+		return future().isReady();
+	}
+
+	CallbackHandle onComplete(typename Core<S>::Callback &&h)
+	{
+		return future().onComplete(std::move(h));
+	}
+
+	private:
+	template <typename, typename, typename>
+	friend class FusedFuture;
+
+	/**
+	 * Creates a chain which has already been materialized.
+	 */
+	FusedFuture(Future<T> source, Future<S> &&materialized)
+	    : source(source), materialized(std::move(materialized))
+	{
+	}
+
+	template <typename GF>
+	detail::FuseNext<T, S, Func, GF> fuseNext(GF &&g)
+	{
+		if constexpr (std::is_same<Func, detail::FuseIdentity<T>>::value)
+		{
+			return std::move(g);
+		}
+		else
+		{
+			return detail::FuseNext<T, S, Func, GF>{std::move(*f), std::move(g)};
+		}
+	}
+
+	Future<T> source;
+	// Exactly one of f and materialized is set.
+	std::optional<Func> f;
+	std::optional<Future<S>> materialized;
+};
+
+} // namespace adv
+
+#endif
@@ -1,6 +1,7 @@
 #ifndef ADV_FUTURE_H
 #define ADV_FUTURE_H
 
+#include <chrono>
 #include <exception>
 #include <utility>
 #include <vector>
@@ -17,9 +18,37 @@ class PredicateNotFulfilled : public std::exception
 {
 };
 
+/**
+ * A future returned by \ref Future::within() fails with this exception if the
+ * original future is not completed in time.
+ */
+class Timeout : public std::exception
+{
+};
+
 template <typename T>
 class Promise;
 
+template <typename T>
+class LazyFuture;
+
+template <typename T>
+class Task;
+
+template <typename State>
+class Actor;
+
+template <typename T, typename S, typename Func>
+class FusedFuture;
+
+namespace detail
+{
+template <typename T>
+struct FuseIdentity;
+}
+
+class TimerExecutor;
+
 /**
  * A shared future which can be copied around and has multiple read semantics.
  * It can get multiple callbacks.
@@ -54,8 +83,24 @@ class Future
 		return core->getExecutor();
 	}
 
+	/**
+	 * Blocks until the future has been completed. If the calling thread runs a
+	 * task of an executor, the executor can wait without blocking the thread.
+	 * See \ref Executor::wait().
+	 */
 	const Try<T> &get()
 	{
+		if (!core->isReady())
+		{
+			auto ex = Executor::current();
+
+			if (ex != nullptr)
+			{
+				CoreAwaited a(core);
+				ex->wait(a);
+			}
+		}
+
 		return core->get();
 	}
 
@@ -64,21 +109,38 @@ class Future
 		return core->isReady();
 	}
 
-	void onComplete(typename Core<T>::Callback &&h)
+	/**
+	 * @return Returns a handle which allows removing the callback again before
+	 * it is executed.
+	 */
+	CallbackHandle onComplete(typename Core<T>::Callback &&h)
 	{
-		core->onComplete(std::move(h));
+		return core->onComplete(std::move(h));
 	}
 
 	// Derived methods:
 	template <typename Func>
-	void onSuccess(Func &&f);
+	CallbackHandle onSuccess(Func &&f);
 
 	template <typename Func>
-	void onFailure(Func &&f);
+	CallbackHandle onFailure(Func &&f);
 
 	template <typename Func>
 	Future<typename std::result_of<Func(const Try<T> &)>::type> then(Func &&f);
 
+	/**
+	 * @return A chain which fuses the continuations added by \ref
+	 * FusedFuture::then() into one continuation of this future, so a chain of n
+	 * continuations needs one promise and one executor task instead of n.
+	 */
+	FusedFuture<T, T, detail::FuseIdentity<T>> fuse();
+
+	/**
+	 * @return A new future which is completed with the future returned by f. The
+	 * core of the returned future is linked to the core of the new future if
+	 * both have the same executor, so recursive calls do not build up a chain of
+	 * futures.
+	 */
 	template <typename Func>
 	typename std::result_of<Func(const Try<T> &)>::type thenWith(Func &&f);
 
@@ -99,6 +161,18 @@ class Future
 
 	Self fallbackTo(Self other);
 
+	/**
+	 * @return A new future which is completed with the result of this future or
+	 * with the result of other if this future fails. other is only forced if this
+	 * future fails, so an unused fallback is never computed.
+	 */
+	Self fallbackTo(LazyFuture<T> other);
+
+	/**
+	 * @return A new future which is completed with the first completed future of
+	 * this and other. The callback of the other future is removed as soon as the
+	 * result is known, so long-lived futures do not collect callbacks.
+	 */
 	Self first(Self other);
 
 	/**
@@ -108,12 +182,58 @@ class Future
 	 */
 	Self firstSucc(Self other);
 
+	/**
+	 * @return A new future which is completed with the result of this future or
+	 * fails with \ref Timeout if this future is not completed within d. The timer
+	 * is removed as soon as this future is completed.
+	 * @param timer If it is nullptr, \ref TimerExecutor::getDefault() is used.
+	 */
+	Self within(std::chrono::steady_clock::duration d,
+	            TimerExecutor *timer = nullptr);
+
+	/**
+	 * @return A new future which is completed with the result of this future but
+	 * not before d has passed.
+	 * @param timer If it is nullptr, \ref TimerExecutor::getDefault() is used.
+	 */
+	Self delayed(std::chrono::steady_clock::duration d,
+	             TimerExecutor *timer = nullptr);
+
 	private:
 	CoreType core;
 
+	class CoreAwaited : public Awaited
+	{
+		public:
+		explicit CoreAwaited(const CoreType &core) : core(core)
+		{
+		}
+
+		bool isReady() const override
+		{
+			return core->isReady();
+		}
+
+		void onReady(std::function<void()> &&f) override
+		{
+			// f might destroy this object before onComplete returns.
+			auto c = core;
+			c->onComplete([f = std::move(f)](const Try<T> &) { f(); });
+		}
+
+		private:
+		CoreType core;
+	};
+
 	template <typename S>
 	friend class Promise;
 
+	template <typename S>
+	friend class Task;
+
+	template <typename S>
+	friend class Actor;
+
 	explicit Future(CoreType s) : core(s)
 	{
 	}
@@ -130,6 +250,14 @@ template <typename Func>
 Future<typename std::result_of<Func()>::type> async(adv::Executor *ex,
                                                     Func &&f);
 
+/**
+ * @return A future which is completed after d has passed. Its callbacks are
+ * executed by ex.
+ * @param timer If it is nullptr, \ref TimerExecutor::getDefault() is used.
+ */
+Future<Unit> sleep(Executor *ex, std::chrono::steady_clock::duration d,
+                   TimerExecutor *timer = nullptr);
+
 template <typename T>
 Future<std::vector<std::pair<std::size_t, Try<T>>>>
 firstN(Executor *ex, std::vector<Future<T>> futures, std::size_t n);
@@ -4,16 +4,19 @@
 #include <type_traits>
 
 #include "future.h"
+#include "fused_future.h"
+#include "lazy_future.h"
 #include "promise.h"
+#include "timer_executor.h"
 
 namespace adv
 {
 
 template <typename T>
 template <typename Func>
-void Future<T>::onSuccess(Func &&f)
+CallbackHandle Future<T>::onSuccess(Func &&f)
 {
-	this->onComplete([f = std::move(f)](const Try<T> &t) mutable {
+	return this->onComplete([f = std::forward<Func>(f)](const Try<T> &t) mutable {
 		if (t.hasValue())
 		{
 			f(t.get());
@@ -23,9 +26,9 @@ void Future<T>::onSuccess(Func &&f)
 
 template <typename T>
 template <typename Func>
-void Future<T>::onFailure(Func &&f)
+CallbackHandle Future<T>::onFailure(Func &&f)
 {
-	this->onComplete([f = std::move(f)](const Try<T> &t) mutable {
+	return this->onComplete([f = std::forward<Func>(f)](const Try<T> &t) mutable {
 		if (t.hasException())
 		{
 			try
@@ -64,6 +67,13 @@ Future<T>::then(Func &&f)
 	return r;
 }
 
+template <typename T>
+FusedFuture<T, T, detail::FuseIdentity<T>> Future<T>::fuse()
+{
+	return FusedFuture<T, T, detail::FuseIdentity<T>>(
+	    *this, detail::FuseIdentity<T>());
+}
+
 template <typename T>
 template <typename Func>
 typename std::result_of<Func(const Try<T> &)>::type
@@ -75,10 +85,19 @@ Future<T>::thenWith(Func &&f)
 	auto p = createPromise<S>();
 
 	this->onComplete([f = std::move(f), p](const Try<T> &t) mutable {
-		// The future will stay alive until it is completed.
 		Future<S> future = f(t);
-		future.onComplete([future](const Try<S> &) {});
-		p.tryCompleteWith(future);
+
+		/*
+		 * Only the returned future completes p, so its core can be linked to the
+		 * core of p. Recursive calls of thenWith do not build up a chain of
+		 * promises then.
+		 */
+		if (!p.tryLinkWith(future))
+		{
+			// The future will stay alive until it is completed.
+			future.onComplete([future](const Try<S> &) {});
+			p.tryCompleteWith(future);
+		}
 	});
 
 	return p.future();
@@ -87,10 +106,18 @@ Future<T>::thenWith(Func &&f)
 template <typename T>
 Future<T> Future<T>::fallbackTo(Future<T> other)
 {
-	return this->thenWith([other](const Try<T> &t) mutable -> Future<T> {
+	return fallbackTo(LazyFuture<T>(other));
+}
+
+template <typename T>
+Future<T> Future<T>::fallbackTo(LazyFuture<T> other)
+{
+	auto ex = getExecutor();
+
+	return this->thenWith([ex, other](const Try<T> &t) mutable -> Future<T> {
 		if (t.hasException())
 		{
-			return other.template then([&t](const Try<T> &tt) mutable {
+			return other.force().then([t](const Try<T> &tt) {
 				if (tt.hasException())
 				{
 					return t.get();
@@ -103,7 +130,7 @@ Future<T> Future<T>::fallbackTo(Future<T> other)
 		}
 		else
 		{
-			auto p = other.template createPromise<T>();
+			Promise<T> p(ex);
 			p.tryComplete(Try<T>(t));
 			return p.future();
 		}
@@ -113,33 +140,118 @@ Future<T> Future<T>::fallbackTo(Future<T> other)
 template <typename T>
 Future<T> Future<T>::first(Future<T> other)
 {
-	auto p = createPromise<T>();
-	this->onComplete([p](const Try<T> &t) mutable { p.tryComplete(Try<T>(t)); });
-	other.onComplete([p](const Try<T> &t) mutable { p.tryComplete(Try<T>(t)); });
+	struct Context
+	{
+		explicit Context(Promise<T> &&p) : p(std::move(p))
+		{
+		}
 
-	return p.future();
+		Promise<T> p;
+		CallbackHandles handles{2};
+	};
+	auto ctx = std::make_shared<Context>(createPromise<T>());
+	auto h = [ctx](const Try<T> &t) {
+		if (ctx->p.tryComplete(Try<T>(t)))
+		{
+			ctx->handles.removeAll();
+		}
+	};
+	ctx->handles.add(this->onComplete(h));
+	ctx->handles.add(other.onComplete(h));
+
+	return ctx->p.future();
 }
 
 template <typename T>
 Future<T> Future<T>::firstSucc(Future<T> other)
 {
-	auto p = createPromise<T>();
 	struct Context
 	{
-		explicit Context(Promise<T> &&p) : p(p)
+		explicit Context(Promise<T> &&p) : p(std::move(p))
 		{
 		}
 
 		Promise<T> p;
-		std::atomic<int> failCounter{0};
+		CallbackHandles handles{2};
 	};
-	auto ctx = std::make_shared<Context>(std::move(p));
-	this->onSuccess([ctx](const T &v) { ctx->p.trySuccess(T(v)); });
-	other.onSuccess([ctx](const T &v) { ctx->p.trySuccess(T(v)); });
+	auto ctx = std::make_shared<Context>(createPromise<T>());
+	auto h = [ctx](const T &v) {
+		if (ctx->p.trySuccess(T(v)))
+		{
+			ctx->handles.removeAll();
+		}
+	};
+	ctx->handles.add(this->onSuccess(h));
+	ctx->handles.add(other.onSuccess(h));
 
 	return ctx->p.future();
 }
 
+template <typename T>
+Future<T> Future<T>::within(std::chrono::steady_clock::duration d,
+                            TimerExecutor *timer)
+{
+	if (timer == nullptr)
+	{
+		timer = TimerExecutor::getDefault();
+	}
+
+	struct Context
+	{
+		explicit Context(Promise<T> &&p) : p(std::move(p))
+		{
+		}
+
+		Promise<T> p;
+		CallbackHandles handles{2};
+	};
+	auto ctx = std::make_shared<Context>(createPromise<T>());
+	ctx->handles.add(this->onComplete([ctx](const Try<T> &t) {
+		if (ctx->p.tryComplete(Try<T>(t)))
+		{
+			ctx->handles.removeAll();
+		}
+	}));
+
+	// Do not start the timer if this future has already been completed.
+	if (!ctx->p.future().isReady())
+	{
+		ctx->handles.add(timer->schedule(d, [ctx]() {
+			if (ctx->p.tryFailure(Timeout()))
+			{
+				ctx->handles.removeAll();
+			}
+		}));
+	}
+
+	return ctx->p.future();
+}
+
+template <typename T>
+Future<T> Future<T>::delayed(std::chrono::steady_clock::duration d,
+                             TimerExecutor *timer)
+{
+	auto s = sleep(getExecutor(), d, timer);
+
+	return this->thenWith([s](const Try<T> &t) mutable {
+		return s.then([t](const Try<Unit> &) { return t.get(); });
+	});
+}
+
+inline Future<Unit> sleep(Executor *ex, std::chrono::steady_clock::duration d,
+                          TimerExecutor *timer)
+{
+	if (timer == nullptr)
+	{
+		timer = TimerExecutor::getDefault();
+	}
+
+	Promise<Unit> p(ex);
+	timer->schedule(d, [p]() mutable { p.trySuccess(Unit()); });
+
+	return p.future();
+}
+
 template <typename Func>
 Future<typename std::result_of<Func()>::type> async(adv::Executor *ex, Func &&f)
 {
@@ -168,7 +280,8 @@ firstN(Executor *ex, std::vector<Future<T>> futures, std::size_t n)
 
 	struct FirstNContext
 	{
-		FirstNContext(Executor *ex, std::size_t n) : p(ex)
+		FirstNContext(Executor *ex, std::size_t n, std::size_t total)
+		    : p(ex), handles(total)
 		{
 			/*
 			 * Reserve enough space for the vector, so emplace_back won't modify the
@@ -181,10 +294,11 @@ firstN(Executor *ex, std::vector<Future<T>> futures, std::size_t n)
 		std::atomic<std::size_t> vectorSize = {0};
 		std::atomic<std::size_t> completed = {0};
 		Promise<V> p;
+		CallbackHandles handles;
 	};
 
-	auto ctx = std::make_shared<FirstNContext>(ex, n);
 	const std::size_t total = futures.size();
+	auto ctx = std::make_shared<FirstNContext>(ex, n, total);
 
 	if (total < n)
 	{
@@ -196,7 +310,7 @@ firstN(Executor *ex, std::vector<Future<T>> futures, std::size_t n)
 
 		for (auto it = futures.begin(); it != futures.end(); ++it, ++i)
 		{
-			it->onComplete([ctx, n, total, i](const Try<T> &t) {
+			ctx->handles.add(it->onComplete([ctx, n, total, i](const Try<T> &t) {
 				auto c = ++ctx->completed;
 
 				if (c <= n)
@@ -216,9 +330,10 @@ firstN(Executor *ex, std::vector<Future<T>> futures, std::size_t n)
 					if (s == n)
 					{
 						ctx->p.trySuccess(std::move(ctx->v));
+						ctx->handles.removeAll();
 					}
 				}
-			});
+			}));
 		}
 	}
 
@@ -233,7 +348,8 @@ firstNSucc(Executor *ex, std::vector<Future<T>> futures, std::size_t n)
 
 	struct FirstNSuccContext
 	{
-		FirstNSuccContext(Executor *ex, std::size_t n) : p(ex)
+		FirstNSuccContext(Executor *ex, std::size_t n, std::size_t total)
+		    : p(ex), handles(total)
 		{
 			/*
 			 * Reserve enough space for the vector, so emplace_back won't modify the
@@ -247,10 +363,11 @@ firstNSucc(Executor *ex, std::vector<Future<T>> futures, std::size_t n)
 		std::atomic<std::size_t> succeeded = {0};
 		std::atomic<std::size_t> failed = {0};
 		Promise<V> p;
+		CallbackHandles handles;
 	};
 
-	auto ctx = std::make_shared<FirstNSuccContext>(ex, n);
 	const std::size_t total = futures.size();
+	auto ctx = std::make_shared<FirstNSuccContext>(ex, n, total);
 
 	if (total < n)
 	{
@@ -262,7 +379,7 @@ firstNSucc(Executor *ex, std::vector<Future<T>> futures, std::size_t n)
 
 		for (auto it = futures.begin(); it != futures.end(); ++it, ++i)
 		{
-			it->onComplete([ctx, n, total, i](const Try<T> &t) {
+			ctx->handles.add(it->onComplete([ctx, n, total, i](const Try<T> &t) {
 				// ignore exceptions until as many futures failed that n futures cannot be
 				// completed successfully anymore
 				if (t.hasException())
@@ -284,6 +401,8 @@ firstNSucc(Executor *ex, std::vector<Future<T>> futures, std::size_t n)
 						{
 							ctx->p.tryFailure(std::current_exception());
 						}
+
+						ctx->handles.removeAll();
 					}
 				}
 				else
@@ -307,10 +426,11 @@ firstNSucc(Executor *ex, std::vector<Future<T>> futures, std::size_t n)
 						if (s == n)
 						{
 							ctx->p.trySuccess(std::move(ctx->v));
+							ctx->handles.removeAll();
 						}
 					}
 				}
-			});
+			}));
 		}
 	}
 
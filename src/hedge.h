@@ -0,0 +1,312 @@
+#ifndef ADV_HEDGE_H
+#define ADV_HEDGE_H
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <vector>
+
+#include "future.h"
+#include "promise.h"
+#include "timer_executor.h"
+
+namespace adv
+{
+
+/**
+ * A lock-free histogram of latencies which is used to derive the delay of
+ * hedged attempts from a percentile of the observed latencies.
+ * The buckets have a relative precision of 25 percent.
+ * When the number of samples reaches the window size, all buckets are halved,
+ * so old samples fade out and the percentiles adapt to changed latencies.
+ */
+class LatencyHistogram
+{
+	public:
+	using Duration = std::chrono::steady_clock::duration;
+
+	explicit LatencyHistogram(
+	    Duration initial = std::chrono::milliseconds(10),
+	    std::uint64_t window = 10000)
+	    : initial(initial), window(window)
+	{
+		for (auto &b : buckets)
+		{
+			b = 0;
+		}
+	}
+
+	LatencyHistogram(const LatencyHistogram &) = delete;
+	LatencyHistogram &operator=(const LatencyHistogram &) = delete;
+
+	void record(Duration latency)
+	{
+		const auto us =
+		    std::chrono::duration_cast<std::chrono::microseconds>(latency).count();
+		++buckets[bucket(us < 0 ? 0 : static_cast<std::uint64_t>(us))];
+
+		if (++samples == window)
+		{
+			// Concurrent samples might get lost which does not matter for an estimate.
+			for (auto &b : buckets)
+			{
+				b -= b.load() / 2;
+			}
+
+			samples -= window / 2;
+		}
+	}
+
+	/**
+	 * @param p The percentile between 0 and 1.
+	 * @return Returns the upper bound of the bucket which contains the
+	 * percentile or the initial latency if no latency has been recorded yet.
+	 */
+	Duration percentile(double p) const
+	{
+		std::array<std::uint64_t, bucketCount> counts;
+		std::uint64_t total = 0;
+
+		for (std::size_t i = 0; i < bucketCount; ++i)
+		{
+			counts[i] = buckets[i].load();
+			total += counts[i];
+		}
+
+		if (total == 0)
+		{
+			return initial;
+		}
+
+		const auto rank = static_cast<std::uint64_t>(p * (total - 1));
+		std::uint64_t seen = 0;
+
+		for (std::size_t i = 0; i < bucketCount; ++i)
+		{
+			seen += counts[i];
+
+			if (seen > rank)
+			{
+				return std::chrono::microseconds(upperBound(i));
+			}
+		}
+
+		return std::chrono::microseconds(upperBound(bucketCount - 1));
+	}
+
+	private:
+	/*
+	 * Values below 8 microseconds get their own bucket. All other values are
+	 * split by their most significant bit and the two following bits.
+	 */
+	static constexpr std::size_t bucketCount = 8 + 61 * 4;
+
+	static std::size_t bucket(std::uint64_t us)
+	{
+		if (us < 8)
+		{
+			return us;
+		}
+
+		const std::size_t msb = 63 - __builtin_clzll(us);
+
+		return 8 + (msb - 3) * 4 + ((us >> (msb - 2)) & 3);
+	}
+
+	static std::int64_t upperBound(std::size_t i)
+	{
+		if (i < 8)
+		{
+			return static_cast<std::int64_t>(i) + 1;
+		}
+
+		const std::size_t msb = (i - 8) / 4 + 3;
+		const std::uint64_t sub = (i - 8) % 4;
+
+		return static_cast<std::int64_t>(((4 + sub + 1) << (msb - 2)) - 1);
+	}
+
+	const Duration initial;
+	const std::uint64_t window;
+	std::array<std::atomic<std::uint64_t>, bucketCount> buckets;
+	std::atomic<std::uint64_t> samples{0};
+};
+
+/**
+ * Starts attempt() immediately and one additional attempt after each of the
+ * delays unless an attempt has already succeeded. The delays are relative to
+ * the call of hedge, so the number of duplicates is capped by their number.
+ * When an attempt fails or attempt() throws, the next attempt is started
+ * immediately.
+ *
+ * The first successful attempt completes the resulting future like \ref
+ * Future::firstSucc(). Afterwards, the callbacks are removed from all
+ * outstanding attempts and the timers of attempts which have not been started
+ * yet are removed. If all attempts fail, the resulting future fails with the
+ * exception of the last attempt.
+ *
+ * @param attempt Returns a future and might be called concurrently.
+ * @param latencies If it is not nullptr, the latency of every successful first
+ * attempt is recorded. It has to live until the first attempt is completed.
+ */
+template <typename Func>
+typename std::result_of<Func()>::type
+hedge(Executor *ex, Func &&attempt,
+      std::vector<std::chrono::steady_clock::duration> delays,
+      TimerExecutor *timer = nullptr, LatencyHistogram *latencies = nullptr)
+{
+	using T = typename std::result_of<Func()>::type::Type;
+	using F = typename std::decay<Func>::type;
+
+	if (timer == nullptr)
+	{
+		timer = TimerExecutor::getDefault();
+	}
+
+	struct Context
+	{
+		Context(Executor *ex, F &&attempt, std::size_t total,
+		        LatencyHistogram *latencies)
+		    : p(ex), attempt(std::move(attempt)), total(total),
+		      latencies(latencies), handles(2 * total)
+		{
+		}
+
+		Promise<T> p;
+		F attempt;
+		const std::size_t total;
+		LatencyHistogram *latencies;
+		CallbackHandles handles;
+		std::mutex m;
+		std::size_t started{0};
+		std::size_t failed{0};
+		bool done{false};
+
+		/**
+		 * Starts the next attempt unless at least n attempts have been started.
+		 */
+		static void start(const std::shared_ptr<Context> &ctx, std::size_t n)
+		{
+			std::size_t i;
+
+			{
+				std::lock_guard<std::mutex> l(ctx->m);
+
+				if (ctx->done || ctx->started >= n || ctx->started == ctx->total)
+				{
+					return;
+				}
+
+				i = ctx->started++;
+			}
+
+			const auto begin = std::chrono::steady_clock::now();
+			std::optional<Future<T>> f;
+
+			// Delayed attempts are started on the timer thread which must not throw.
+			try
+			{
+				f.emplace(ctx->attempt());
+			}
+			catch (...)
+			{
+				completeAttempt(ctx, Try<T>(std::current_exception()));
+
+				return;
+			}
+
+			if (i == 0 && ctx->latencies != nullptr)
+			{
+				f->onSuccess([latencies = ctx->latencies, begin](const T &) {
+					latencies->record(std::chrono::steady_clock::now() - begin);
+				});
+			}
+
+			ctx->handles.add(f->onComplete(
+			    [ctx](const Try<T> &t) { completeAttempt(ctx, t); }));
+		}
+
+		static void completeAttempt(const std::shared_ptr<Context> &ctx,
+		                            const Try<T> &t)
+		{
+			if (t.hasValue())
+			{
+				complete(ctx, t);
+
+				return;
+			}
+
+			bool last;
+
+			{
+				std::lock_guard<std::mutex> l(ctx->m);
+				last = ++ctx->failed == ctx->total;
+			}
+
+			if (last)
+			{
+				complete(ctx, t);
+			}
+			else
+			{
+				start(ctx, ctx->total);
+			}
+		}
+
+		static void complete(const std::shared_ptr<Context> &ctx, const Try<T> &t)
+		{
+			if (ctx->p.tryComplete(Try<T>(t)))
+			{
+				{
+					std::lock_guard<std::mutex> l(ctx->m);
+					ctx->done = true;
+				}
+
+				ctx->handles.removeAll();
+			}
+		}
+	};
+
+	auto ctx = std::make_shared<Context>(ex, F(std::forward<Func>(attempt)),
+	                                     delays.size() + 1, latencies);
+	Context::start(ctx, 1);
+
+	for (std::size_t i = 0; i < delays.size(); ++i)
+	{
+		ctx->handles.add(timer->schedule(
+		    delays[i], [ctx, i]() { Context::start(ctx, i + 2); }));
+	}
+
+	return ctx->p.future();
+}
+
+/**
+ * Hedges with the delay of the given percentile of the latencies of previous
+ * first attempts. The n-th duplicate is started after n times the delay.
+ * The latency of the first attempt is recorded in latencies.
+ */
+template <typename Func>
+typename std::result_of<Func()>::type
+hedge(Executor *ex, Func &&attempt, LatencyHistogram &latencies,
+      std::size_t maxDuplicates = 1, double percentile = 0.95,
+      TimerExecutor *timer = nullptr)
+{
+	const auto d = latencies.percentile(percentile);
+	std::vector<std::chrono::steady_clock::duration> delays;
+	delays.reserve(maxDuplicates);
+
+	for (std::size_t i = 1; i <= maxDuplicates; ++i)
+	{
+		delays.push_back(d * static_cast<int>(i));
+	}
+
+	return hedge(ex, std::forward<Func>(attempt), std::move(delays), timer,
+	             &latencies);
+}
+
+} // namespace adv
+
+#endif
@@ -0,0 +1,233 @@
+#ifndef ADV_LATCH_H
+#define ADV_LATCH_H
+
+#include <atomic>
+#include <cstdint>
+
+#include "future.h"
+#include "promise.h"
+
+namespace adv
+{
+
+/**
+ * A single-use countdown which completes a future when the counter reaches
+ * zero. It consists of one atomic counter and one promise, so counting down
+ * does not allocate anything regardless of the number of participants.
+ * Unlike \ref firstN(), it does not collect the results of the participants.
+ */
+class Latch
+{
+	public:
+	Latch(Executor *ex, std::size_t count)
+	    : counter(static_cast<std::int64_t>(count)), p(ex)
+	{
+		if (count == 0)
+		{
+			p.trySuccess(Unit());
+		}
+	}
+
+	Latch(const Latch &) = delete;
+	Latch &operator=(const Latch &) = delete;
+
+	/**
+	 * Counting down below zero has no effect.
+	 */
+	void countDown(std::size_t n = 1)
+	{
+		const auto d = static_cast<std::int64_t>(n);
+		const auto previous = counter.fetch_sub(d, std::memory_order_acq_rel);
+
+		if (previous > 0 && previous <= d)
+		{
+			p.trySuccess(Unit());
+		}
+	}
+
+	/**
+	 * @return Returns a future which is completed when the counter has reached
+	 * zero.
+	 */
+	Future<Unit> future()
+	{
+		return p.future();
+	}
+
+	bool isReady() const
+	{
+		return count() == 0;
+	}
+
+	std::size_t count() const
+	{
+		const auto c = counter.load(std::memory_order_acquire);
+
+		return c > 0 ? static_cast<std::size_t>(c) : 0;
+	}
+
+	private:
+	std::atomic<std::int64_t> counter;
+	Promise<Unit> p;
+};
+
+/**
+ * Like a \ref Latch but participants can be added as long as the counter has
+ * not reached zero, for example by producers which start further producers.
+ */
+class CountdownEvent
+{
+	public:
+	CountdownEvent(Executor *ex, std::size_t count)
+	    : counter(static_cast<std::int64_t>(count)), p(ex)
+	{
+		if (count == 0)
+		{
+			p.trySuccess(Unit());
+		}
+	}
+
+	CountdownEvent(const CountdownEvent &) = delete;
+	CountdownEvent &operator=(const CountdownEvent &) = delete;
+
+	/**
+	 * @return Returns false if the counter has already reached zero.
+	 */
+	bool tryAddCount(std::size_t n = 1)
+	{
+		auto c = counter.load(std::memory_order_acquire);
+
+		while (c > 0)
+		{
+			if (counter.compare_exchange_weak(c, c + static_cast<std::int64_t>(n),
+			                                  std::memory_order_acq_rel))
+			{
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+	/**
+	 * Counting down below zero has no effect.
+	 */
+	void signal(std::size_t n = 1)
+	{
+		const auto d = static_cast<std::int64_t>(n);
+		auto c = counter.load(std::memory_order_acquire);
+
+		while (c > 0)
+		{
+			if (counter.compare_exchange_weak(c, c > d ? c - d : 0,
+			                                  std::memory_order_acq_rel))
+			{
+				if (c <= d)
+				{
+					p.trySuccess(Unit());
+				}
+
+				return;
+			}
+		}
+	}
+
+	/**
+	 * @return Returns a future which is completed when the counter has reached
+	 * zero.
+	 */
+	Future<Unit> future()
+	{
+		return p.future();
+	}
+
+	bool isReady() const
+	{
+		return count() == 0;
+	}
+
+	std::size_t count() const
+	{
+		return static_cast<std::size_t>(counter.load(std::memory_order_acquire));
+	}
+
+	private:
+	// Never drops below zero, so participants cannot be added after completion.
+	std::atomic<std::int64_t> counter;
+	Promise<Unit> p;
+};
+
+/**
+ * A cyclic barrier for a fixed number of participants. Every participant
+ * calls \ref arrive() once per phase and gets a future which is completed when
+ * all participants have arrived. Then the next phase starts.
+ *
+ * The phase and the number of arrivals are stored in one atomic counter.
+ * Only one promise is allocated per phase. Since no participant can arrive in
+ * the next phase before the current one has been completed, two promises are
+ * enough: one for the current phase and one for the next. Hence, every phase
+ * requires exactly participants calls of \ref arrive().
+ */
+class Barrier
+{
+	public:
+	Barrier(Executor *ex, std::uint32_t participants)
+	    : ex(ex), participants(participants), promises{Promise<Unit>(ex),
+	                                                   Promise<Unit>(ex)}
+	{
+	}
+
+	Barrier(const Barrier &) = delete;
+	Barrier &operator=(const Barrier &) = delete;
+
+	/**
+	 * @return Returns a future which is completed when all participants have
+	 * arrived in the current phase.
+	 */
+	Future<Unit> arrive()
+	{
+		const auto v = counter.fetch_add(1, std::memory_order_acq_rel);
+		const auto phase = v >> 32;
+		auto &p = promises[phase % 2];
+		auto r = p.future();
+
+		if ((v & ARRIVALS) + 1 == participants)
+		{
+			/*
+			 * The slot of the next phase belongs to the previous phase whose
+			 * participants have all returned, since they have arrived in this phase.
+			 * The promises of the first two phases have been created by the constructor.
+			 */
+			if (phase > 0)
+			{
+				promises[(phase + 1) % 2] = Promise<Unit>(ex);
+			}
+
+			counter.store((phase + 1) << 32, std::memory_order_release);
+			p.trySuccess(Unit());
+		}
+
+		return r;
+	}
+
+	/**
+	 * @return Returns the number of phases which have been completed.
+	 */
+	std::uint64_t phase() const
+	{
+		return counter.load(std::memory_order_acquire) >> 32;
+	}
+
+	private:
+	static constexpr std::uint64_t ARRIVALS = 0xFFFFFFFF;
+
+	Executor *const ex;
+	const std::uint64_t participants;
+	// The upper half is the phase and the lower half the number of arrivals.
+	std::atomic<std::uint64_t> counter{0};
+	Promise<Unit> promises[2];
+};
+
+} // namespace adv
+
+#endif
@@ -0,0 +1,189 @@
+#ifndef ADV_LAZY_FUTURE_H
+#define ADV_LAZY_FUTURE_H
+
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+
+#include "future.h"
+#include "promise.h"
+
+namespace adv
+{
+
+/**
+ * A description of a computation which is only started when its result is
+ * required. It is forced by \ref get(), \ref onComplete() or \ref force() and
+ * by combinators which need its result. Continuations added with \ref then()
+ * are lazy, too, and force the previous computation when they are forced.
+ * Copies share the computation which is started at most once.
+ */
+template <typename T>
+class LazyFuture
+{
+	public:
+	using Type = T;
+	using Self = LazyFuture<T>;
+	using Function = std::function<Future<T>()>;
+
+	LazyFuture() = delete;
+
+	/**
+	 * @param f Starts the computation and is called at most once.
+	 */
+	LazyFuture(Executor *ex, Function &&f)
+	    : state(std::make_shared<State>(ex, std::move(f)))
+	{
+	}
+
+	/**
+	 * Wraps a future which has already been started.
+	 */
+	explicit LazyFuture(Future<T> f)
+	    : state(std::make_shared<State>(f.getExecutor(), nullptr))
+	{
+		state->future.emplace(std::move(f));
+	}
+
+	Executor *getExecutor() const
+	{
+		return state->ex;
+	}
+
+	/**
+	 * Starts the computation unless it has already been started.
+	 * The computation is started without holding the lock, so it might force
+	 * this lazy future itself. Concurrent and reentrant calls get a future which
+	 * is completed with the result of the computation.
+	 * If the computation throws, the future fails with the exception.
+	 */
+	Future<T> force()
+	{
+		Function f;
+		std::optional<Promise<T>> p;
+
+		{
+			std::lock_guard<std::mutex> l(state->m);
+
+			if (state->future)
+			{
+				return *state->future;
+			}
+
+			f = std::move(state->f);
+			state->f = nullptr;
+			p.emplace(state->ex);
+			state->future.emplace(p->future());
+		}
+
+		try
+		{
+			p->tryCompleteWith(f());
+		}
+		catch (...)
+		{
+			p->tryFailure(std::current_exception());
+		}
+
+		// The future is never changed after it has been set.
+		return *state->future;
+	}
+
+	bool isForced() const
+	{
+		std::lock_guard<std::mutex> l(state->m);
+
+		return state->future.has_value();
+	}
+
+	/**
+	 * Does not force the computation.
+	 */
+	bool isReady() const
+	{
+		std::lock_guard<std::mutex> l(state->m);
+
+		return state->future && state->future->isReady();
+	}
+
+	const Try<T> &get()
+	{
+		force();
+
+		// The state keeps the core alive.
+		return state->future->get();
+	}
+
+	CallbackHandle onComplete(typename Core<T>::Callback &&h)
+	{
+		return force().onComplete(std::move(h));
+	}
+
+	template <typename Func>
+	LazyFuture<typename std::result_of<Func(const Try<T> &)>::type>
+	then(Func &&f)
+	{
+		using S = typename std::result_of<Func(const Try<T> &)>::type;
+
+		return LazyFuture<S>(
+		    getExecutor(), [self = *this, f = std::forward<Func>(f)]() mutable {
+			    return self.force().then(std::move(f));
+		    });
+	}
+
+	template <typename Func>
+	LazyFuture<typename std::result_of<Func(const Try<T> &)>::type::Type>
+	thenWith(Func &&f)
+	{
+		using S = typename std::result_of<Func(const Try<T> &)>::type::Type;
+
+		return LazyFuture<S>(
+		    getExecutor(), [self = *this, f = std::forward<Func>(f)]() mutable {
+			    return self.force().thenWith(std::move(f));
+		    });
+	}
+
+	/**
+	 * @return A lazy future of this result or of the result of other if this
+	 * fails. other is only forced if this fails.
+	 */
+	Self fallbackTo(Self other)
+	{
+		return Self(getExecutor(), [self = *this, other]() mutable {
+			return self.force().fallbackTo(other);
+		});
+	}
+
+	private:
+	struct State
+	{
+		State(Executor *ex, Function &&f) : ex(ex), f(std::move(f))
+		{
+		}
+
+		Executor *const ex;
+		std::mutex m;
+		Function f;
+		std::optional<Future<T>> future;
+	};
+
+	std::shared_ptr<State> state;
+};
+
+/**
+ * @return Returns a lazy future which runs f on ex when it is forced.
+ */
+template <typename Func>
+LazyFuture<typename std::result_of<Func()>::type> lazy(Executor *ex, Func &&f)
+{
+	using T = typename std::result_of<Func()>::type;
+
+	return LazyFuture<T>(ex, [ex, f = std::forward<Func>(f)]() mutable {
+		return async(ex, std::move(f));
+	});
+}
+
+} // namespace adv
+
+#endif
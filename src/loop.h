@@ -0,0 +1,297 @@
+#ifndef ADV_LOOP_H
+#define ADV_LOOP_H
+
+#include <atomic>
+#include <memory>
+#include <optional>
+#include <variant>
+
+#include "future.h"
+#include "promise.h"
+
+namespace adv
+{
+
+/**
+ * Returned by the step of \ref loop() to start the next iteration with state.
+ */
+template <typename S>
+struct Continue
+{
+	S state;
+};
+
+/**
+ * Returned by the step of \ref loop() to complete the loop with result.
+ */
+template <typename R>
+struct Done
+{
+	R result;
+};
+
+template <typename S, typename R>
+using Step = std::variant<Continue<S>, Done<R>>;
+
+/**
+ * The default number of iterations which are run in the calling thread when
+ * their futures are completed synchronously before the loop continues with a
+ * new task on the executor.
+ */
+constexpr std::size_t LOOP_INLINE_LIMIT = 64;
+
+namespace detail
+{
+
+template <typename V>
+struct StepTraits;
+
+template <typename S, typename R>
+struct StepTraits<Step<S, R>>
+{
+	using State = S;
+	using Result = R;
+};
+
+/**
+ * Runs the iterations of an asynchronous loop with one context and one promise.
+ * step(S&) starts an iteration and returns a future. next(S&, const X&,
+ * Promise<R>&) either stores the next state and returns true or completes the
+ * promise and returns false.
+ */
+template <typename R, typename S, typename Step, typename Next>
+Future<R> runLoop(Executor *ex, S &&state, Step &&step, Next &&next,
+                  std::size_t inlineLimit)
+{
+	using StepF = typename std::decay<Step>::type;
+	using NextF = typename std::decay<Next>::type;
+	using X = typename std::result_of<StepF(S &)>::type::Type;
+
+	struct Context
+	{
+		Context(Executor *ex, S &&state, StepF &&step, NextF &&next,
+		        std::size_t inlineLimit)
+		    : p(ex), ex(ex), state(std::move(state)), step(std::move(step)),
+		      next(std::move(next)), inlineLimit(inlineLimit)
+		{
+		}
+
+		Promise<R> p;
+		Executor *ex;
+		// Only one iteration is running at a time.
+		S state;
+		StepF step;
+		NextF next;
+		const std::size_t inlineLimit;
+		std::atomic<int> pending{0};
+
+		/**
+		 * Trampoline: If the loop is resumed while it is running on the stack, the
+		 * running loop continues after returning.
+		 */
+		static void resume(const std::shared_ptr<Context> &ctx)
+		{
+			if (ctx->pending++ > 0)
+			{
+				return;
+			}
+
+			do
+			{
+				run(ctx);
+			} while (--ctx->pending > 0);
+		}
+
+		static void run(const std::shared_ptr<Context> &ctx)
+		{
+			for (std::size_t i = 0; i < ctx->inlineLimit; ++i)
+			{
+				std::optional<Future<X>> f;
+
+				try
+				{
+					f.emplace(ctx->step(ctx->state));
+				}
+				catch (...)
+				{
+					ctx->p.tryFailure(std::current_exception());
+
+					return;
+				}
+
+				if (!f->isReady())
+				{
+					f->onComplete([ctx](const Try<X> &t) {
+						if (complete(ctx, t))
+						{
+							resume(ctx);
+						}
+					});
+
+					return;
+				}
+
+				if (!complete(ctx, f->get()))
+				{
+					return;
+				}
+			}
+
+			// Give other tasks of the executor a chance to run.
+			ctx->ex->add([ctx] { resume(ctx); });
+		}
+
+		/**
+		 * @return Returns true if the loop continues.
+		 */
+		static bool complete(const std::shared_ptr<Context> &ctx, const Try<X> &t)
+		{
+			try
+			{
+				return ctx->next(ctx->state, t.get(), ctx->p);
+			}
+			catch (...)
+			{
+				ctx->p.tryFailure(std::current_exception());
+
+				return false;
+			}
+		}
+	};
+
+	auto ctx = std::make_shared<Context>(ex, std::move(state),
+	                                     StepF(std::forward<Step>(step)),
+	                                     NextF(std::forward<Next>(next)),
+	                                     inlineLimit == 0 ? 1 : inlineLimit);
+	ex->add([ctx] { Context::resume(ctx); });
+
+	return ctx->p.future();
+}
+
+} // namespace detail
+
+/**
+ * Runs an asynchronous loop like tailRecM. step is called with the state and
+ * returns a future of either \ref Continue with the state of the next iteration
+ * or \ref Done with the result of the loop. If step throws an exception or its
+ * future fails, the loop fails with the exception.
+ *
+ * All iterations share one context and one promise, so the memory stays
+ * constant regardless of the number of iterations. Iterations whose futures are
+ * completed synchronously are run in a loop up to inlineLimit times before the
+ * loop continues with a new task on ex.
+ *
+ * @param step Returns Future<Step<S, R>>.
+ */
+template <typename S, typename Func>
+Future<typename detail::StepTraits<typename std::result_of<
+    typename std::decay<Func>::type(S &&)>::type::Type>::Result>
+loop(Executor *ex, S state, Func &&step,
+     std::size_t inlineLimit = LOOP_INLINE_LIMIT)
+{
+	using V = typename std::result_of<typename std::decay<Func>::type(
+	    S &&)>::type::Type;
+	using R = typename detail::StepTraits<V>::Result;
+
+	return detail::runLoop<R>(
+	    ex, std::move(state),
+	    [step = std::forward<Func>(step)](S &s) mutable {
+		    return step(std::move(s));
+	    },
+	    [](S &s, const V &v, Promise<R> &p) {
+		    if (v.index() == 0)
+		    {
+			    s = std::get<0>(v).state;
+
+			    return true;
+		    }
+
+		    p.trySuccess(R(std::get<1>(v).result));
+
+		    return false;
+	    },
+	    inlineLimit);
+}
+
+/**
+ * Calls body as long as cond returns true like a while loop. The next call of
+ * cond happens when the future returned by body has been completed
+ * successfully.
+ *
+ * @param cond Returns a bool.
+ * @param body Returns a future of any type.
+ */
+template <typename Cond, typename Body>
+Future<Unit> whileDo(Executor *ex, Cond &&cond, Body &&body,
+                     std::size_t inlineLimit = LOOP_INLINE_LIMIT)
+{
+	using X = typename std::result_of<Body()>::type::Type;
+
+	Promise<Unit> p(ex);
+
+	try
+	{
+		if (!cond())
+		{
+			p.trySuccess(Unit());
+
+			return p.future();
+		}
+	}
+	catch (...)
+	{
+		p.tryFailure(std::current_exception());
+
+		return p.future();
+	}
+
+	return detail::runLoop<Unit>(
+	    ex, Unit(),
+	    [body = std::forward<Body>(body)](Unit &) mutable { return body(); },
+	    [cond = std::forward<Cond>(cond)](Unit &, const X &,
+	                                      Promise<Unit> &p) mutable {
+		    if (cond())
+		    {
+			    return true;
+		    }
+
+		    p.trySuccess(Unit());
+
+		    return false;
+	    },
+	    inlineLimit);
+}
+
+/**
+ * Calls f with the state and then with the result of its previous call until
+ * the result fulfills pred.
+ *
+ * @param f Returns Future<S>.
+ * @return Returns a future of the first state which fulfills pred.
+ */
+template <typename S, typename Func, typename Pred>
+Future<S> iterateUntil(Executor *ex, S state, Func &&f, Pred &&pred,
+                       std::size_t inlineLimit = LOOP_INLINE_LIMIT)
+{
+	return detail::runLoop<S>(
+	    ex, std::move(state),
+	    [f = std::forward<Func>(f)](S &s) mutable { return f(std::move(s)); },
+	    [pred = std::forward<Pred>(pred)](S &s, const S &x,
+	                                      Promise<S> &p) mutable {
+		    if (pred(x))
+		    {
+			    p.trySuccess(S(x));
+
+			    return false;
+		    }
+
+		    s = x;
+
+		    return true;
+	    },
+	    inlineLimit);
+}
+
+} // namespace adv
+
+#endif
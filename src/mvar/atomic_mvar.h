@@ -0,0 +1,567 @@
+#ifndef ADV_MVAR_ATOMIC_MVAR_H
+#define ADV_MVAR_ATOMIC_MVAR_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <type_traits>
+
+#ifdef __linux__
+#include <climits>
+#include <ctime>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#else
+#include <condition_variable>
+#include <mutex>
+#endif
+
+namespace adv_mvar
+{
+
+namespace detail
+{
+
+/**
+ * A 32 bit counter which threads can wait on until it changes. On Linux,
+ * waiting and waking are futex system calls. Other platforms use a mutex and a
+ * condition variable.
+ */
+class Futex
+{
+	public:
+	std::uint32_t load() const
+	{
+		return v.load();
+	}
+
+	/**
+	 * Increments the counter and wakes all waiting threads.
+	 */
+	void wakeAll()
+	{
+#ifdef __linux__
+		++v;
+		syscall(SYS_futex, reinterpret_cast<std::uint32_t *>(&v),
+		        FUTEX_WAKE_PRIVATE, INT_MAX, nullptr, nullptr, 0);
+#else
+		{
+			std::lock_guard<std::mutex> l(m);
+			++v;
+		}
+
+		condition.notify_all();
+#endif
+	}
+
+	/**
+	 * Blocks while the counter is expected. It might return spuriously.
+	 */
+	void wait(std::uint32_t expected)
+	{
+#ifdef __linux__
+		syscall(SYS_futex, reinterpret_cast<std::uint32_t *>(&v),
+		        FUTEX_WAIT_PRIVATE, expected, nullptr, nullptr, 0);
+#else
+		std::unique_lock<std::mutex> l(m);
+		condition.wait(l, [this, expected] { return v.load() != expected; });
+#endif
+	}
+
+	/**
+	 * Like \ref wait() but returns when d has elapsed.
+	 */
+	void waitFor(std::uint32_t expected, std::chrono::nanoseconds d)
+	{
+		if (d <= std::chrono::nanoseconds::zero())
+		{
+			return;
+		}
+
+#ifdef __linux__
+		const auto s = std::chrono::duration_cast<std::chrono::seconds>(d);
+		timespec t;
+		t.tv_sec = static_cast<time_t>(s.count());
+		t.tv_nsec = static_cast<long>((d - s).count());
+		syscall(SYS_futex, reinterpret_cast<std::uint32_t *>(&v),
+		        FUTEX_WAIT_PRIVATE, expected, &t, nullptr, 0);
+#else
+		std::unique_lock<std::mutex> l(m);
+		condition.wait_for(l, d, [this, expected] { return v.load() != expected; });
+#endif
+	}
+
+	private:
+	static_assert(sizeof(std::atomic<std::uint32_t>) == sizeof(std::uint32_t),
+	              "The futex word has to be a plain 32 bit integer.");
+
+	std::atomic<std::uint32_t> v{0};
+#ifndef __linux__
+	std::mutex m;
+	std::condition_variable condition;
+#endif
+};
+
+/**
+ * Parks threads which wait for a change of some lock-free state. A thread
+ * counts itself as waiting before it checks the state again, and a thread
+ * which changes the state wakes the parked threads only if there are any. The
+ * fences order the change of the state and the check of the counter, so no
+ * wakeup is lost. Hence, operations which do not have to wait do not need any
+ * system call.
+ */
+class Parking
+{
+	public:
+	/**
+	 * Has to be called after the state has been changed.
+	 */
+	void changed()
+	{
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+
+		if (waiters.load(std::memory_order_relaxed) > 0)
+		{
+			futex.wakeAll();
+		}
+	}
+
+	/**
+	 * Calls f until it returns a value and parks the thread in between.
+	 *
+	 * @return Returns the value returned by f.
+	 */
+	template <typename Func>
+	auto park(Func &&f) -> typename decltype(f())::value_type
+	{
+		auto r = f();
+
+		if (r)
+		{
+			return std::move(*r);
+		}
+
+		++waiters;
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+
+		while (true)
+		{
+			const auto expected = futex.load();
+			r = f();
+
+			if (r)
+			{
+				--waiters;
+
+				return std::move(*r);
+			}
+
+			futex.wait(expected);
+		}
+	}
+
+	/**
+	 * Like \ref park() but returns nothing if f has not returned a value
+	 * within d.
+	 */
+	template <typename Func, typename Rep, typename Period>
+	auto parkFor(Func &&f, const std::chrono::duration<Rep, Period> &d)
+	    -> decltype(f())
+	{
+		auto r = f();
+
+		if (r)
+		{
+			return r;
+		}
+
+		const auto deadline = std::chrono::steady_clock::now() + d;
+		++waiters;
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+
+		while (true)
+		{
+			const auto expected = futex.load();
+			r = f();
+
+			const auto remaining = deadline - std::chrono::steady_clock::now();
+
+			if (r || remaining <= std::chrono::steady_clock::duration::zero())
+			{
+				--waiters;
+
+				return r;
+			}
+
+			futex.waitFor(expected, remaining);
+		}
+	}
+
+	private:
+	std::atomic<std::uint32_t> waiters{0};
+	Futex futex;
+};
+
+#if defined(__SIZEOF_INT128__) && defined(__GCC_HAVE_SYNC_COMPARE_AND_SWAP_16)
+#define ADV_MVAR_HAS_DOUBLE_WORD 1
+
+/**
+ * An atomic 16 byte integer whose operations are a double-width CAS. On x86-64
+ * this requires the compiler flag -mcx16. Other than std::atomic, the
+ * operations are always inlined and never fall back to a lock of libatomic.
+ */
+class AtomicDoubleWord
+{
+	public:
+	using Word = unsigned __int128;
+
+	explicit AtomicDoubleWord(Word w) : w(w)
+	{
+	}
+
+	Word load() const
+	{
+		// The CAS only writes the value which is already stored.
+		return __sync_val_compare_and_swap(const_cast<Word *>(&w), 0, 0);
+	}
+
+	bool compare_exchange_strong(Word &expected, Word desired)
+	{
+		const Word previous = __sync_val_compare_and_swap(&w, expected, desired);
+
+		if (previous == expected)
+		{
+			return true;
+		}
+
+		expected = previous;
+
+		return false;
+	}
+
+	bool compare_exchange_weak(Word &expected, Word desired)
+	{
+		return compare_exchange_strong(expected, desired);
+	}
+
+	private:
+	alignas(16) Word w;
+};
+#endif
+
+/**
+ * The value and the full flag of an \ref AtomicMVar in one atomic word. An
+ * empty word is always zero. Taking and putting are a single CAS if they do not
+ * have to wait. Only threads which have to wait are parked.
+ *
+ * @tparam W The unsigned integer type of the word.
+ * @tparam Atomic The atomic type which stores the word.
+ */
+template <typename W, typename Atomic = std::atomic<W>>
+class AtomicWord
+{
+	public:
+	using Word = W;
+
+	/**
+	 * The full flag is the last byte of the word, so the value can occupy the
+	 * first bytes independently of the byte order.
+	 */
+	static Word full()
+	{
+		unsigned char bytes[sizeof(Word)] = {};
+		bytes[sizeof(Word) - 1] = 1;
+		Word w;
+		std::memcpy(&w, bytes, sizeof(Word));
+
+		return w;
+	}
+
+	explicit AtomicWord(Word w = 0) : word(w)
+	{
+	}
+
+	bool tryPut(Word w)
+	{
+		Word expected = 0;
+
+		if (!word.compare_exchange_strong(expected, w))
+		{
+			return false;
+		}
+
+		parking.changed();
+
+		return true;
+	}
+
+	std::optional<Word> tryTake()
+	{
+		Word w = word.load();
+
+		while (w != 0)
+		{
+			if (word.compare_exchange_weak(w, 0))
+			{
+				parking.changed();
+
+				return w;
+			}
+		}
+
+		return std::nullopt;
+	}
+
+	std::optional<Word> tryRead() const
+	{
+		const Word w = word.load();
+
+		return w != 0 ? std::optional<Word>(w) : std::nullopt;
+	}
+
+	void put(Word w)
+	{
+		parking.park([this, w] { return tryPut(w) ? std::optional<Word>(w) : std::nullopt; });
+	}
+
+	Word take()
+	{
+		return parking.park([this] { return tryTake(); });
+	}
+
+	Word read()
+	{
+		return parking.park([this] { return tryRead(); });
+	}
+
+	template <typename Rep, typename Period>
+	bool putFor(Word w, const std::chrono::duration<Rep, Period> &d)
+	{
+		return parking.parkFor(
+		           [this, w] {
+			           return tryPut(w) ? std::optional<Word>(w) : std::nullopt;
+		           },
+		           d)
+		    .has_value();
+	}
+
+	template <typename Rep, typename Period>
+	std::optional<Word> takeFor(const std::chrono::duration<Rep, Period> &d)
+	{
+		return parking.parkFor([this] { return tryTake(); }, d);
+	}
+
+	bool isEmpty() const
+	{
+		return word.load() == 0;
+	}
+
+	private:
+	Atomic word;
+	Parking parking;
+};
+
+/**
+ * Values with less than eight bytes share one 64 bit word with the full flag.
+ * Larger values such as pointers get a word of 16 bytes, so the full flag is
+ * stored outside of the value.
+ */
+template <typename T, bool Small = (sizeof(T) < sizeof(std::uint64_t))>
+struct AtomicWordFor
+{
+	using Type = AtomicWord<std::uint64_t>;
+};
+
+#ifdef ADV_MVAR_HAS_DOUBLE_WORD
+template <typename T>
+struct AtomicWordFor<T, false>
+{
+	using Type = AtomicWord<AtomicDoubleWord::Word, AtomicDoubleWord>;
+};
+#endif
+
+} // namespace detail
+
+/**
+ * An MVar for small trivially copyable types which stores the value and whether
+ * it is full in one atomic word. Uncontended operations are a single CAS
+ * without any lock. Threads which have to wait are parked on a futex.
+ *
+ * Values with less than eight bytes are stored in a 64 bit word. Values with up
+ * to 15 bytes such as pointers are stored in a 16 byte word which requires a
+ * double-width CAS (-mcx16 on x86-64).
+ *
+ * Unlike \ref MVar, the waiting threads are not served in FIFO order, \ref
+ * read() returns a copy and there is no \ref MVar::modify().
+ */
+template <typename T>
+class AtomicMVar
+{
+	private:
+	using Word = typename detail::AtomicWordFor<T>::Type;
+
+	public:
+	using Self = AtomicMVar<T>;
+
+	static_assert(std::is_trivially_copyable<T>::value,
+	              "T has to be trivially copyable.");
+	static_assert(sizeof(T) < sizeof(typename Word::Word),
+	              "T has to fit into the atomic word with the full flag. Values "
+	              "with eight or more bytes require a double-width CAS.");
+
+	AtomicMVar() = default;
+	explicit AtomicMVar(T v) : word(encode(v))
+	{
+	}
+
+	AtomicMVar(const Self &other) = delete;
+	Self &operator=(const Self &other) = delete;
+
+	void put(T v)
+	{
+		word.put(encode(v));
+	}
+
+	T take()
+	{
+		return decode(word.take());
+	}
+
+	T read()
+	{
+		return decode(word.read());
+	}
+
+	std::optional<T> tryTake()
+	{
+		return decode(word.tryTake());
+	}
+
+	bool tryPut(T v)
+	{
+		return word.tryPut(encode(v));
+	}
+
+	std::optional<T> tryRead()
+	{
+		return decode(word.tryRead());
+	}
+
+	template <typename Rep, typename Period>
+	std::optional<T> takeFor(const std::chrono::duration<Rep, Period> &d)
+	{
+		return decode(word.takeFor(d));
+	}
+
+	template <typename Rep, typename Period>
+	bool putFor(T v, const std::chrono::duration<Rep, Period> &d)
+	{
+		return word.putFor(encode(v), d);
+	}
+
+	bool isEmpty()
+	{
+		return word.isEmpty();
+	}
+
+	private:
+	Word word;
+
+	static typename Word::Word encode(T v)
+	{
+		typename Word::Word w = 0;
+		std::memcpy(&w, &v, sizeof(T));
+
+		return w | Word::full();
+	}
+
+	static T decode(typename Word::Word w)
+	{
+		T v;
+		std::memcpy(&v, &w, sizeof(T));
+
+		return v;
+	}
+
+	static std::optional<T> decode(std::optional<typename Word::Word> w)
+	{
+		return w ? std::optional<T>(decode(*w)) : std::nullopt;
+	}
+};
+
+/**
+ * A signal which can be put and taken without any lock. It is used to wait
+ * for the completion of cores.
+ */
+template <>
+class AtomicMVar<void>
+{
+	public:
+	using Self = AtomicMVar<void>;
+
+	AtomicMVar() = default;
+	AtomicMVar(const Self &other) = delete;
+	Self &operator=(const Self &other) = delete;
+
+	void put()
+	{
+		word.put(Word::full());
+	}
+
+	void take()
+	{
+		word.take();
+	}
+
+	void read()
+	{
+		word.read();
+	}
+
+	bool tryTake()
+	{
+		return word.tryTake().has_value();
+	}
+
+	bool tryPut()
+	{
+		return word.tryPut(Word::full());
+	}
+
+	/**
+	 * @return Returns true if the MVar is full.
+	 */
+	bool tryRead()
+	{
+		return word.tryRead().has_value();
+	}
+
+	template <typename Rep, typename Period>
+	bool takeFor(const std::chrono::duration<Rep, Period> &d)
+	{
+		return word.takeFor(d).has_value();
+	}
+
+	template <typename Rep, typename Period>
+	bool putFor(const std::chrono::duration<Rep, Period> &d)
+	{
+		return word.putFor(Word::full(), d);
+	}
+
+	bool isEmpty()
+	{
+		return word.isEmpty();
+	}
+
+	private:
+	using Word = detail::AtomicWord<std::uint64_t>;
+
+	Word word;
+};
+
+} // namespace adv_mvar
+
+#endif
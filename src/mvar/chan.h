@@ -0,0 +1,598 @@
+#ifndef ADV_MVAR_CHAN_H
+#define ADV_MVAR_CHAN_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "../future.h"
+#include "../promise.h"
+#include "atomic_mvar.h"
+
+namespace adv_mvar
+{
+
+namespace detail
+{
+
+/**
+ * A bounded multi-producer multi-consumer queue of Dmitry Vyukov.
+ * Every slot of the ring has a sequence number which tells producers and
+ * consumers whether the slot is free or occupied for the current lap, so
+ * pushing and popping claim a slot with a single CAS on the positions.
+ * http://www.1024cores.net/home/lock-free-algorithms/queues/bounded-mpmc-queue
+ */
+template <typename T>
+class RingQueue
+{
+	public:
+	/**
+	 * @param capacity Is rounded up to the next power of two.
+	 */
+	explicit RingQueue(std::size_t capacity)
+	    : mask(roundUp(capacity) - 1), slots(new Slot[mask + 1])
+	{
+		for (std::size_t i = 0; i <= mask; ++i)
+		{
+			slots[i].sequence.store(i, std::memory_order_relaxed);
+		}
+	}
+
+	~RingQueue()
+	{
+		while (tryPop())
+		{
+		}
+	}
+
+	RingQueue(const RingQueue &) = delete;
+	RingQueue &operator=(const RingQueue &) = delete;
+
+	/**
+	 * Moves from v only if it returns true.
+	 */
+	bool tryPush(T &v)
+	{
+		auto pos = pushPos.load(std::memory_order_relaxed);
+		Slot *slot;
+
+		while (true)
+		{
+			slot = &slots[pos & mask];
+			const auto sequence = slot->sequence.load(std::memory_order_acquire);
+			const auto diff = static_cast<std::intptr_t>(sequence) -
+			                  static_cast<std::intptr_t>(pos);
+
+			if (diff == 0)
+			{
+				if (pushPos.compare_exchange_weak(pos, pos + 1,
+				                                  std::memory_order_relaxed))
+				{
+					break;
+				}
+			}
+			else if (diff < 0)
+			{
+				return false;
+			}
+			else
+			{
+				pos = pushPos.load(std::memory_order_relaxed);
+			}
+		}
+
+		new (&slot->storage) T(std::move(v));
+		slot->sequence.store(pos + 1, std::memory_order_release);
+
+		return true;
+	}
+
+	std::optional<T> tryPop()
+	{
+		auto pos = popPos.load(std::memory_order_relaxed);
+		Slot *slot;
+
+		while (true)
+		{
+			slot = &slots[pos & mask];
+			const auto sequence = slot->sequence.load(std::memory_order_acquire);
+			const auto diff = static_cast<std::intptr_t>(sequence) -
+			                  static_cast<std::intptr_t>(pos + 1);
+
+			if (diff == 0)
+			{
+				if (popPos.compare_exchange_weak(pos, pos + 1,
+				                                 std::memory_order_relaxed))
+				{
+					break;
+				}
+			}
+			else if (diff < 0)
+			{
+				return std::nullopt;
+			}
+			else
+			{
+				pos = popPos.load(std::memory_order_relaxed);
+			}
+		}
+
+		auto v = reinterpret_cast<T *>(&slot->storage);
+		std::optional<T> r(std::move(*v));
+		v->~T();
+		// The slot is free for the next lap.
+		slot->sequence.store(pos + mask + 1, std::memory_order_release);
+
+		return r;
+	}
+
+	/**
+	 * @return Returns the number of values which have been pushed from the
+	 * beginning of vs.
+	 */
+	std::size_t tryPushMany(std::vector<T> &vs, std::size_t first)
+	{
+		auto i = first;
+
+		while (i < vs.size() && tryPush(vs[i]))
+		{
+			++i;
+		}
+
+		return i - first;
+	}
+
+	std::size_t tryPopMany(std::vector<T> &out, std::size_t n)
+	{
+		std::size_t r = 0;
+
+		while (r < n)
+		{
+			auto v = tryPop();
+
+			if (!v)
+			{
+				break;
+			}
+
+			out.push_back(std::move(*v));
+			++r;
+		}
+
+		return r;
+	}
+
+	private:
+	struct Slot
+	{
+		std::atomic<std::size_t> sequence;
+		typename std::aligned_storage<sizeof(T), alignof(T)>::type storage;
+	};
+
+	static std::size_t roundUp(std::size_t capacity)
+	{
+		std::size_t r = 1;
+
+		while (r < capacity)
+		{
+			r <<= 1;
+		}
+
+		return r;
+	}
+
+	const std::size_t mask;
+	const std::unique_ptr<Slot[]> slots;
+	// Producers and consumers do not share a cache line.
+	alignas(64) std::atomic<std::size_t> pushPos{0};
+	alignas(64) std::atomic<std::size_t> popPos{0};
+};
+
+/**
+ * An unbounded multi-producer multi-consumer queue with one lock for the
+ * producers and one lock for the consumers like the two-lock queue of Michael
+ * and Scott. It corresponds to the write and read ends of Haskell's Chan.
+ * The first node is a dummy node, so producers and consumers only meet at the
+ * next pointer of the last node.
+ */
+template <typename T>
+class LinkedQueue
+{
+	public:
+	LinkedQueue() : head(new Node()), tail(head)
+	{
+	}
+
+	~LinkedQueue()
+	{
+		while (head != nullptr)
+		{
+			auto next = head->next.load(std::memory_order_relaxed);
+			delete head;
+			head = next;
+		}
+	}
+
+	LinkedQueue(const LinkedQueue &) = delete;
+	LinkedQueue &operator=(const LinkedQueue &) = delete;
+
+	bool tryPush(T &v)
+	{
+		auto node = new Node(std::move(v));
+		std::lock_guard<std::mutex> l(tailMutex);
+		tail->next.store(node, std::memory_order_release);
+		tail = node;
+
+		return true;
+	}
+
+	/**
+	 * Links all nodes with holding the lock only once.
+	 */
+	std::size_t tryPushMany(std::vector<T> &vs, std::size_t first)
+	{
+		if (first == vs.size())
+		{
+			return 0;
+		}
+
+		auto begin = new Node(std::move(vs[first]));
+		auto end = begin;
+
+		for (auto i = first + 1; i < vs.size(); ++i)
+		{
+			auto node = new Node(std::move(vs[i]));
+			end->next.store(node, std::memory_order_relaxed);
+			end = node;
+		}
+
+		std::lock_guard<std::mutex> l(tailMutex);
+		tail->next.store(begin, std::memory_order_release);
+		tail = end;
+
+		return vs.size() - first;
+	}
+
+	std::optional<T> tryPop()
+	{
+		Node *old;
+		std::optional<T> r;
+
+		{
+			std::lock_guard<std::mutex> l(headMutex);
+			auto next = head->next.load(std::memory_order_acquire);
+
+			if (next == nullptr)
+			{
+				return std::nullopt;
+			}
+
+			r = std::move(next->v);
+			next->v.reset();
+			old = head;
+			head = next;
+		}
+
+		delete old;
+
+		return r;
+	}
+
+	std::size_t tryPopMany(std::vector<T> &out, std::size_t n)
+	{
+		std::vector<Node *> old;
+		std::size_t r = 0;
+
+		{
+			std::lock_guard<std::mutex> l(headMutex);
+
+			while (r < n)
+			{
+				auto next = head->next.load(std::memory_order_acquire);
+
+				if (next == nullptr)
+				{
+					break;
+				}
+
+				out.push_back(std::move(*next->v));
+				next->v.reset();
+				old.push_back(head);
+				head = next;
+				++r;
+			}
+		}
+
+		for (auto node : old)
+		{
+			delete node;
+		}
+
+		return r;
+	}
+
+	private:
+	struct Node
+	{
+		Node() = default;
+
+		explicit Node(T &&v) : v(std::move(v))
+		{
+		}
+
+		std::optional<T> v;
+		std::atomic<Node *> next{nullptr};
+	};
+
+	alignas(64) std::mutex headMutex;
+	Node *head;
+	alignas(64) std::mutex tailMutex;
+	Node *tail;
+};
+
+} // namespace detail
+
+/**
+ * A multi-producer multi-consumer channel with the blocking operations of an
+ * \ref MVar. Unlike an MVar, it holds many values, so producers and consumers
+ * do not serialize on one slot. Threads are only parked if they have to wait.
+ *
+ * \ref takeAsync() returns a future instead of blocking the thread. Futures of
+ * waiting consumers are completed by the producers in FIFO order. They are
+ * broken if the channel is destroyed before.
+ *
+ * Use \ref Chan for an unbounded channel and \ref BoundedChan for a ring
+ * buffer with a fixed capacity.
+ */
+template <typename T, typename Queue>
+class BasicChan
+{
+	public:
+	using Self = BasicChan<T, Queue>;
+
+	template <typename... Args>
+	explicit BasicChan(Args &&... args) : queue(std::forward<Args>(args)...)
+	{
+	}
+
+	BasicChan(const Self &) = delete;
+	Self &operator=(const Self &) = delete;
+
+	/**
+	 * Blocks while the channel is full.
+	 */
+	void put(T v)
+	{
+		notFull.park([this, &v] {
+			return queue.tryPush(v) ? std::optional<bool>(true) : std::nullopt;
+		});
+		pushed();
+	}
+
+	/**
+	 * @return Returns false without moving v if the channel is full.
+	 */
+	bool tryPut(T &&v)
+	{
+		if (!queue.tryPush(v))
+		{
+			return false;
+		}
+
+		pushed();
+
+		return true;
+	}
+
+	/**
+	 * @return Returns false without moving v if the channel stays full for d.
+	 */
+	template <typename Rep, typename Period>
+	bool putFor(T &&v, const std::chrono::duration<Rep, Period> &d)
+	{
+		const auto r = notFull.parkFor(
+		    [this, &v] {
+			    return queue.tryPush(v) ? std::optional<bool>(true) : std::nullopt;
+		    },
+		    d);
+
+		if (r)
+		{
+			pushed();
+		}
+
+		return r.has_value();
+	}
+
+	/**
+	 * Puts all values in their order. Consecutive values are pushed at once as
+	 * long as there is space. Blocks while the channel is full.
+	 */
+	void putMany(std::vector<T> vs)
+	{
+		std::size_t first = 0;
+
+		while (first < vs.size())
+		{
+			first += notFull.park([this, &vs, first] {
+				const auto n = queue.tryPushMany(vs, first);
+
+				return n > 0 ? std::optional<std::size_t>(n) : std::nullopt;
+			});
+			pushed();
+		}
+	}
+
+	/**
+	 * Blocks while the channel is empty.
+	 */
+	T take()
+	{
+		auto r = notEmpty.park([this] { return queue.tryPop(); });
+		notFull.changed();
+
+		return r;
+	}
+
+	std::optional<T> tryTake()
+	{
+		auto r = queue.tryPop();
+
+		if (r)
+		{
+			notFull.changed();
+		}
+
+		return r;
+	}
+
+	/**
+	 * @return Returns a value or nothing if the channel stays empty for d.
+	 */
+	template <typename Rep, typename Period>
+	std::optional<T> takeFor(const std::chrono::duration<Rep, Period> &d)
+	{
+		auto r = notEmpty.parkFor([this] { return queue.tryPop(); }, d);
+
+		if (r)
+		{
+			notFull.changed();
+		}
+
+		return r;
+	}
+
+	/**
+	 * Blocks while the channel is empty.
+	 *
+	 * @return Returns at least one and at most n values.
+	 */
+	std::vector<T> takeMany(std::size_t n)
+	{
+		std::vector<T> r;
+
+		if (n > 0)
+		{
+			notEmpty.park([this, &r, n] {
+				const auto taken = queue.tryPopMany(r, n);
+
+				return taken > 0 ? std::optional<std::size_t>(taken) : std::nullopt;
+			});
+			notFull.changed();
+		}
+
+		return r;
+	}
+
+	/**
+	 * Does not block any thread.
+	 *
+	 * @return Returns a future which is completed with the next value which is
+	 * not taken by anyone else.
+	 */
+	adv::Future<T> takeAsync(adv::Executor *ex)
+	{
+		adv::Promise<T> p(ex);
+		auto r = p.future();
+		auto v = tryTake();
+
+		if (v)
+		{
+			p.trySuccess(std::move(*v));
+
+			return r;
+		}
+
+		{
+			std::lock_guard<std::mutex> l(asyncMutex);
+			asyncTakers.push_back(std::move(p));
+			++asyncTakersSize;
+		}
+
+		// A value might have been put before the consumer has been counted.
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		dispatch();
+
+		return r;
+	}
+
+	private:
+	Queue queue;
+	detail::Parking notEmpty;
+	detail::Parking notFull;
+	std::mutex asyncMutex;
+	std::deque<adv::Promise<T>> asyncTakers;
+	std::atomic<std::size_t> asyncTakersSize{0};
+
+	void pushed()
+	{
+		// The fence of changed() orders the push and the check of the takers.
+		notEmpty.changed();
+
+		if (asyncTakersSize.load(std::memory_order_relaxed) > 0)
+		{
+			dispatch();
+		}
+	}
+
+	/**
+	 * Passes values to the waiting futures. The futures are completed without
+	 * the lock, since their callbacks might use the channel.
+	 */
+	void dispatch()
+	{
+		std::vector<std::pair<adv::Promise<T>, T>> ready;
+
+		{
+			std::lock_guard<std::mutex> l(asyncMutex);
+
+			while (!asyncTakers.empty())
+			{
+				auto v = queue.tryPop();
+
+				if (!v)
+				{
+					break;
+				}
+
+				ready.emplace_back(std::move(asyncTakers.front()), std::move(*v));
+				asyncTakers.pop_front();
+				--asyncTakersSize;
+			}
+		}
+
+		if (!ready.empty())
+		{
+			notFull.changed();
+		}
+
+		for (auto &r : ready)
+		{
+			r.first.trySuccess(std::move(r.second));
+		}
+	}
+};
+
+/**
+ * An unbounded channel like Haskell's Chan. Putting never blocks.
+ */
+template <typename T>
+using Chan = BasicChan<T, detail::LinkedQueue<T>>;
+
+/**
+ * A channel with a fixed capacity which is rounded up to the next power of
+ * two. Putting blocks while the channel is full, which provides backpressure.
+ */
+template <typename T>
+using BoundedChan = BasicChan<T, detail::RingQueue<T>>;
+
+} // namespace adv_mvar
+
+#endif
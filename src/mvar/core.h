@@ -1,9 +1,24 @@
 #ifndef ADV_MVAR_CORE_H
 #define ADV_MVAR_CORE_H
 
+#include <optional>
+#include <utility>
+#include <variant>
+#include <vector>
+
 #include "../core.h"
+#include "atomic_mvar.h"
 #include "mvar.h"
 
+namespace adv
+{
+template <typename T>
+class Task;
+
+template <typename State>
+class Actor;
+}
+
 namespace adv_mvar
 {
 
@@ -15,11 +30,26 @@ class Core : public adv::Core<T>
 	using Self = Core<T>;
 	using Callback = typename Parent::Callback;
 	using Callbacks = typename Parent::Callbacks;
-	using State = typename Parent::State;
 	using Value = typename Parent::Value;
+	using SharedPtr = typename Parent::SharedPtr;
+
+	/**
+	 * The state of a core which has been linked to another core.
+	 */
+	struct Link
+	{
+		SharedPtr root;
+		/*
+		 * The generations and handles of the callbacks which have been moved to the
+		 * root indexed by their slots before linking.
+		 */
+		std::vector<std::pair<std::size_t, adv::CallbackHandle>> moved;
+	};
+
+	using State = std::variant<Value, Callbacks, Link>;
 	using MVar = adv_mvar::MVar<State>;
 	using StateSharedPtr = std::shared_ptr<MVar>;
-	using MVarSignal = adv_mvar::MVar<void>;
+	using MVarSignal = adv_mvar::AtomicMVar<void>;
 
 	Core() = delete;
 
@@ -40,55 +70,197 @@ class Core : public adv::Core<T>
 
 	Self &operator=(const Self &other) = delete;
 
+	/*
+	 * The state is changed in place with MVar::modify(), so it is never empty
+	 * and a completed state is never moved. Hence, the references returned by
+	 * get() stay valid.
+	 */
+
 	bool tryComplete(Value &&v) override
 	{
-		auto s = state->take();
+		Callbacks hs;
+		SharedPtr root;
+		const auto completed =
+		    state->modify([&v, &hs, &root](State &s) {
+			    if (s.index() == 1)
+			    {
+				    hs = std::move(std::get<Callbacks>(s));
+				    s = std::move(v);
 
-		if (s.index() == 0)
-		{
-			state->put(std::move(s));
+				    return true;
+			    }
 
-			return false;
-		}
-		else
+			    root = linkedRoot(s);
+
+			    return false;
+		    });
+
+		if (completed)
 		{
-			auto hs = std::get<Callbacks>(s);
-			state->put(std::move(v));
 			signal.put();
 			executeCallbacks(std::move(hs));
 
 			return true;
 		}
+
+		return root != nullptr && root->tryComplete(std::move(v));
 	}
 
-	void onComplete(Callback &&h) override
+	adv::CallbackHandle onComplete(Callback &&h) override
 	{
-		auto s = state->take();
+		SharedPtr root;
+		const auto key = state->modify(
+		    [&h, &root](State &s) -> std::optional<adv::CallbackKey> {
+			    if (s.index() == 1)
+			    {
+				    return std::get<Callbacks>(s).add(std::move(h));
+			    }
+
+			    root = linkedRoot(s);
 
-		if (s.index() == 0)
+			    return std::nullopt;
+		    });
+
+		if (key)
 		{
-			state->put(std::move(s));
-			executeCallback(std::move(h));
+			return adv::CallbackHandle(this->shared_from_this(), *key);
 		}
-		else
+
+		if (root != nullptr)
 		{
-			state->put(addCallback(std::move(s), std::move(h)));
+			return root->onComplete(std::move(h));
 		}
+
+		executeCallback(std::move(h));
+
+		return adv::CallbackHandle();
+	}
+
+	bool removeCallback(adv::CallbackKey key) override
+	{
+		Callback h;
+		adv::CallbackHandle moved;
+
+		state->modify([key, &h, &moved](State &s) {
+			if (s.index() == 1)
+			{
+				h = std::get<Callbacks>(s).remove(key);
+			}
+			else if (s.index() == 2)
+			{
+				auto &l = std::get<Link>(s);
+
+				if (key.index < l.moved.size() &&
+				    l.moved[key.index].first == key.generation)
+				{
+					moved = std::move(l.moved[key.index].second);
+				}
+			}
+		});
+
+		// The callback is destroyed without holding the state.
+		return static_cast<bool>(h) || moved.remove();
 	}
 
 	const Value &get() override
 	{
 		signal.read();
-		return std::get<Value>(state->read());
+		// The state does not change anymore after the signal has been put.
+		const auto &s = state->read();
+
+		if (s.index() == 2)
+		{
+			return std::get<Link>(s).root->get();
+		}
+
+		return std::get<Value>(s);
 	}
 
 	bool isReady() const override
 	{
-		auto s = state->take();
-		auto r = s.index() == 0;
-		state->put(std::move(s));
+		SharedPtr root;
+		const auto r = state->withMVar([&root](const State &s) {
+			root = linkedRoot(s);
 
-		return r;
+			return s.index() == 0;
+		});
+
+		return root != nullptr ? root->isReady() : r;
+	}
+
+	bool link(const SharedPtr &target) override
+	{
+		auto root = target->root();
+
+		if (root.get() == this ||
+		    root->getExecutor() != Parent::getExecutor())
+		{
+			return false;
+		}
+
+		Callbacks hs;
+		const auto index = state->modify([&hs, &root](State &s) {
+			const auto index = s.index();
+
+			if (index == 1)
+			{
+				hs = std::move(std::get<Callbacks>(s));
+				// The promises of this core keep the root from being broken.
+				root->incrementPromiseCounter();
+				s = Link{root, {}};
+			}
+
+			return index;
+		});
+
+		if (index == 0)
+		{
+			root->tryComplete(Value(std::get<Value>(state->read())));
+
+			return true;
+		}
+		else if (index == 2)
+		{
+			return false;
+		}
+
+		signal.put();
+
+		/*
+		 * The callbacks are registered at the root without holding the state since
+		 * they might be executed immediately.
+		 * Until their handles are stored, they cannot be removed.
+		 */
+		std::vector<std::pair<std::size_t, adv::CallbackHandle>> moved;
+		hs.forEachWithKey([&moved, &root](adv::CallbackKey key, Callback &&h) {
+			if (moved.size() <= key.index)
+			{
+				moved.resize(key.index + 1);
+			}
+
+			moved[key.index] = {key.generation, root->onComplete(std::move(h))};
+		});
+
+		if (!moved.empty())
+		{
+			state->modify([&moved](State &s) {
+				std::get<Link>(s).moved = std::move(moved);
+			});
+		}
+
+		return true;
+	}
+
+	SharedPtr root() override
+	{
+		auto root = state->withMVar(linkedRoot);
+
+		if (root != nullptr)
+		{
+			return root->root();
+		}
+
+		return std::static_pointer_cast<Parent>(this->shared_from_this());
 	}
 
 	protected:
@@ -97,12 +269,55 @@ class Core : public adv::Core<T>
 		state = std::make_shared<MVar>(State(Callbacks()));
 	}
 
+	/**
+	 * Allocates the state and the control block of its shared pointer with a.
+	 */
+	template <typename Alloc>
+	Core(adv::Executor *executor, const Alloc &a) : Parent(executor)
+	{
+		state = std::allocate_shared<MVar>(a, State(Callbacks()));
+	}
+
 	/**
 	 * Allow access to create a new Core instance.
 	 */
 	template <typename U>
 	friend class adv::Core;
 
+	/**
+	 * A task stores its core in the coroutine frame.
+	 */
+	template <typename U>
+	friend class adv::Task;
+
+	/**
+	 * An actor stores the cores of its replies in the nodes of its mailbox.
+	 */
+	template <typename U>
+	friend class adv::Actor;
+
+	/**
+	 * A linked core passes the release of its last promise on to the root.
+	 */
+	void breakPromise() override
+	{
+		auto root = state->withMVar(linkedRoot);
+
+		if (root != nullptr)
+		{
+			root->decrementPromiseCounter();
+		}
+		else
+		{
+			Parent::breakPromise();
+		}
+	}
+
+	static SharedPtr linkedRoot(const State &s)
+	{
+		return s.index() == 2 ? std::get<Link>(s).root : nullptr;
+	}
+
 	/**
 	 * We have to pass a copy of the shared pointer to ensure the lifetime when
 	 * reading the result.
@@ -118,17 +333,7 @@ class Core : public adv::Core<T>
 
 	void executeCallbacks(Callbacks &&hs)
 	{
-		for (auto h : hs)
-		{
-			executeCallback(std::move(h));
-		}
-	}
-
-	Callbacks addCallback(State &&state, Callback &&h)
-	{
-		auto hs = std::get<Callbacks>(state);
-		hs.push_back(h);
-		return hs;
+		hs.forEach([this](Callback &&h) { executeCallback(std::move(h)); });
 	}
 
 	private:
@@ -1,16 +1,320 @@
 #ifndef ADV_MVAR_MVAR_H
 #define ADV_MVAR_MVAR_H
 
+#include <algorithm>
+#include <chrono>
 #include <condition_variable>
+#include <cstdint>
 #include <mutex>
 #include <optional>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
 
 namespace adv_mvar
 {
 
+namespace detail
+{
+
+/**
+ * Wakes a thread which waits in \ref select() for several MVars at once.
+ * Every notification increments the version, so the thread notices
+ * notifications which arrive before it waits.
+ */
+class Selector
+{
+	public:
+	std::uint64_t version()
+	{
+		std::lock_guard<std::mutex> l(m);
+
+		return v;
+	}
+
+	void notify()
+	{
+		{
+			std::lock_guard<std::mutex> l(m);
+			++v;
+		}
+
+		condition.notify_one();
+	}
+
+	/**
+	 * @return Returns false if the deadline has been reached without any
+	 * notification since seen.
+	 */
+	template <typename Clock, typename Duration>
+	bool waitUntil(std::uint64_t seen,
+	               const std::optional<std::chrono::time_point<Clock, Duration>>
+	                   &deadline)
+	{
+		std::unique_lock<std::mutex> l(m);
+		auto changed = [this, seen] { return v != seen; };
+
+		if (!deadline)
+		{
+			condition.wait(l, changed);
+
+			return true;
+		}
+
+		return condition.wait_until(l, *deadline, changed);
+	}
+
+	private:
+	std::mutex m;
+	std::condition_variable condition;
+	std::uint64_t v{0};
+};
+
+template <typename T>
+class SelectGuard;
+
+/**
+ * The threads which wait for taking from or putting into an MVar in FIFO
+ * order. Every waiting thread has its own condition variable, so a put wakes
+ * only the oldest taker and a take wakes only the oldest putter. The woken
+ * thread has the state reserved until it has taken or put, so threads which
+ * arrive later cannot overtake it.
+ *
+ * All methods require the lock of the MVar.
+ */
+class Waiters
+{
+	public:
+	bool canTake(bool full) const
+	{
+		return full && !reserved;
+	}
+
+	bool canPut(bool full) const
+	{
+		return !full && !reserved;
+	}
+
+	void waitTake(std::unique_lock<std::mutex> &l, bool full)
+	{
+		wait(l, takers, canTake(full));
+	}
+
+	void waitPut(std::unique_lock<std::mutex> &l, bool full)
+	{
+		wait(l, putters, canPut(full));
+	}
+
+	template <typename Rep, typename Period>
+	bool waitTakeFor(std::unique_lock<std::mutex> &l, bool full,
+	                 const std::chrono::duration<Rep, Period> &d)
+	{
+		return waitFor(l, takers, canTake(full), d);
+	}
+
+	template <typename Rep, typename Period>
+	bool waitPutFor(std::unique_lock<std::mutex> &l, bool full,
+	                const std::chrono::duration<Rep, Period> &d)
+	{
+		return waitFor(l, putters, canPut(full), d);
+	}
+
+	/**
+	 * Waits until full returns true without taking part in the order of the
+	 * takers.
+	 */
+	template <typename Pred>
+	void waitRead(std::unique_lock<std::mutex> &l, Pred &&full)
+	{
+		++readers;
+		readCondition.wait(l, std::forward<Pred>(full));
+		--readers;
+	}
+
+	/**
+	 * Is called after a value has been taken.
+	 */
+	void taken()
+	{
+		signal(putters);
+	}
+
+	/**
+	 * Is called after a value has been put. Selectors are only notified if the
+	 * value is not reserved for a waiting taker.
+	 */
+	void put()
+	{
+		if (readers > 0)
+		{
+			readCondition.notify_all();
+		}
+
+		if (!signal(takers))
+		{
+			for (auto s : selectors)
+			{
+				s->notify();
+			}
+		}
+	}
+
+	void addSelector(Selector *s)
+	{
+		selectors.push_back(s);
+	}
+
+	void removeSelector(Selector *s)
+	{
+		selectors.erase(std::remove(selectors.begin(), selectors.end(), s),
+		                selectors.end());
+	}
+
+	private:
+	struct Waiter
+	{
+		std::condition_variable condition;
+		bool ready{false};
+		Waiter *next{nullptr};
+	};
+
+	/**
+	 * An intrusive FIFO queue of waiters which live on the stacks of the waiting
+	 * threads. Unlike std::deque, it allocates nothing, so constructing an MVar
+	 * is cheap.
+	 */
+	struct Queue
+	{
+		Waiter *front{nullptr};
+		Waiter *back{nullptr};
+
+		bool empty() const
+		{
+			return front == nullptr;
+		}
+
+		void push(Waiter *w)
+		{
+			if (back != nullptr)
+			{
+				back->next = w;
+			}
+			else
+			{
+				front = w;
+			}
+
+			back = w;
+		}
+
+		Waiter *pop()
+		{
+			auto w = front;
+			front = w->next;
+
+			if (front == nullptr)
+			{
+				back = nullptr;
+			}
+
+			return w;
+		}
+
+		void remove(Waiter *w)
+		{
+			Waiter *previous = nullptr;
+			auto c = front;
+
+			while (c != w)
+			{
+				previous = c;
+				c = c->next;
+			}
+
+			(previous != nullptr ? previous->next : front) = w->next;
+
+			if (back == w)
+			{
+				back = previous;
+			}
+		}
+	};
+
+	Queue takers;
+	Queue putters;
+	std::vector<Selector *> selectors;
+	std::condition_variable readCondition;
+	std::size_t readers{0};
+	// The state is reserved for a woken waiter.
+	bool reserved{false};
+
+	void wait(std::unique_lock<std::mutex> &l, Queue &q,
+	          bool allowed)
+	{
+		if (allowed)
+		{
+			return;
+		}
+
+		Waiter w;
+		q.push(&w);
+		w.condition.wait(l, [&w] { return w.ready; });
+		reserved = false;
+	}
+
+	template <typename Rep, typename Period>
+	bool waitFor(std::unique_lock<std::mutex> &l, Queue &q,
+	             bool allowed, const std::chrono::duration<Rep, Period> &d)
+	{
+		if (allowed)
+		{
+			return true;
+		}
+
+		Waiter w;
+		q.push(&w);
+
+		if (!w.condition.wait_for(l, d, [&w] { return w.ready; }))
+		{
+			q.remove(&w);
+
+			return false;
+		}
+
+		reserved = false;
+
+		return true;
+	}
+
+	/**
+	 * Wakes the oldest waiter of q. The notification happens with the lock, since
+	 * the waiter is destroyed as soon as it returns.
+	 */
+	bool signal(Queue &q)
+	{
+		if (q.empty())
+		{
+			return false;
+		}
+
+		auto w = q.pop();
+		w->ready = true;
+		reserved = true;
+		w->condition.notify_one();
+
+		return true;
+	}
+};
+
+} // namespace detail
+
 /**
  * http://hackage.haskell.org/package/base-4.12.0.0/docs/Control-Concurrent-MVar.html
  *
+ * Like the MVars of Haskell, blocked takers and putters are served in FIFO
+ * order and every put or take wakes at most one of them.
+ *
  * Some references:
  * https://github.com/sanketr/mvar
  * https://stackoverflow.com/a/8941979/1221159
@@ -23,7 +327,7 @@ class MVar
 	using Self = MVar<T>;
 
 	MVar() = default;
-	explicit MVar(T &&v) : v(v)
+	explicit MVar(T &&v) : v(std::move(v))
 	{
 	}
 
@@ -32,37 +336,136 @@ class MVar
 
 	void put(T &&v)
 	{
+		std::unique_lock<std::mutex> l(m);
+		waiters.waitPut(l, this->v.has_value());
+		this->v = std::move(v);
+		waiters.put();
+	}
+
+	T take()
+	{
+		std::unique_lock<std::mutex> l(m);
+		waiters.waitTake(l, v.has_value());
+
+		return takeValue();
+	}
+
+	/**
+	 * The returned reference is valid until the value is taken or modified.
+	 */
+	const T &read()
+	{
+		std::unique_lock<std::mutex> l(m);
+		waitFull(l);
+
+		return *v;
+	}
+
+	/**
+	 * @return Returns the value or nothing if the MVar is empty.
+	 */
+	std::optional<T> tryTake()
+	{
+		std::unique_lock<std::mutex> l(m);
+
+		if (!waiters.canTake(v.has_value()))
 		{
-			std::unique_lock<std::mutex> l(m);
-			putCondition.wait(l, [this] { return !this->v; });
-			this->v = v;
+			return std::nullopt;
 		}
 
-		takeCondition.notify_all();
+		return takeValue();
 	}
 
-	T take()
+	/**
+	 * @return Returns false without moving v if the MVar is full.
+	 */
+	bool tryPut(T &&v)
 	{
-		std::optional<T> r;
+		std::unique_lock<std::mutex> l(m);
 
+		if (!waiters.canPut(this->v.has_value()))
 		{
-			std::unique_lock<std::mutex> l(m);
-			takeCondition.wait(l, [this] { return this->v; });
-			r = std::move(*v);
-			v.reset();
+			return false;
 		}
 
-		putCondition.notify_all();
+		this->v = std::move(v);
+		waiters.put();
 
-		return *r;
+		return true;
 	}
 
-	const T &read()
+	/**
+	 * @return Returns a copy of the value or nothing if the MVar is empty.
+	 */
+	std::optional<T> tryRead()
 	{
 		std::unique_lock<std::mutex> l(m);
-		takeCondition.wait(l, [this] { return this->v; });
 
-		return *v;
+		return v;
+	}
+
+	/**
+	 * @return Returns the value or nothing if the MVar stays empty for d.
+	 */
+	template <typename Rep, typename Period>
+	std::optional<T> takeFor(const std::chrono::duration<Rep, Period> &d)
+	{
+		std::unique_lock<std::mutex> l(m);
+
+		if (!waiters.waitTakeFor(l, v.has_value(), d))
+		{
+			return std::nullopt;
+		}
+
+		return takeValue();
+	}
+
+	/**
+	 * @return Returns false without moving v if the MVar stays full for d.
+	 */
+	template <typename Rep, typename Period>
+	bool putFor(T &&v, const std::chrono::duration<Rep, Period> &d)
+	{
+		std::unique_lock<std::mutex> l(m);
+
+		if (!waiters.waitPutFor(l, this->v.has_value(), d))
+		{
+			return false;
+		}
+
+		this->v = std::move(v);
+		waiters.put();
+
+		return true;
+	}
+
+	/**
+	 * Waits until the MVar is full and calls f with a reference to the value
+	 * while holding the lock once, so the value can be changed in place. Unlike
+	 * a take followed by a put, nobody can observe the MVar as empty and no
+	 * waiter is notified.
+	 *
+	 * @return Returns the result of f.
+	 */
+	template <typename Func>
+	auto modify(Func &&f) -> decltype(f(std::declval<T &>()))
+	{
+		std::unique_lock<std::mutex> l(m);
+		waitFull(l);
+
+		return f(*v);
+	}
+
+	/**
+	 * Like \ref modify() but f cannot change the value.
+	 */
+	template <typename Func>
+	auto withMVar(Func &&f) -> decltype(f(std::declval<const T &>()))
+	{
+		std::unique_lock<std::mutex> l(m);
+		waitFull(l);
+
+		return f(static_cast<const T &>(*v));
 	}
 
 	bool isEmpty()
@@ -74,8 +477,23 @@ class MVar
 	private:
 	std::optional<T> v;
 	std::mutex m;
-	std::condition_variable takeCondition;
-	std::condition_variable putCondition;
+	detail::Waiters waiters;
+
+	friend class detail::SelectGuard<T>;
+
+	void waitFull(std::unique_lock<std::mutex> &l)
+	{
+		waiters.waitRead(l, [this] { return v.has_value(); });
+	}
+
+	T takeValue()
+	{
+		T r = std::move(*v);
+		v.reset();
+		waiters.taken();
+
+		return r;
+	}
 };
 
 template <>
@@ -90,30 +508,96 @@ class MVar<void>
 
 	void put()
 	{
+		std::unique_lock<std::mutex> l(m);
+		waiters.waitPut(l, v);
+		v = true;
+		waiters.put();
+	}
+
+	void take()
+	{
+		std::unique_lock<std::mutex> l(m);
+		waiters.waitTake(l, v);
+		v = false;
+		waiters.taken();
+	}
+
+	void read()
+	{
+		std::unique_lock<std::mutex> l(m);
+		waiters.waitRead(l, [this] { return v; });
+	}
+
+	bool tryTake()
+	{
+		std::unique_lock<std::mutex> l(m);
+
+		if (!waiters.canTake(v))
 		{
-			std::unique_lock<std::mutex> l(m);
-			putCondition.wait(l, [this] { return !this->v; });
-			this->v = true;
+			return false;
 		}
 
-		takeCondition.notify_all();
+		v = false;
+		waiters.taken();
+
+		return true;
 	}
 
-	void take()
+	bool tryPut()
 	{
+		std::unique_lock<std::mutex> l(m);
+
+		if (!waiters.canPut(v))
 		{
-			std::unique_lock<std::mutex> l(m);
-			takeCondition.wait(l, [this] { return this->v; });
-			this->v = false;
+			return false;
 		}
 
-		putCondition.notify_all();
+		v = true;
+		waiters.put();
+
+		return true;
 	}
 
-	void read()
+	/**
+	 * @return Returns true if the MVar is full.
+	 */
+	bool tryRead()
 	{
 		std::unique_lock<std::mutex> l(m);
-		takeCondition.wait(l, [this] { return this->v; });
+
+		return v;
+	}
+
+	template <typename Rep, typename Period>
+	bool takeFor(const std::chrono::duration<Rep, Period> &d)
+	{
+		std::unique_lock<std::mutex> l(m);
+
+		if (!waiters.waitTakeFor(l, v, d))
+		{
+			return false;
+		}
+
+		v = false;
+		waiters.taken();
+
+		return true;
+	}
+
+	template <typename Rep, typename Period>
+	bool putFor(const std::chrono::duration<Rep, Period> &d)
+	{
+		std::unique_lock<std::mutex> l(m);
+
+		if (!waiters.waitPutFor(l, v, d))
+		{
+			return false;
+		}
+
+		v = true;
+		waiters.put();
+
+		return true;
 	}
 
 	bool isEmpty()
@@ -125,10 +609,127 @@ class MVar<void>
 	private:
 	bool v{false};
 	std::mutex m;
-	std::condition_variable takeCondition;
-	std::condition_variable putCondition;
+	detail::Waiters waiters;
+};
+
+namespace detail
+{
+
+/**
+ * Registers one selector at several MVars as long as it exists.
+ */
+template <typename T>
+class SelectGuard
+{
+	public:
+	SelectGuard(const std::vector<MVar<T> *> &mvars, Selector *s)
+	    : mvars(mvars), s(s)
+	{
+		for (auto mvar : mvars)
+		{
+			std::lock_guard<std::mutex> l(mvar->m);
+			mvar->waiters.addSelector(s);
+		}
+	}
+
+	~SelectGuard()
+	{
+		for (auto mvar : mvars)
+		{
+			std::lock_guard<std::mutex> l(mvar->m);
+			mvar->waiters.removeSelector(s);
+		}
+	}
+
+	SelectGuard(const SelectGuard &) = delete;
+	SelectGuard &operator=(const SelectGuard &) = delete;
+
+	private:
+	const std::vector<MVar<T> *> &mvars;
+	Selector *const s;
 };
 
+template <typename T>
+std::optional<std::pair<std::size_t, T>>
+tryTakeFirst(const std::vector<MVar<T> *> &mvars)
+{
+	for (std::size_t i = 0; i < mvars.size(); ++i)
+	{
+		auto v = mvars[i]->tryTake();
+
+		if (v)
+		{
+			return std::make_pair(i, std::move(*v));
+		}
+	}
+
+	return std::nullopt;
+}
+
+template <typename T, typename Clock, typename Duration>
+std::optional<std::pair<std::size_t, T>>
+select(const std::vector<MVar<T> *> &mvars,
+       const std::optional<std::chrono::time_point<Clock, Duration>> &deadline)
+{
+	if (mvars.empty())
+	{
+		// Nothing could ever wake the thread.
+		throw std::invalid_argument("Select requires at least one MVar.");
+	}
+
+	auto r = tryTakeFirst(mvars);
+
+	if (r)
+	{
+		return r;
+	}
+
+	Selector s;
+	SelectGuard<T> guard(mvars, &s);
+
+	while (true)
+	{
+		const auto seen = s.version();
+		r = tryTakeFirst(mvars);
+
+		if (r || !s.waitUntil(seen, deadline))
+		{
+			return r;
+		}
+	}
+}
+
+} // namespace detail
+
+/**
+ * Takes the value of the first MVar which is full like Haskell's orElse with
+ * takeMVar. If several MVars are full, the one with the lowest index is taken.
+ * The thread waits without a thread per MVar: one waiter is registered at all
+ * MVars while it blocks and removed from them before it returns. Values which
+ * are reserved for threads waiting in \ref MVar::take() are not taken.
+ *
+ * @return Returns the index of the MVar and its value.
+ * @throw std::invalid_argument If mvars is empty.
+ */
+template <typename T>
+std::pair<std::size_t, T> select(const std::vector<MVar<T> *> &mvars)
+{
+	return std::move(*detail::select(
+	    mvars, std::optional<std::chrono::steady_clock::time_point>()));
+}
+
+/**
+ * Like \ref select() but returns nothing if no MVar has become full within d.
+ */
+template <typename T, typename Rep, typename Period>
+std::optional<std::pair<std::size_t, T>>
+selectFor(const std::vector<MVar<T> *> &mvars,
+          const std::chrono::duration<Rep, Period> &d)
+{
+	return detail::select(mvars, std::make_optional(
+	                                 std::chrono::steady_clock::now() + d));
+}
+
 } // namespace adv_mvar
 
 #endif
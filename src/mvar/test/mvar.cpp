@@ -4,6 +4,7 @@
 
 #include <boost/test/included/unit_test.hpp>
 
+#include "mvar/atomic_mvar.h"
 #include "mvar/mvar.h"
 
 BOOST_AUTO_TEST_CASE(MVarInt)
@@ -67,4 +68,261 @@ BOOST_AUTO_TEST_CASE(MVarVoid)
 	BOOST_REQUIRE(mvar.isEmpty());
 	mvar.put();
 	BOOST_REQUIRE(!mvar.isEmpty());
-}
\ No newline at end of file
+}
+
+BOOST_AUTO_TEST_CASE(MVarIntFifo)
+{
+	adv_mvar::MVar<int> mvar;
+	std::vector<int> results(3, -1);
+	std::vector<std::thread> takers;
+
+	// Every taker has enough time to block before the next one is started.
+	for (int i = 0; i < 3; ++i)
+	{
+		takers.emplace_back([&mvar, &results, i] { results[i] = mvar.take(); });
+		std::this_thread::sleep_for(std::chrono::milliseconds(50));
+	}
+
+	for (int i = 0; i < 3; ++i)
+	{
+		mvar.put(int(i));
+	}
+
+	for (auto &t : takers)
+	{
+		t.join();
+	}
+
+	BOOST_REQUIRE_EQUAL(0, results[0]);
+	BOOST_REQUIRE_EQUAL(1, results[1]);
+	BOOST_REQUIRE_EQUAL(2, results[2]);
+
+	// Blocked putters are served in the same order.
+	mvar.put(-1);
+	std::vector<std::thread> putters;
+
+	for (int i = 0; i < 3; ++i)
+	{
+		putters.emplace_back([&mvar, i] { mvar.put(int(i)); });
+		std::this_thread::sleep_for(std::chrono::milliseconds(50));
+	}
+
+	BOOST_REQUIRE_EQUAL(-1, mvar.take());
+	BOOST_REQUIRE_EQUAL(0, mvar.take());
+	BOOST_REQUIRE_EQUAL(1, mvar.take());
+	BOOST_REQUIRE_EQUAL(2, mvar.take());
+
+	for (auto &t : putters)
+	{
+		t.join();
+	}
+}
+
+BOOST_AUTO_TEST_CASE(MVarIntSelect)
+{
+	adv_mvar::MVar<int> mvar0;
+	adv_mvar::MVar<int> mvar1(1);
+	adv_mvar::MVar<int> mvar2(2);
+	const std::vector<adv_mvar::MVar<int> *> mvars{&mvar0, &mvar1, &mvar2};
+
+	// The full MVar with the lowest index is taken.
+	auto r = adv_mvar::select(mvars);
+	BOOST_REQUIRE_EQUAL(1, r.first);
+	BOOST_REQUIRE_EQUAL(1, r.second);
+	r = adv_mvar::select(mvars);
+	BOOST_REQUIRE_EQUAL(2, r.first);
+	BOOST_REQUIRE_EQUAL(2, r.second);
+	BOOST_REQUIRE(!adv_mvar::selectFor(mvars, std::chrono::milliseconds(10)));
+
+	std::thread t([&mvar2] {
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		mvar2.put(3);
+	});
+
+	r = adv_mvar::select(mvars);
+	BOOST_REQUIRE_EQUAL(2, r.first);
+	BOOST_REQUIRE_EQUAL(3, r.second);
+	t.join();
+
+	// The selector has been removed from all MVars.
+	mvar0.put(4);
+	BOOST_REQUIRE_EQUAL(4, mvar0.take());
+
+	BOOST_REQUIRE_THROW(adv_mvar::select(std::vector<adv_mvar::MVar<int> *>()),
+	                    std::invalid_argument);
+}
+
+BOOST_AUTO_TEST_CASE(MVarIntTry)
+{
+	adv_mvar::MVar<int> mvar;
+	BOOST_REQUIRE(!mvar.tryTake());
+	BOOST_REQUIRE(!mvar.tryRead());
+	BOOST_REQUIRE(mvar.tryPut(1));
+	BOOST_REQUIRE(!mvar.tryPut(2));
+	BOOST_REQUIRE_EQUAL(1, *mvar.tryRead());
+	BOOST_REQUIRE_EQUAL(1, *mvar.tryTake());
+	BOOST_REQUIRE(mvar.isEmpty());
+}
+
+BOOST_AUTO_TEST_CASE(MVarIntTimeout)
+{
+	adv_mvar::MVar<int> mvar;
+	BOOST_REQUIRE(!mvar.takeFor(std::chrono::milliseconds(10)));
+	BOOST_REQUIRE(mvar.putFor(1, std::chrono::milliseconds(10)));
+	BOOST_REQUIRE(!mvar.putFor(2, std::chrono::milliseconds(10)));
+
+	std::thread t([&mvar] { mvar.put(3); });
+
+	BOOST_REQUIRE_EQUAL(1, *mvar.takeFor(std::chrono::seconds(10)));
+	BOOST_REQUIRE_EQUAL(3, *mvar.takeFor(std::chrono::seconds(10)));
+	t.join();
+}
+
+BOOST_AUTO_TEST_CASE(MVarIntModify)
+{
+	adv_mvar::MVar<int> mvar(1);
+	auto r = mvar.modify([](int &v) {
+		v += 10;
+
+		return v * 2;
+	});
+	BOOST_REQUIRE_EQUAL(22, r);
+	BOOST_REQUIRE_EQUAL(11, mvar.withMVar([](const int &v) { return v; }));
+
+	std::vector<std::thread> threads;
+
+	for (int i = 0; i < 4; ++i)
+	{
+		threads.emplace_back([&mvar] {
+			for (int j = 0; j < 1000; ++j)
+			{
+				mvar.modify([](int &v) { ++v; });
+			}
+		});
+	}
+
+	for (auto &t : threads)
+	{
+		t.join();
+	}
+
+	BOOST_REQUIRE_EQUAL(4011, mvar.take());
+}
+
+BOOST_AUTO_TEST_CASE(MVarVoidTry)
+{
+	adv_mvar::MVar<void> mvar;
+	BOOST_REQUIRE(!mvar.tryTake());
+	BOOST_REQUIRE(!mvar.tryRead());
+	BOOST_REQUIRE(!mvar.takeFor(std::chrono::milliseconds(10)));
+	BOOST_REQUIRE(mvar.tryPut());
+	BOOST_REQUIRE(!mvar.tryPut());
+	BOOST_REQUIRE(!mvar.putFor(std::chrono::milliseconds(10)));
+	BOOST_REQUIRE(mvar.tryRead());
+	BOOST_REQUIRE(mvar.tryTake());
+	BOOST_REQUIRE(mvar.isEmpty());
+}
+
+BOOST_AUTO_TEST_CASE(AtomicMVarInt)
+{
+	adv_mvar::AtomicMVar<int> mvar;
+	BOOST_REQUIRE(mvar.isEmpty());
+	BOOST_REQUIRE(!mvar.tryTake());
+	BOOST_REQUIRE(!mvar.takeFor(std::chrono::milliseconds(10)));
+	mvar.put(0);
+	BOOST_REQUIRE(!mvar.isEmpty());
+	BOOST_REQUIRE(!mvar.tryPut(2));
+	BOOST_REQUIRE(!mvar.putFor(2, std::chrono::milliseconds(10)));
+	BOOST_REQUIRE_EQUAL(0, mvar.read());
+	BOOST_REQUIRE_EQUAL(0, *mvar.tryRead());
+	BOOST_REQUIRE_EQUAL(0, mvar.take());
+	BOOST_REQUIRE(mvar.isEmpty());
+	BOOST_REQUIRE(mvar.tryPut(-1));
+	BOOST_REQUIRE_EQUAL(-1, *mvar.tryTake());
+}
+
+BOOST_AUTO_TEST_CASE(AtomicMVarIntMultipleThreads)
+{
+	adv_mvar::AtomicMVar<int> mvar;
+	std::vector<std::thread> threads;
+	std::atomic<long> sum{0};
+
+	for (int i = 0; i < 4; ++i)
+	{
+		threads.emplace_back([&mvar] {
+			for (int j = 1; j <= 1000; ++j)
+			{
+				mvar.put(j);
+			}
+		});
+		threads.emplace_back([&mvar, &sum] {
+			for (int j = 0; j < 1000; ++j)
+			{
+				sum += mvar.take();
+			}
+		});
+	}
+
+	for (auto &t : threads)
+	{
+		t.join();
+	}
+
+	BOOST_REQUIRE(mvar.isEmpty());
+	BOOST_REQUIRE_EQUAL(4 * 500500, sum);
+}
+
+BOOST_AUTO_TEST_CASE(AtomicMVarPointer)
+{
+	int v = 10;
+	adv_mvar::AtomicMVar<int *> mvar;
+	BOOST_REQUIRE(mvar.isEmpty());
+	// The null pointer is a value which is different from an empty MVar.
+	mvar.put(nullptr);
+	BOOST_REQUIRE(!mvar.isEmpty());
+	BOOST_REQUIRE(!mvar.tryPut(&v));
+	BOOST_REQUIRE(mvar.take() == nullptr);
+	BOOST_REQUIRE(mvar.tryPut(&v));
+	BOOST_REQUIRE(*mvar.tryRead() == &v);
+	BOOST_REQUIRE(mvar.take() == &v);
+	BOOST_REQUIRE(mvar.isEmpty());
+}
+
+BOOST_AUTO_TEST_CASE(AtomicMVarTwelveBytes)
+{
+	struct Value
+	{
+		std::int32_t a;
+		std::int32_t b;
+		std::int32_t c;
+	};
+
+	adv_mvar::AtomicMVar<std::int64_t> mvar0;
+	mvar0.put(-1);
+	BOOST_REQUIRE_EQUAL(-1, mvar0.take());
+
+	adv_mvar::AtomicMVar<Value> mvar1;
+	std::thread t([&mvar1] { mvar1.put(Value{-1, 0, 1}); });
+	const auto v = mvar1.take();
+	BOOST_REQUIRE_EQUAL(-1, v.a);
+	BOOST_REQUIRE_EQUAL(0, v.b);
+	BOOST_REQUIRE_EQUAL(1, v.c);
+	BOOST_REQUIRE(mvar1.isEmpty());
+	t.join();
+}
+
+BOOST_AUTO_TEST_CASE(AtomicMVarVoid)
+{
+	adv_mvar::AtomicMVar<void> mvar;
+	BOOST_REQUIRE(!mvar.tryRead());
+	BOOST_REQUIRE(!mvar.takeFor(std::chrono::milliseconds(10)));
+
+	std::thread t([&mvar] { mvar.put(); });
+
+	mvar.read();
+	BOOST_REQUIRE(mvar.tryRead());
+	BOOST_REQUIRE(!mvar.tryPut());
+	BOOST_REQUIRE(mvar.tryTake());
+	BOOST_REQUIRE(mvar.isEmpty());
+	t.join();
+}
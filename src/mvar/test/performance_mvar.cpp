@@ -0,0 +1,279 @@
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "mvar/atomic_mvar.h"
+#include "mvar/chan.h"
+#include "mvar/mvar.h"
+
+/*
+ * PRODUCERS threads put time stamps into one MVar and CONSUMERS threads take
+ * them. The benchmark prints the throughput and the percentiles of the latency
+ * from calling put until the value has been taken.
+ *
+ * BroadcastMVar is the previous implementation which notifies all waiters on
+ * every put and take, so every put wakes all blocked consumers although only
+ * one of them can take the value.
+ *
+ * Besides, it compares uncontended puts and takes of MVar<int> and
+ * AtomicMVar<int> by a single thread.
+ *
+ * Finally, it passes MESSAGES integers from PRODUCERS to CONSUMERS threads
+ * through one MVar, through channels and through channels in batches of BATCH
+ * values.
+ */
+constexpr std::size_t PRODUCERS = 8;
+constexpr std::size_t CONSUMERS = 8;
+constexpr std::size_t VALUES_PER_PRODUCER = 20000;
+constexpr std::size_t UNCONTENDED_VALUES = 10000000;
+constexpr std::size_t MESSAGES = 4000000;
+constexpr std::size_t BATCH = 64;
+constexpr std::size_t BOUNDED_CAPACITY = 1024;
+
+using Clock = std::chrono::steady_clock;
+
+template <typename T>
+class BroadcastMVar
+{
+	public:
+	void put(T &&v)
+	{
+		{
+			std::unique_lock<std::mutex> l(m);
+			putCondition.wait(l, [this] { return !this->v; });
+			this->v = std::move(v);
+		}
+
+		takeCondition.notify_all();
+	}
+
+	T take()
+	{
+		std::optional<T> r;
+
+		{
+			std::unique_lock<std::mutex> l(m);
+			takeCondition.wait(l, [this] { return this->v.has_value(); });
+			r = std::move(*v);
+			v.reset();
+		}
+
+		putCondition.notify_all();
+
+		return std::move(*r);
+	}
+
+	private:
+	std::optional<T> v;
+	std::mutex m;
+	std::condition_variable takeCondition;
+	std::condition_variable putCondition;
+};
+
+template <typename MVar>
+void run(const std::string &name)
+{
+	constexpr std::size_t VALUES = PRODUCERS * VALUES_PER_PRODUCER;
+	MVar mvar;
+	std::vector<std::vector<Clock::duration>> latencies(CONSUMERS);
+	std::vector<std::thread> threads;
+	const auto start = Clock::now();
+
+	for (std::size_t i = 0; i < CONSUMERS; ++i)
+	{
+		threads.emplace_back([&mvar, &latencies, i] {
+			// The values are distributed evenly, so every consumer knows when to stop.
+			const std::size_t n =
+			    VALUES / CONSUMERS + (i < VALUES % CONSUMERS ? 1 : 0);
+			latencies[i].reserve(n);
+
+			for (std::size_t j = 0; j < n; ++j)
+			{
+				const auto put = mvar.take();
+				latencies[i].push_back(Clock::now() - put);
+			}
+		});
+	}
+
+	for (std::size_t i = 0; i < PRODUCERS; ++i)
+	{
+		threads.emplace_back([&mvar] {
+			for (std::size_t j = 0; j < VALUES_PER_PRODUCER; ++j)
+			{
+				mvar.put(Clock::now());
+			}
+		});
+	}
+
+	for (auto &t : threads)
+	{
+		t.join();
+	}
+
+	const auto duration = Clock::now() - start;
+	std::vector<Clock::duration> all;
+	all.reserve(VALUES);
+
+	for (auto &l : latencies)
+	{
+		all.insert(all.end(), l.begin(), l.end());
+	}
+
+	std::sort(all.begin(), all.end());
+	auto percentile = [&all](double p) {
+		return std::chrono::duration_cast<std::chrono::microseconds>(
+		           all[static_cast<std::size_t>(p * (all.size() - 1))])
+		    .count();
+	};
+	const auto seconds = std::chrono::duration<double>(duration).count();
+
+	std::cout << name << ": " << static_cast<std::size_t>(VALUES / seconds)
+	          << " values/s, p50 " << percentile(0.5) << " us, p99 "
+	          << percentile(0.99) << " us, max " << percentile(1.0) << " us"
+	          << std::endl;
+}
+
+template <typename MVar>
+void runUncontended(const std::string &name)
+{
+	MVar mvar;
+	std::size_t sum = 0;
+	const auto start = Clock::now();
+
+	for (std::size_t i = 0; i < UNCONTENDED_VALUES; ++i)
+	{
+		mvar.put(static_cast<int>(i));
+		sum += static_cast<std::size_t>(mvar.take());
+	}
+
+	const auto ns = std::chrono::duration<double, std::nano>(Clock::now() - start);
+
+	std::cout << name << ": " << ns.count() / UNCONTENDED_VALUES
+	          << " ns per put and take (" << sum << ")" << std::endl;
+}
+
+/**
+ * Passes the messages with single puts and takes. MVar<int> and the channels
+ * share the interface for this.
+ */
+template <typename Chan, typename... Args>
+void runMessages(const std::string &name, Args &&... args)
+{
+	Chan chan(std::forward<Args>(args)...);
+	std::vector<std::thread> threads;
+	std::atomic<std::size_t> sum{0};
+	const auto start = Clock::now();
+
+	for (std::size_t i = 0; i < PRODUCERS; ++i)
+	{
+		threads.emplace_back([&chan] {
+			for (std::size_t j = 0; j < MESSAGES / PRODUCERS; ++j)
+			{
+				chan.put(static_cast<int>(j));
+			}
+		});
+	}
+
+	for (std::size_t i = 0; i < CONSUMERS; ++i)
+	{
+		threads.emplace_back([&chan, &sum] {
+			std::size_t r = 0;
+
+			for (std::size_t j = 0; j < MESSAGES / CONSUMERS; ++j)
+			{
+				r += static_cast<std::size_t>(chan.take());
+			}
+
+			sum += r;
+		});
+	}
+
+	for (auto &t : threads)
+	{
+		t.join();
+	}
+
+	const auto seconds =
+	    std::chrono::duration<double>(Clock::now() - start).count();
+
+	std::cout << name << ": " << static_cast<std::size_t>(MESSAGES / seconds)
+	          << " messages/s (" << sum << ")" << std::endl;
+}
+
+template <typename Chan, typename... Args>
+void runBatches(const std::string &name, Args &&... args)
+{
+	Chan chan(std::forward<Args>(args)...);
+	std::vector<std::thread> threads;
+	std::atomic<std::size_t> sum{0};
+	const auto start = Clock::now();
+
+	for (std::size_t i = 0; i < PRODUCERS; ++i)
+	{
+		threads.emplace_back([&chan] {
+			for (std::size_t j = 0; j < MESSAGES / PRODUCERS; j += BATCH)
+			{
+				std::vector<int> batch;
+				batch.reserve(BATCH);
+
+				for (std::size_t k = j; k < std::min(j + BATCH, MESSAGES / PRODUCERS);
+				     ++k)
+				{
+					batch.push_back(static_cast<int>(k));
+				}
+
+				chan.putMany(std::move(batch));
+			}
+		});
+	}
+
+	for (std::size_t i = 0; i < CONSUMERS; ++i)
+	{
+		threads.emplace_back([&chan, &sum] {
+			std::size_t r = 0;
+			std::size_t n = 0;
+
+			while (n < MESSAGES / CONSUMERS)
+			{
+				for (auto v : chan.takeMany(
+				         std::min(BATCH, MESSAGES / CONSUMERS - n)))
+				{
+					r += static_cast<std::size_t>(v);
+					++n;
+				}
+			}
+
+			sum += r;
+		});
+	}
+
+	for (auto &t : threads)
+	{
+		t.join();
+	}
+
+	const auto seconds =
+	    std::chrono::duration<double>(Clock::now() - start).count();
+
+	std::cout << name << ": " << static_cast<std::size_t>(MESSAGES / seconds)
+	          << " messages/s (" << sum << ")" << std::endl;
+}
+
+int main()
+{
+	run<BroadcastMVar<Clock::time_point>>("Notify all");
+	run<adv_mvar::MVar<Clock::time_point>>("FIFO handoff");
+	runUncontended<adv_mvar::MVar<int>>("Uncontended MVar");
+	runUncontended<adv_mvar::AtomicMVar<int>>("Uncontended AtomicMVar");
+	runMessages<adv_mvar::MVar<int>>("MVar");
+	runMessages<adv_mvar::Chan<int>>("Chan");
+	runMessages<adv_mvar::BoundedChan<int>>("BoundedChan", BOUNDED_CAPACITY);
+	runBatches<adv_mvar::Chan<int>>("Chan with batches");
+	runBatches<adv_mvar::BoundedChan<int>>("BoundedChan with batches",
+	                                       BOUNDED_CAPACITY);
+
+	return 0;
+}
@@ -0,0 +1,133 @@
+#include <chrono>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <folly/Benchmark.h>
+#include <folly/init/Init.h>
+
+#include "advanced_futures_promises.h"
+
+/*
+ * SENDERS threads send MESSAGES messages in total to one state which is owned
+ * by a pool of THREADS threads. The actor enqueues every message into its
+ * mailbox and runs up to 64 messages per executor task. Both tell() and ask()
+ * allocate only the node of the message but ask() also completes the core of
+ * its future which is stored in the node.
+ * The baseline submits one task per message which locks a mutex around the
+ * state.
+ */
+constexpr int THREADS = 4;
+constexpr int SENDERS = 4;
+constexpr int MESSAGES = 100000;
+
+template <typename Func>
+void send(Func f)
+{
+	std::vector<std::thread> senders;
+	senders.reserve(SENDERS);
+
+	for (int i = 0; i < SENDERS; ++i)
+	{
+		senders.emplace_back([&f] {
+			for (int j = 0; j < MESSAGES / SENDERS; ++j)
+			{
+				f();
+			}
+		});
+	}
+
+	for (auto &t : senders)
+	{
+		t.join();
+	}
+}
+
+void runTell(adv::Executor *ex)
+{
+	adv::Actor<long> actor(ex);
+	send([&actor] { actor.tell([](long &s) { ++s; }); });
+	// The ask is executed after all messages.
+	folly::doNotOptimizeAway(actor.ask([](long &s) { return s; }).get().get());
+}
+
+void runAsk(adv::Executor *ex)
+{
+	adv::Actor<long> actor(ex);
+	send([&actor] { actor.ask([](long &s) { return ++s; }); });
+	folly::doNotOptimizeAway(actor.ask([](long &s) { return s; }).get().get());
+}
+
+void runTaskAndMutex(adv::Executor *ex)
+{
+	std::mutex m;
+	long s = 0;
+	adv::Latch done(ex, MESSAGES / SENDERS * SENDERS);
+	send([ex, &m, &s, &done] {
+		ex->add([&m, &s, &done] {
+			{
+				std::lock_guard<std::mutex> l(m);
+				++s;
+			}
+
+			done.countDown();
+		});
+	});
+	done.future().get();
+	folly::doNotOptimizeAway(s);
+}
+
+template <typename Func>
+void runMessages(unsigned n, Func f)
+{
+	adv::ThreadPoolExecutor ex(THREADS);
+
+	for (unsigned i = 0; i < n; ++i)
+	{
+		f(&ex);
+	}
+}
+
+BENCHMARK(AdvActorTell, n)
+{
+	runMessages(n, runTell);
+}
+
+BENCHMARK(AdvActorAsk, n)
+{
+	runMessages(n, runAsk);
+}
+
+BENCHMARK(TaskAndMutexPerMessage, n)
+{
+	runMessages(n, runTaskAndMutex);
+}
+
+template <typename Func>
+void printCostPerMessage(const std::string &name, Func f)
+{
+	adv::ThreadPoolExecutor ex(THREADS);
+	const auto begin = std::chrono::steady_clock::now();
+	f(&ex);
+	const auto end = std::chrono::steady_clock::now();
+
+	std::cout << "Time per message " << name << ": "
+	          << std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin)
+	                     .count() /
+	                 MESSAGES
+	          << " ns" << std::endl;
+}
+
+int main(int argc, char *argv[])
+{
+	folly::init(&argc, &argv);
+
+	printCostPerMessage("with tell", runTell);
+	printCostPerMessage("with ask", runAsk);
+	printCostPerMessage("with a task and a mutex", runTaskAndMutex);
+
+	folly::runBenchmarks();
+
+	return 0;
+}
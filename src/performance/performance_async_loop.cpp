@@ -0,0 +1,149 @@
+#include <sys/resource.h>
+
+#include <deque>
+#include <iostream>
+
+#include <folly/Benchmark.h>
+#include <folly/init/Init.h>
+
+#include "advanced_futures_promises.h"
+
+/*
+ * Runs an asynchronous loop like paginating through results where every step
+ * calls thenWith recursively. The cores of the nested futures are linked to the
+ * core of the outermost future, so the memory usage does not grow with the
+ * number of steps. adv::loop does not even create a future per step for the
+ * loop itself.
+ */
+constexpr int STEPS = 1000000;
+
+/*
+ * Executes the functions one after another in the calling thread, so the
+ * recursive steps do not grow the stack.
+ */
+class QueueExecutor : public adv::Executor
+{
+	public:
+	void add(Function &&f) override
+	{
+		functions.push_back(std::move(f));
+	}
+
+	void run()
+	{
+		while (!functions.empty())
+		{
+			auto f = std::move(functions.front());
+			functions.pop_front();
+			f();
+		}
+	}
+
+	private:
+	std::deque<Function> functions;
+};
+
+adv::Future<int> loop(adv::Executor *ex, int n)
+{
+	return adv::async(ex, [n] { return n; })
+	    .thenWith([ex](const adv::Try<int> &t) {
+		    auto i = t.get();
+
+		    return i == 0 ? adv::async(ex, [] { return 0; }) : loop(ex, i - 1);
+	    });
+}
+
+/*
+ * The same loop with adv::loop which reuses one context and one promise for all
+ * steps.
+ */
+adv::Future<int> loopPrimitive(adv::Executor *ex, int n)
+{
+	return adv::loop(ex, n, [ex](int i) {
+		return adv::async(ex, [i]() -> adv::Step<int, int> {
+			if (i == 0)
+			{
+				return adv::Done<int>{0};
+			}
+
+			return adv::Continue<int>{i - 1};
+		});
+	});
+}
+
+/*
+ * The behaviour of thenWith without linking: Every step completes the promise
+ * of the previous step with a callback.
+ */
+adv::Future<int> loopWithoutLinking(adv::Executor *ex, int n)
+{
+	adv::Promise<int> p(ex);
+	adv::async(ex, [n] { return n; })
+	    .onComplete([ex, p](const adv::Try<int> &t) mutable {
+		    auto i = t.get();
+		    auto future = i == 0 ? adv::async(ex, [] { return 0; })
+		                         : loopWithoutLinking(ex, i - 1);
+		    future.onComplete([future](const adv::Try<int> &) {});
+		    p.tryCompleteWith(future);
+	    });
+
+	return p.future();
+}
+
+template <typename Func>
+void runLoop(int n, Func f)
+{
+	QueueExecutor ex;
+	auto r = f(&ex, n);
+	ex.run();
+	folly::doNotOptimizeAway(r.get());
+}
+
+long maxResidentSetSize()
+{
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+
+	return usage.ru_maxrss;
+}
+
+BENCHMARK(AdvThenWithLoop, n)
+{
+	runLoop(n, loop);
+}
+
+BENCHMARK(AdvLoop, n)
+{
+	runLoop(n, loopPrimitive);
+}
+
+BENCHMARK(AdvThenWithLoopWithoutLinking, n)
+{
+	runLoop(n, loopWithoutLinking);
+}
+
+template <typename Func>
+void printGrowth(const std::string &name, Func f)
+{
+	auto before = maxResidentSetSize();
+	runLoop(STEPS, f);
+	auto after = maxResidentSetSize();
+
+	std::cout << "Maximum resident set size growth after " << STEPS
+	          << " steps " << name << ": " << (after - before) << " KiB"
+	          << std::endl;
+}
+
+int main(int argc, char *argv[])
+{
+	folly::init(&argc, &argv);
+
+	// Measure the memory before the benchmarks raise the maximum.
+	printGrowth("with linking", loop);
+	printGrowth("with adv::loop", loopPrimitive);
+	printGrowth("without linking", loopWithoutLinking);
+
+	folly::runBenchmarks();
+
+	return 0;
+}
@@ -0,0 +1,76 @@
+#include <sys/resource.h>
+
+#include <iostream>
+
+#include <folly/Benchmark.h>
+#include <folly/executors/InlineExecutor.h>
+#include <folly/init/Init.h>
+
+#include "advanced_futures_promises.h"
+
+/*
+ * Every iteration races one long-lived future which is never completed against
+ * a short-lived future, similar to racing a shutdown future against requests.
+ * The combinators remove their callbacks from the long-lived future, so its
+ * memory usage does not grow with the number of iterations.
+ */
+constexpr std::size_t RACES = 1000000;
+
+template <typename Func>
+void raceLongLived(std::size_t n, Func f)
+{
+	folly::InlineExecutor follyExecutor;
+	adv::FollyExecutor ex(&follyExecutor);
+	adv::Promise<int> longLived(&ex);
+	auto longLivedFuture = longLived.future();
+
+	for (std::size_t i = 0; i < n; ++i)
+	{
+		adv::Promise<int> shortLived(&ex);
+		auto r = f(longLivedFuture, shortLived.future());
+		shortLived.trySuccess(static_cast<int>(i));
+		folly::doNotOptimizeAway(r.get());
+	}
+}
+
+long maxResidentSetSize()
+{
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+
+	return usage.ru_maxrss;
+}
+
+BENCHMARK(AdvFirstLongLived, n)
+{
+	raceLongLived(n, [](adv::Future<int> longLived, adv::Future<int> shortLived) {
+		return longLived.first(shortLived);
+	});
+}
+
+BENCHMARK(AdvFirstSuccLongLived, n)
+{
+	raceLongLived(n, [](adv::Future<int> longLived, adv::Future<int> shortLived) {
+		return longLived.firstSucc(shortLived);
+	});
+}
+
+int main(int argc, char *argv[])
+{
+	folly::init(&argc, &argv);
+
+	folly::runBenchmarks();
+
+	auto before = maxResidentSetSize();
+	raceLongLived(RACES,
+	              [](adv::Future<int> longLived, adv::Future<int> shortLived) {
+		              return longLived.first(shortLived);
+	              });
+	auto after = maxResidentSetSize();
+
+	std::cout << "Maximum resident set size growth after " << RACES
+	          << " races against a long-lived future: " << (after - before)
+	          << " KiB" << std::endl;
+
+	return 0;
+}
@@ -12,6 +12,7 @@ constexpr int TREE_HEIGHT = 22;
 constexpr int TREE_CHILDS = 2;
 static_assert(TREE_CHILDS == 2,
               "The custom combinators only support passing two futures.");
+constexpr int CHAIN_LENGTH = 10;
 
 template <typename T, typename Func>
 folly::Future<T> follyCollectAll(std::size_t treeHeight, std::size_t childNodes,
@@ -402,6 +403,60 @@ inline int initFuture()
 	return 3;
 }
 
+inline int mapStage(const adv::Try<int> &t)
+{
+	return t.get() + 1;
+}
+
+/*
+ * Adds a map stage CHAIN_LENGTH times with one promise, core and task per
+ * stage.
+ */
+adv::Future<int> advThenChain(adv::Future<int> f)
+{
+	for (int i = 0; i < CHAIN_LENGTH; ++i)
+	{
+		f = f.then(mapStage);
+	}
+
+	return f;
+}
+
+/*
+ * Adds the same stages to a fused chain which is materialized into one future.
+ */
+template <int N, typename Chain>
+auto advFusedThenChain(Chain &&chain)
+{
+	if constexpr (N == 0)
+	{
+		return chain.future();
+	}
+	else
+	{
+		return advFusedThenChain<N - 1>(std::move(chain).then(mapStage));
+	}
+}
+
+/*
+ * Completes the promise after the chain has been built, so every stage is
+ * executed by a callback.
+ */
+template <typename Func>
+void runThenChain(unsigned n, Func f)
+{
+	folly::InlineExecutor follyExecutor;
+	adv::FollyExecutor ex(&follyExecutor);
+
+	for (unsigned i = 0; i < n; ++i)
+	{
+		adv::Promise<int> p(&ex);
+		auto r = f(p.future());
+		p.trySuccess(initFuture());
+		folly::doNotOptimizeAway(r.get());
+	}
+}
+
 BENCHMARK(FollyCollectAll)
 {
 	follyCollectAll<TREE_TYPE>(TREE_HEIGHT, TREE_CHILDS, initFuture).wait();
@@ -469,6 +524,18 @@ BENCHMARK(AdvFallbackTo)
 	advFallbackTo<TREE_TYPE>(&ex, TREE_HEIGHT, TREE_CHILDS, initFuture).get();
 }
 
+BENCHMARK(AdvThenChain, n)
+{
+	runThenChain(n, advThenChain);
+}
+
+BENCHMARK(AdvFusedThenChain, n)
+{
+	runThenChain(n, [](adv::Future<int> f) {
+		return advFusedThenChain<CHAIN_LENGTH>(f.fuse());
+	});
+}
+
 int main(int argc, char *argv[])
 {
 	folly::init(&argc, &argv);
@@ -0,0 +1,123 @@
+#include <folly/Benchmark.h>
+#include <folly/executors/InlineExecutor.h>
+#include <folly/init/Init.h>
+
+#include "advanced_futures_promises.h"
+
+/*
+ * Compares the holiday booking example and a sequence of dependent asynchronous
+ * steps written with callbacks to the same code written with coroutines.
+ */
+constexpr int STEPS = 10;
+
+enum Hotel
+{
+	Switzerland,
+	USA
+};
+
+Hotel getHotelSwitzerland()
+{
+	return Switzerland;
+}
+
+Hotel getHotelUSA()
+{
+	return USA;
+}
+
+adv::Future<Hotel> bookHolidayCallbacks(adv::Executor *ex)
+{
+	auto switzerland = adv::async(ex, getHotelSwitzerland);
+	auto usa = adv::async(ex, getHotelUSA);
+
+	return switzerland.fallbackTo(usa).then(
+	    [](const adv::Try<Hotel> &t) { return t.get(); });
+}
+
+adv::Task<Hotel> bookHolidayCoroutine(adv::Executor *ex)
+{
+	auto switzerland = adv::async(ex, getHotelSwitzerland);
+	auto usa = adv::async(ex, getHotelUSA);
+
+	co_return co_await switzerland.fallbackTo(usa);
+}
+
+/*
+ * Every step depends on the result of the previous step.
+ */
+adv::Future<int> stepsCallbacks(adv::Executor *ex, int i, int sum)
+{
+	return adv::async(ex, [i] { return i; })
+	    .thenWith([ex, i, sum](const adv::Try<int> &t) {
+		    auto s = sum + t.get();
+
+		    return i + 1 == STEPS ? adv::async(ex, [s] { return s; })
+		                          : stepsCallbacks(ex, i + 1, s);
+	    });
+}
+
+adv::Task<int> stepsCoroutine(adv::Executor *ex)
+{
+	int sum = 0;
+
+	for (int i = 0; i < STEPS; ++i)
+	{
+		sum += co_await adv::async(ex, [i] { return i; });
+	}
+
+	co_return sum;
+}
+
+BENCHMARK(AdvHolidayBookingCallbacks, n)
+{
+	folly::InlineExecutor follyExecutor;
+	adv::FollyExecutor ex(&follyExecutor);
+
+	for (unsigned i = 0; i < n; ++i)
+	{
+		folly::doNotOptimizeAway(bookHolidayCallbacks(&ex).get());
+	}
+}
+
+BENCHMARK(AdvHolidayBookingCoroutine, n)
+{
+	folly::InlineExecutor follyExecutor;
+	adv::FollyExecutor ex(&follyExecutor);
+
+	for (unsigned i = 0; i < n; ++i)
+	{
+		folly::doNotOptimizeAway(bookHolidayCoroutine(&ex).get());
+	}
+}
+
+BENCHMARK(AdvStepsCallbacks, n)
+{
+	folly::InlineExecutor follyExecutor;
+	adv::FollyExecutor ex(&follyExecutor);
+
+	for (unsigned i = 0; i < n; ++i)
+	{
+		folly::doNotOptimizeAway(stepsCallbacks(&ex, 0, 0).get());
+	}
+}
+
+BENCHMARK(AdvStepsCoroutine, n)
+{
+	folly::InlineExecutor follyExecutor;
+	adv::FollyExecutor ex(&follyExecutor);
+
+	for (unsigned i = 0; i < n; ++i)
+	{
+		folly::doNotOptimizeAway(stepsCoroutine(&ex).get());
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	folly::init(&argc, &argv);
+
+	folly::runBenchmarks();
+
+	return 0;
+}
@@ -0,0 +1,114 @@
+#include <algorithm>
+#include <iostream>
+#include <random>
+
+#include <folly/executors/InlineExecutor.h>
+#include <folly/init/Init.h>
+
+#include "advanced_futures_promises.h"
+
+/*
+ * Simulates requests to replicas with a long-tail latency distribution:
+ * 90 % take 1-3 ms, 8 % take 5-10 ms and 2 % take 50-100 ms.
+ * The requests are started in waves and the percentiles of their latencies are
+ * compared with and without hedging.
+ */
+constexpr std::size_t WAVES = 50;
+constexpr std::size_t REQUESTS_PER_WAVE = 100;
+
+using Clock = std::chrono::steady_clock;
+
+Clock::duration randomLatency()
+{
+	thread_local std::mt19937 engine(std::random_device{}());
+	std::uniform_real_distribution<double> d(0.0, 1.0);
+	const auto x = d(engine);
+	double ms;
+
+	if (x < 0.9)
+	{
+		ms = 1.0 + 2.0 * d(engine);
+	}
+	else if (x < 0.98)
+	{
+		ms = 5.0 + 5.0 * d(engine);
+	}
+	else
+	{
+		ms = 50.0 + 50.0 * d(engine);
+	}
+
+	return std::chrono::microseconds(static_cast<long>(ms * 1000.0));
+}
+
+template <typename Func>
+void simulate(const std::string &name, Func request)
+{
+	std::vector<Clock::duration> latencies;
+	latencies.reserve(WAVES * REQUESTS_PER_WAVE);
+
+	for (std::size_t i = 0; i < WAVES; ++i)
+	{
+		std::vector<adv::Future<Clock::duration>> futures;
+		futures.reserve(REQUESTS_PER_WAVE);
+
+		for (std::size_t j = 0; j < REQUESTS_PER_WAVE; ++j)
+		{
+			const auto start = Clock::now();
+			futures.push_back(request().then(
+			    [start](const adv::Try<int> &) { return Clock::now() - start; }));
+		}
+
+		for (auto &f : futures)
+		{
+			latencies.push_back(f.get().get());
+		}
+	}
+
+	std::sort(latencies.begin(), latencies.end());
+	auto percentile = [&latencies](double p) {
+		return std::chrono::duration_cast<std::chrono::microseconds>(
+		           latencies[static_cast<std::size_t>(p * (latencies.size() - 1))])
+		    .count();
+	};
+
+	std::cout << name << ": p50 " << percentile(0.5) << " us, p95 "
+	          << percentile(0.95) << " us, p99 " << percentile(0.99) << " us"
+	          << std::endl;
+}
+
+int main(int argc, char *argv[])
+{
+	folly::init(&argc, &argv);
+
+	folly::InlineExecutor follyExecutor;
+	adv::FollyExecutor ex(&follyExecutor);
+	// Is destroyed first, so abandoned attempts do not outlive the executor.
+	adv::TimerExecutor timer;
+	std::atomic<std::size_t> attempts{0};
+	auto attempt = [&ex, &timer, &attempts] {
+		++attempts;
+
+		return adv::sleep(&ex, randomLatency(), &timer)
+		    .then([](const adv::Try<adv::Unit> &) { return 10; });
+	};
+
+	simulate("No hedging", attempt);
+	std::cout << "Attempts: " << attempts << std::endl;
+
+	attempts = 0;
+	simulate("Hedging after 10 ms", [&ex, &timer, &attempt] {
+		return adv::hedge(&ex, attempt, {std::chrono::milliseconds(10)}, &timer);
+	});
+	std::cout << "Attempts: " << attempts << std::endl;
+
+	adv::LatencyHistogram histogram;
+	attempts = 0;
+	simulate("Hedging after adaptive p95 delay",
+	         [&ex, &timer, &attempt, &histogram] {
+		         return adv::hedge(&ex, attempt, histogram, 1, 0.95, &timer);
+	         });
+	std::cout << "Attempts: " << attempts << std::endl;
+
+	return 0;
+}
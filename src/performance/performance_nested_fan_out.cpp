@@ -0,0 +1,82 @@
+#include <folly/Benchmark.h>
+#include <folly/init/Init.h>
+
+#include "advanced_futures_promises.h"
+
+/*
+ * Every task adds FAN_OUT child tasks to the same pool and blocks in get() until
+ * they have been completed. With DEPTH levels, there are more waiting tasks than
+ * the THREADS threads of the pool, so a pool which blocks its threads in get()
+ * deadlocks. The pool which helps while waiting runs the children of a waiting
+ * task on its thread instead. The fiber executor suspends only the fiber of the
+ * waiting task. The blocking pool needs a thread for every waiting task to
+ * complete at all.
+ */
+constexpr int THREADS = 4;
+constexpr int FAN_OUT = 4;
+constexpr int DEPTH = 3;
+// The number of inner nodes of the tree and one thread for the leaves.
+constexpr int BLOCKING_THREADS = 1 + FAN_OUT + FAN_OUT * FAN_OUT + 1;
+
+int fanOut(adv::Executor *ex, int depth)
+{
+	if (depth == 0)
+	{
+		return 1;
+	}
+
+	std::vector<adv::Future<int>> children;
+	children.reserve(FAN_OUT);
+
+	for (int i = 0; i < FAN_OUT; ++i)
+	{
+		children.push_back(
+		    adv::async(ex, [ex, depth] { return fanOut(ex, depth - 1); }));
+	}
+
+	int r = 0;
+
+	for (auto &c : children)
+	{
+		r += c.get().get();
+	}
+
+	return r;
+}
+
+template <typename Executor>
+void runFanOut(unsigned n, Executor &ex)
+{
+	for (unsigned i = 0; i < n; ++i)
+	{
+		folly::doNotOptimizeAway(
+		    adv::async(&ex, [&ex] { return fanOut(&ex, DEPTH); }).get());
+	}
+}
+
+BENCHMARK(AdvThreadPoolHelpWhileWaiting, n)
+{
+	adv::ThreadPoolExecutor ex(THREADS);
+	runFanOut(n, ex);
+}
+
+BENCHMARK(AdvFiberExecutor, n)
+{
+	adv::FiberExecutor ex(THREADS);
+	runFanOut(n, ex);
+}
+
+BENCHMARK(AdvThreadPoolBlocking, n)
+{
+	adv::ThreadPoolExecutor ex(BLOCKING_THREADS, false);
+	runFanOut(n, ex);
+}
+
+int main(int argc, char *argv[])
+{
+	folly::init(&argc, &argv);
+
+	folly::runBenchmarks();
+
+	return 0;
+}
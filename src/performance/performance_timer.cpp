@@ -0,0 +1,66 @@
+#include <folly/Benchmark.h>
+#include <folly/executors/InlineExecutor.h>
+#include <folly/init/Init.h>
+
+#include "advanced_futures_promises.h"
+
+/*
+ * Every request has a deadline but most requests are completed before it
+ * expires. Hence, almost all timeouts are removed before they expire.
+ */
+constexpr auto DEADLINE = std::chrono::seconds(30);
+
+BENCHMARK(TimerExecutorScheduleAndRemove, n)
+{
+	adv::TimerExecutor timer;
+
+	for (unsigned i = 0; i < n; ++i)
+	{
+		timer.schedule(DEADLINE, [] {}).remove();
+	}
+}
+
+BENCHMARK(TimerExecutorScheduleAllThenRemove, n)
+{
+	adv::TimerExecutor timer;
+	std::vector<adv::CallbackHandle> handles;
+
+	BENCHMARK_SUSPEND
+	{
+		handles.reserve(n);
+	}
+
+	for (unsigned i = 0; i < n; ++i)
+	{
+		handles.push_back(timer.schedule(DEADLINE, [] {}));
+	}
+
+	for (auto &h : handles)
+	{
+		h.remove();
+	}
+}
+
+BENCHMARK(AdvWithinCompletedInTime, n)
+{
+	folly::InlineExecutor follyExecutor;
+	adv::FollyExecutor ex(&follyExecutor);
+	adv::TimerExecutor timer;
+
+	for (unsigned i = 0; i < n; ++i)
+	{
+		adv::Promise<int> p(&ex);
+		auto f = p.future().within(DEADLINE, &timer);
+		p.trySuccess(static_cast<int>(i));
+		folly::doNotOptimizeAway(f.get());
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	folly::init(&argc, &argv);
+
+	folly::runBenchmarks();
+
+	return 0;
+}
@@ -0,0 +1,688 @@
+#ifndef ADV_PIPELINE_H
+#define ADV_PIPELINE_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <utility>
+#include <vector>
+
+#include "future.h"
+#include "promise.h"
+#include "stream.h"
+
+namespace adv
+{
+
+enum class PipelineOrder
+{
+	/**
+	 * Every stage passes its results on in the order of its input. A worker
+	 * whose result is not the next one in order keeps its slot until the result
+	 * can be passed on, so the results which are held back are limited by the
+	 * parallelism of the stage.
+	 */
+	Ordered,
+	/**
+	 * Every stage passes its results on as soon as they are available.
+	 */
+	Unordered
+};
+
+/**
+ * A snapshot of the counters of one stage of a \ref Pipeline.
+ */
+struct PipelineStageStatistics
+{
+	// The number of values which have been processed by the stage.
+	std::size_t processed;
+	// The time spent in the function of the stage by all workers.
+	std::chrono::steady_clock::duration busy;
+	/*
+	 * The number of values which wait for a worker of the stage including the
+	 * values of workers of the previous stage which wait for space in the queue.
+	 */
+	std::size_t queued;
+	// The maximum number of values which have been waiting at once.
+	std::size_t maxQueued;
+	// The number of workers which process or hold back a value.
+	std::size_t active;
+};
+
+namespace detail
+{
+
+/**
+ * The input of a pipeline stage or the output of the pipeline.
+ */
+template <typename T>
+class PipelineInlet
+{
+	public:
+	virtual ~PipelineInlet() = default;
+
+	/**
+	 * @return Returns true if v has been accepted. Otherwise, resume is called
+	 * once when it has been accepted.
+	 */
+	virtual bool offer(T &&v, std::function<void()> &&resume) = 0;
+
+	/**
+	 * Is called once after the last value has been accepted.
+	 */
+	virtual void close() = 0;
+};
+
+class PipelineStageBase
+{
+	public:
+	virtual ~PipelineStageBase() = default;
+
+	virtual PipelineStageStatistics statistics() const = 0;
+};
+
+/**
+ * Is shared by all stages of one pipeline.
+ */
+struct PipelineContext
+{
+	explicit PipelineContext(PipelineOrder order) : order(order)
+	{
+	}
+
+	const PipelineOrder order;
+	std::mutex m;
+	std::exception_ptr failure;
+
+	void fail(std::exception_ptr e)
+	{
+		std::lock_guard<std::mutex> l(m);
+
+		if (failure == nullptr)
+		{
+			failure = std::move(e);
+		}
+	}
+
+	std::exception_ptr getFailure()
+	{
+		std::lock_guard<std::mutex> l(m);
+
+		return failure;
+	}
+};
+
+/**
+ * At most parallelism workers process the values of the stage. Every worker
+ * is a task of the executor which processes values until the queue is empty
+ * or the next stage does not accept its result. In the latter case, the worker
+ * keeps its slot and is continued when the result has been accepted, so full
+ * queues slow the previous stages down without blocking threads.
+ *
+ * The values are numbered when a worker takes them. Since a worker is only
+ * started if the queue is empty, the numbers follow the order of the input.
+ */
+template <typename In, typename Out>
+class PipelineStage : public PipelineInlet<In>,
+                      public PipelineStageBase,
+                      public std::enable_shared_from_this<PipelineStage<In, Out>>
+{
+	public:
+	using Function = std::function<Out(In &&)>;
+
+	PipelineStage(Executor *ex, std::size_t parallelism, std::size_t capacity,
+	              Function &&f, std::shared_ptr<PipelineInlet<Out>> next,
+	              std::shared_ptr<PipelineContext> context)
+	    : ex(ex), parallelism(std::max<std::size_t>(parallelism, 1)),
+	      capacity(capacity), f(std::move(f)), next(std::move(next)),
+	      context(std::move(context)),
+	      ordered(this->context->order == PipelineOrder::Ordered)
+	{
+	}
+
+	bool offer(In &&v, std::function<void()> &&resume) override
+	{
+		std::uint64_t n = 0;
+
+		{
+			std::lock_guard<std::mutex> l(m);
+
+			if (active < parallelism)
+			{
+				++active;
+				n = nextIn++;
+			}
+			else if (queue.size() < capacity)
+			{
+				queue.push_back(std::move(v));
+				updateMaxQueued();
+
+				return true;
+			}
+			else
+			{
+				blocked.emplace_back(std::move(v), std::move(resume));
+				updateMaxQueued();
+
+				return false;
+			}
+		}
+
+		auto self = this->shared_from_this();
+		ex->add([self, n, v = std::move(v)]() mutable {
+			self->work(n, std::move(v));
+		});
+
+		return true;
+	}
+
+	void close() override
+	{
+		{
+			std::lock_guard<std::mutex> l(m);
+			closed = true;
+
+			if (!isDone())
+			{
+				return;
+			}
+		}
+
+		next->close();
+	}
+
+	PipelineStageStatistics statistics() const override
+	{
+		std::lock_guard<std::mutex> l(m);
+
+		return PipelineStageStatistics{
+		    processed.load(), std::chrono::steady_clock::duration(busy.load()),
+		    queue.size() + blocked.size(), maxQueued, active};
+	}
+
+	private:
+	using Result = std::optional<Out>;
+
+	void work(std::uint64_t n, In &&v)
+	{
+		while (true)
+		{
+			if (!deliver(n, apply(std::move(v))))
+			{
+				return;
+			}
+
+			auto taken = take();
+
+			if (!taken)
+			{
+				return;
+			}
+
+			n = taken->first;
+			v = std::move(taken->second);
+		}
+	}
+
+	/**
+	 * Continues a worker which has no value.
+	 */
+	void proceed()
+	{
+		auto taken = take();
+
+		if (taken)
+		{
+			work(taken->first, std::move(taken->second));
+		}
+	}
+
+	/**
+	 * A failed value is dropped and fails the pipeline.
+	 */
+	Result apply(In &&v)
+	{
+		const auto start = std::chrono::steady_clock::now();
+		Result r;
+
+		try
+		{
+			r.emplace(f(std::move(v)));
+		}
+		catch (...)
+		{
+			context->fail(std::current_exception());
+		}
+
+		busy += (std::chrono::steady_clock::now() - start).count();
+		++processed;
+
+		return r;
+	}
+
+	/**
+	 * @return Returns true if the worker may take the next value.
+	 */
+	bool deliver(std::uint64_t n, Result &&r)
+	{
+		if (ordered)
+		{
+			std::lock_guard<std::mutex> l(m);
+
+			if (n != nextOut)
+			{
+				held.emplace(n, std::move(r));
+
+				return false;
+			}
+		}
+
+		return emit(std::move(r));
+	}
+
+	/**
+	 * Passes r and all results held back after it on. If the next stage does not
+	 * accept a result, the emission is continued when it has been accepted.
+	 *
+	 * @return Returns true if all results have been accepted.
+	 */
+	bool emit(Result &&r)
+	{
+		do
+		{
+			if (r)
+			{
+				auto self = this->shared_from_this();
+				auto accepted = next->offer(std::move(*r), [self] {
+					self->ex->add([self] {
+						Result r;
+
+						if (!self->advance(r) || self->emit(std::move(r)))
+						{
+							self->proceed();
+						}
+					});
+				});
+
+				if (!accepted)
+				{
+					return false;
+				}
+			}
+		} while (advance(r));
+
+		return true;
+	}
+
+	/**
+	 * Is called when a result has been passed on.
+	 *
+	 * @return Returns true if the next result in order has been held back.
+	 * It is moved into r and the worker which has held it back is continued.
+	 */
+	bool advance(Result &r)
+	{
+		if (!ordered)
+		{
+			return false;
+		}
+
+		{
+			std::lock_guard<std::mutex> l(m);
+			++nextOut;
+			auto it = held.find(nextOut);
+
+			if (it == held.end())
+			{
+				return false;
+			}
+
+			r = std::move(it->second);
+			held.erase(it);
+		}
+
+		auto self = this->shared_from_this();
+		ex->add([self] { self->proceed(); });
+
+		return true;
+	}
+
+	/**
+	 * @return Returns the next value and its number or nothing if the worker
+	 * has to stop since there are no values.
+	 */
+	std::optional<std::pair<std::uint64_t, In>> take()
+	{
+		std::optional<std::pair<std::uint64_t, In>> r;
+		std::function<void()> resume;
+		bool done = false;
+
+		{
+			std::lock_guard<std::mutex> l(m);
+
+			if (!queue.empty())
+			{
+				r.emplace(nextIn++, std::move(queue.front()));
+				queue.pop_front();
+
+				if (!blocked.empty())
+				{
+					queue.push_back(std::move(blocked.front().first));
+					resume = std::move(blocked.front().second);
+					blocked.pop_front();
+				}
+			}
+			// Without a queue, the values are taken from the blocked workers directly.
+			else if (!blocked.empty())
+			{
+				r.emplace(nextIn++, std::move(blocked.front().first));
+				resume = std::move(blocked.front().second);
+				blocked.pop_front();
+			}
+			else
+			{
+				--active;
+				done = isDone();
+			}
+		}
+
+		if (resume)
+		{
+			resume();
+		}
+
+		if (done)
+		{
+			next->close();
+		}
+
+		return r;
+	}
+
+	/**
+	 * Requires the lock. Workers which hold results back are active.
+	 */
+	bool isDone() const
+	{
+		return closed && active == 0 && queue.empty() && blocked.empty();
+	}
+
+	void updateMaxQueued()
+	{
+		maxQueued = std::max(maxQueued, queue.size() + blocked.size());
+	}
+
+	Executor *const ex;
+	const std::size_t parallelism;
+	const std::size_t capacity;
+	const Function f;
+	const std::shared_ptr<PipelineInlet<Out>> next;
+	const std::shared_ptr<PipelineContext> context;
+	const bool ordered;
+
+	mutable std::mutex m;
+	std::deque<In> queue;
+	std::deque<std::pair<In, std::function<void()>>> blocked;
+	std::size_t active{0};
+	std::size_t maxQueued{0};
+	bool closed{false};
+	// The number of the next value which is taken by a worker.
+	std::uint64_t nextIn{0};
+	// The number of the next result which is passed on if the stage is ordered.
+	std::uint64_t nextOut{0};
+	std::map<std::uint64_t, Result> held;
+
+	std::atomic<std::size_t> processed{0};
+	std::atomic<std::chrono::steady_clock::duration::rep> busy{0};
+};
+
+/**
+ * Pushes the results of the last stage into the output channel.
+ */
+template <typename T>
+class PipelineOutput : public PipelineInlet<T>
+{
+	public:
+	PipelineOutput(Executor *ex, std::size_t capacity,
+	               std::shared_ptr<PipelineContext> context)
+	    : channel(ex, capacity), drained(ex), context(std::move(context))
+	{
+	}
+
+	bool offer(T &&v, std::function<void()> &&resume) override
+	{
+		auto f = channel.push(std::move(v));
+
+		if (f.isReady())
+		{
+			return true;
+		}
+
+		f.onComplete(
+		    [resume = std::move(resume)](const Try<Unit> &) { resume(); });
+
+		return false;
+	}
+
+	void close() override
+	{
+		auto e = context->getFailure();
+
+		if (e != nullptr)
+		{
+			channel.fail(e);
+			drained.tryFailure(std::move(e));
+		}
+		else
+		{
+			channel.close();
+			drained.trySuccess(Unit());
+		}
+	}
+
+	Channel<T> channel;
+	Promise<Unit> drained;
+
+	private:
+	const std::shared_ptr<PipelineContext> context;
+};
+
+} // namespace detail
+
+/**
+ * A running pipeline which is created by \ref PipelineBuilder::build().
+ * Values are pushed into the first stage and the results of the last stage can
+ * be pulled from \ref output().
+ */
+template <typename In, typename Out>
+class Pipeline
+{
+	public:
+	Pipeline(Executor *ex, std::shared_ptr<detail::PipelineInlet<In>> head,
+	         std::shared_ptr<detail::PipelineOutput<Out>> tail,
+	         std::vector<std::shared_ptr<detail::PipelineStageBase>> stages)
+	    : ex(ex), head(std::move(head)), tail(std::move(tail)),
+	      stages(std::move(stages))
+	{
+	}
+
+	/**
+	 * @return Returns a future which is completed when the value has been
+	 * accepted by the first stage or fails with \ref ChannelClosed if the
+	 * pipeline has been closed.
+	 */
+	Future<Unit> push(In v)
+	{
+		Promise<Unit> p(ex);
+
+		if (closed)
+		{
+			p.tryFailure(ChannelClosed());
+		}
+		else if (head->offer(std::move(v), [p]() mutable { p.trySuccess(Unit()); }))
+		{
+			p.trySuccess(Unit());
+		}
+
+		return p.future();
+	}
+
+	/**
+	 * No more values are pushed. All values which have been accepted are still
+	 * processed. It must not be called concurrently with \ref push().
+	 */
+	void close()
+	{
+		if (!closed.exchange(true))
+		{
+			head->close();
+		}
+	}
+
+	/**
+	 * @return Returns the results of the last stage. The stream ends when the
+	 * pipeline has drained. If a stage has failed, it fails with the first
+	 * exception.
+	 */
+	Stream<Out> output()
+	{
+		return tail->channel.stream();
+	}
+
+	/**
+	 * @return Returns a future which is completed when the pipeline has been
+	 * closed and all results have been pushed into the output. Note that the
+	 * output has to be pulled if there are more results than fit into its
+	 * buffer. It fails with the first exception of a stage whose value has been
+	 * dropped.
+	 */
+	Future<Unit> drained()
+	{
+		return tail->drained.future();
+	}
+
+	/**
+	 * @return Returns the counters of all stages in the order of the stages.
+	 */
+	std::vector<PipelineStageStatistics> statistics() const
+	{
+		std::vector<PipelineStageStatistics> r;
+		r.reserve(stages.size());
+
+		for (const auto &s : stages)
+		{
+			r.push_back(s->statistics());
+		}
+
+		return r;
+	}
+
+	private:
+	Executor *const ex;
+	const std::shared_ptr<detail::PipelineInlet<In>> head;
+	const std::shared_ptr<detail::PipelineOutput<Out>> tail;
+	const std::vector<std::shared_ptr<detail::PipelineStageBase>> stages;
+	std::atomic<bool> closed{false};
+};
+
+/**
+ * Builds a \ref Pipeline stage by stage. Every stage has its own executor,
+ * parallelism and bounded queue, so different stages of one value run on
+ * different threads and a slow stage applies backpressure to the previous
+ * stages.
+ *
+ * \code{.cpp}
+ * auto pipeline = PipelineBuilder<std::string>()
+ *                     .stage(&parsers, 2, 16, parse)
+ *                     .stage(&writers, 1, 16, write)
+ *                     .build(ex, PipelineOrder::Ordered);
+ * \endcode
+ */
+template <typename In, typename Out = In>
+class PipelineBuilder
+{
+	public:
+	using Stages = std::vector<std::shared_ptr<detail::PipelineStageBase>>;
+	using Connect = std::function<std::shared_ptr<detail::PipelineInlet<In>>(
+	    std::shared_ptr<detail::PipelineInlet<Out>>,
+	    const std::shared_ptr<detail::PipelineContext> &, Stages &)>;
+
+	PipelineBuilder()
+	    : connect([](std::shared_ptr<detail::PipelineInlet<Out>> next,
+	                 const std::shared_ptr<detail::PipelineContext> &, Stages &) {
+		      return next;
+	      })
+	{
+	}
+
+	explicit PipelineBuilder(Connect &&connect) : connect(std::move(connect))
+	{
+	}
+
+	/**
+	 * Appends a stage which applies f to every value.
+	 *
+	 * @param parallelism The maximum number of values which are processed
+	 * concurrently.
+	 * @param capacity The number of values which can wait for a worker before
+	 * the previous stage has to wait.
+	 */
+	template <typename Func>
+	PipelineBuilder<In, typename std::result_of<Func(Out &&)>::type>
+	stage(Executor *ex, std::size_t parallelism, std::size_t capacity, Func &&f)
+	{
+		using R = typename std::result_of<Func(Out &&)>::type;
+		using Stage = detail::PipelineStage<Out, R>;
+
+		auto previous = connect;
+		typename Stage::Function g(std::forward<Func>(f));
+
+		return PipelineBuilder<In, R>(
+		    [previous, ex, parallelism, capacity,
+		     g](std::shared_ptr<detail::PipelineInlet<R>> next,
+		        const std::shared_ptr<detail::PipelineContext> &context,
+		        Stages &stages) {
+			    auto s = std::make_shared<Stage>(ex, parallelism, capacity,
+			                                     typename Stage::Function(g),
+			                                     std::move(next), context);
+			    stages.push_back(s);
+
+			    return previous(s, context, stages);
+		    });
+	}
+
+	/**
+	 * Creates the stages. The builder can be used again.
+	 *
+	 * @param ex Completes the futures of the pipeline and its output.
+	 * @param capacity The buffer size of the output.
+	 */
+	Pipeline<In, Out> build(Executor *ex,
+	                        PipelineOrder order = PipelineOrder::Unordered,
+	                        std::size_t capacity = 1)
+	{
+		auto context = std::make_shared<detail::PipelineContext>(order);
+		auto tail =
+		    std::make_shared<detail::PipelineOutput<Out>>(ex, capacity, context);
+		Stages stages;
+		auto head = connect(tail, context, stages);
+		// The stages have been created from the last to the first.
+		std::reverse(stages.begin(), stages.end());
+
+		return Pipeline<In, Out>(ex, std::move(head), std::move(tail),
+		                         std::move(stages));
+	}
+
+	private:
+	Connect connect;
+};
+
+} // namespace adv
+
+#endif
@@ -110,6 +110,19 @@ class Promise
 	}
 
 	private:
+	template <typename S>
+	friend class Future;
+
+	/**
+	 * Links the core of f to the core of this promise, so f completes this
+	 * promise without a callback. Nothing else may complete this promise.
+	 * @return Returns false if the cores cannot be linked.
+	 */
+	bool tryLinkWith(FutureType f)
+	{
+		return f.core->link(core);
+	}
+
 	CoreType core;
 };
 } // namespace adv
@@ -0,0 +1,224 @@
+#ifndef ADV_RATE_LIMITER_H
+#define ADV_RATE_LIMITER_H
+
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "future.h"
+#include "promise.h"
+#include "timer_executor.h"
+
+namespace adv
+{
+
+/**
+ * A token bucket which limits the rate of requests without blocking threads.
+ * The bucket is refilled continuously with rate tokens per second up to burst
+ * tokens. If there are enough tokens and nobody is waiting, \ref acquire()
+ * returns a completed future. Otherwise, the request is queued and a timer is
+ * scheduled for the time when the oldest request can be granted, so the
+ * requests are granted in FIFO order.
+ *
+ * Unlike \ref AsyncSemaphore, the tokens are consumed and never released, so
+ * the futures are completed with \ref Unit instead of a guard.
+ */
+class RateLimiter
+{
+	public:
+	/**
+	 * @param rate The number of tokens per second.
+	 * @param burst The capacity of the bucket which is full at the beginning.
+	 * @param timer If it is nullptr, \ref TimerExecutor::getDefault() is used.
+	 * Its clock is used for refilling the bucket.
+	 * @throw std::invalid_argument If rate is not positive.
+	 */
+	RateLimiter(Executor *ex, double rate, double burst,
+	            TimerExecutor *timer = nullptr)
+	    : state(std::make_shared<State>(
+	          ex, checkRate(rate), burst,
+	          timer != nullptr ? timer : TimerExecutor::getDefault()))
+	{
+	}
+
+	Executor *getExecutor() const
+	{
+		return state->ex;
+	}
+
+	/**
+	 * @return Returns a future which is completed when n tokens have been
+	 * taken from the bucket. It fails with std::invalid_argument if n exceeds
+	 * the burst capacity, since the request could never be granted and would
+	 * block all later requests.
+	 */
+	Future<Unit> acquire(double n = 1.0)
+	{
+		Promise<Unit> p(state->ex);
+		auto r = p.future();
+
+		if (n > state->burst)
+		{
+			p.tryFailure(
+			    std::invalid_argument("The request exceeds the burst capacity."));
+
+			return r;
+		}
+
+		{
+			std::lock_guard<std::mutex> l(state->m);
+			state->refill();
+
+			if (!state->canAcquire(n))
+			{
+				state->waiters.emplace_back(n, std::move(p));
+				State::scheduleWake(state);
+
+				return r;
+			}
+
+			state->tokens -= n;
+		}
+
+		p.trySuccess(Unit());
+
+		return r;
+	}
+
+	/**
+	 * Does not wait and does not overtake waiting requests.
+	 */
+	bool tryAcquire(double n = 1.0)
+	{
+		std::lock_guard<std::mutex> l(state->m);
+		state->refill();
+
+		if (!state->canAcquire(n))
+		{
+			return false;
+		}
+
+		state->tokens -= n;
+
+		return true;
+	}
+
+	double availableTokens() const
+	{
+		std::lock_guard<std::mutex> l(state->m);
+		state->refill();
+
+		return state->tokens;
+	}
+
+	private:
+	static double checkRate(double rate)
+	{
+		// Also rejects NaN. The delay of a waiting request is divided by the rate.
+		if (!(rate > 0.0))
+		{
+			throw std::invalid_argument("The rate has to be positive.");
+		}
+
+		return rate;
+	}
+
+	struct State
+	{
+		State(Executor *ex, double rate, double burst, TimerExecutor *timer)
+		    : ex(ex), timer(timer), rate(rate), burst(burst), tokens(burst),
+		      refilled(timer->now())
+		{
+		}
+
+		Executor *const ex;
+		TimerExecutor *const timer;
+		const double rate;
+		const double burst;
+		mutable std::mutex m;
+		double tokens;
+		TimerExecutor::Duration refilled;
+		std::deque<std::pair<double, Promise<Unit>>> waiters;
+		bool scheduled{false};
+
+		bool canAcquire(double n) const
+		{
+			return waiters.empty() && tokens >= n;
+		}
+
+		void refill()
+		{
+			const auto now = timer->now();
+			const auto seconds =
+			    std::chrono::duration<double>(now - refilled).count();
+			tokens = std::min(burst, tokens + seconds * rate);
+			refilled = now;
+		}
+
+		/**
+		 * Schedules one timer for the oldest waiting request. Requires the lock.
+		 */
+		static void scheduleWake(const std::shared_ptr<State> &self)
+		{
+			if (self->scheduled || self->waiters.empty())
+			{
+				return;
+			}
+
+			const auto missing = self->waiters.front().first - self->tokens;
+			const auto delay = std::chrono::duration_cast<TimerExecutor::Duration>(
+			    std::chrono::duration<double>(std::max(missing, 0.0) / self->rate));
+			self->scheduled = true;
+			std::weak_ptr<State> weak = self;
+			self->timer->schedule(delay + TimerExecutor::Duration(1), [weak] {
+				auto self = weak.lock();
+
+				if (self != nullptr)
+				{
+					wake(self);
+				}
+			});
+		}
+
+		/**
+		 * Grants the oldest waiting requests. The futures are completed without
+		 * the lock since their callbacks might acquire tokens again.
+		 */
+		static void wake(const std::shared_ptr<State> &self)
+		{
+			std::vector<Promise<Unit>> granted;
+
+			{
+				std::lock_guard<std::mutex> l(self->m);
+				self->scheduled = false;
+				self->refill();
+
+				while (!self->waiters.empty() &&
+				       self->tokens >= self->waiters.front().first)
+				{
+					self->tokens -= self->waiters.front().first;
+					granted.push_back(std::move(self->waiters.front().second));
+					self->waiters.pop_front();
+				}
+
+				scheduleWake(self);
+			}
+
+			for (auto &p : granted)
+			{
+				p.trySuccess(Unit());
+			}
+		}
+	};
+
+	std::shared_ptr<State> state;
+};
+
+} // namespace adv
+
+#endif
@@ -0,0 +1,187 @@
+#ifndef ADV_RETRY_H
+#define ADV_RETRY_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <functional>
+#include <random>
+
+#include "future.h"
+#include "promise.h"
+#include "timer_executor.h"
+
+namespace adv
+{
+
+/**
+ * Configures \ref retry(). The delay before the n-th retry is
+ * initialDelay * multiplier^(n - 1) limited by maxDelay. A random part of the
+ * delay up to the jitter fraction is subtracted, so clients which failed at the
+ * same time do not retry at the same time.
+ */
+struct RetryPolicy
+{
+	using Duration = std::chrono::steady_clock::duration;
+
+	/**
+	 * The maximum number of attempts including the first one.
+	 */
+	std::size_t maxAttempts{3};
+	Duration initialDelay{std::chrono::milliseconds(10)};
+	Duration maxDelay{std::chrono::seconds(1)};
+	double multiplier{2.0};
+	/**
+	 * A value between 0 (no jitter) and 1 (full jitter).
+	 */
+	double jitter{0.5};
+	/**
+	 * Decides whether the failed attempt is retried. If it is empty, all
+	 * exceptions are retried.
+	 */
+	std::function<bool(const std::exception_ptr &)> retryOn;
+
+	/**
+	 * @param retries The number of retries so far starting with 1.
+	 * @param random A random value in [0, 1).
+	 */
+	Duration delay(std::size_t retries, double random) const
+	{
+		using D = std::chrono::duration<double, Duration::period>;
+		const auto d =
+		    std::min(D(initialDelay) * std::pow(multiplier, retries - 1.0),
+		             D(maxDelay));
+
+		return std::chrono::duration_cast<Duration>(d * (1.0 - jitter * random));
+	}
+};
+
+/**
+ * Runs f on ex until its future succeeds, the exception is not accepted by the
+ * policy or the maximum number of attempts has been reached. In the latter
+ * cases, the resulting future fails with the exception of the last attempt.
+ *
+ * All attempts share one context and every failed attempt releases its future
+ * before the next one is started, so the memory stays constant regardless of
+ * the number of attempts. Attempts which fail synchronously are retried in a
+ * loop rather than recursively.
+ *
+ * @param f Returns a future. Exceptions thrown by f count as failed attempts.
+ * @param timer If it is nullptr, \ref TimerExecutor::getDefault() is used.
+ */
+template <typename Func>
+typename std::result_of<Func()>::type retry(Executor *ex, Func &&f,
+                                            RetryPolicy policy,
+                                            TimerExecutor *timer = nullptr)
+{
+	using T = typename std::result_of<Func()>::type::Type;
+	using F = typename std::decay<Func>::type;
+
+	if (timer == nullptr)
+	{
+		timer = TimerExecutor::getDefault();
+	}
+
+	struct Context
+	{
+		Context(Executor *ex, F &&f, RetryPolicy &&policy, TimerExecutor *timer)
+		    : p(ex), ex(ex), f(std::move(f)), policy(std::move(policy)),
+		      timer(timer)
+		{
+		}
+
+		Promise<T> p;
+		Executor *ex;
+		F f;
+		const RetryPolicy policy;
+		TimerExecutor *timer;
+		std::size_t attempts{0};
+		std::atomic<int> pending{0};
+
+		/**
+		 * Trampoline: If an attempt is started while another one is running on the
+		 * stack, the running one starts it after returning.
+		 */
+		static void attempt(const std::shared_ptr<Context> &ctx)
+		{
+			if (ctx->pending++ > 0)
+			{
+				return;
+			}
+
+			do
+			{
+				run(ctx);
+			} while (--ctx->pending > 0);
+		}
+
+		static void run(const std::shared_ptr<Context> &ctx)
+		{
+			++ctx->attempts;
+
+			try
+			{
+				ctx->f().onComplete(
+				    [ctx](const Try<T> &t) { completeAttempt(ctx, t); });
+			}
+			catch (...)
+			{
+				completeAttempt(ctx, Try<T>(std::current_exception()));
+			}
+		}
+
+		static void completeAttempt(const std::shared_ptr<Context> &ctx,
+		                            const Try<T> &t)
+		{
+			if (t.hasValue() || ctx->attempts >= ctx->policy.maxAttempts)
+			{
+				ctx->p.tryComplete(t);
+
+				return;
+			}
+
+			std::exception_ptr e;
+
+			try
+			{
+				t.get();
+			}
+			catch (...)
+			{
+				e = std::current_exception();
+			}
+
+			if (ctx->policy.retryOn && !ctx->policy.retryOn(e))
+			{
+				ctx->p.tryComplete(t);
+
+				return;
+			}
+
+			thread_local std::mt19937 engine(std::random_device{}());
+			std::uniform_real_distribution<double> random(0.0, 1.0);
+			const auto d = ctx->policy.delay(ctx->attempts, random(engine));
+
+			if (d <= RetryPolicy::Duration::zero())
+			{
+				ctx->ex->add([ctx] { attempt(ctx); });
+			}
+			else
+			{
+				ctx->timer->schedule(
+				    d, [ctx] { ctx->ex->add([ctx] { attempt(ctx); }); });
+			}
+		}
+	};
+
+	auto ctx = std::make_shared<Context>(ex, F(std::forward<Func>(f)),
+	                                     std::move(policy), timer);
+	ex->add([ctx] { Context::attempt(ctx); });
+
+	return ctx->p.future();
+}
+
+} // namespace adv
+
+#endif
@@ -0,0 +1,262 @@
+#ifndef ADV_SELECT_H
+#define ADV_SELECT_H
+
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "future.h"
+#include "mvar/mvar.h"
+
+namespace adv
+{
+
+namespace detail
+{
+
+/**
+ * Is shared with the callbacks, since they might still be executed after they
+ * have been removed.
+ */
+struct FutureSelector
+{
+	std::mutex m;
+	std::condition_variable condition;
+	bool ready{false};
+
+	void notify()
+	{
+		{
+			std::lock_guard<std::mutex> l(m);
+			ready = true;
+		}
+
+		condition.notify_one();
+	}
+};
+
+template <typename T>
+std::optional<std::size_t> firstReady(std::vector<Future<T>> &futures)
+{
+	for (std::size_t i = 0; i < futures.size(); ++i)
+	{
+		if (futures[i].isReady())
+		{
+			return i;
+		}
+	}
+
+	return std::nullopt;
+}
+
+template <typename T, typename Clock, typename Duration>
+std::optional<std::size_t>
+select(std::vector<Future<T>> &futures,
+       const std::optional<std::chrono::time_point<Clock, Duration>> &deadline)
+{
+	if (futures.empty())
+	{
+		// Nothing could ever wake the thread.
+		throw std::invalid_argument("Select requires at least one future.");
+	}
+
+	auto r = firstReady(futures);
+
+	if (r)
+	{
+		return r;
+	}
+
+	auto s = std::make_shared<FutureSelector>();
+	std::vector<CallbackHandle> handles;
+	handles.reserve(futures.size());
+
+	for (auto &f : futures)
+	{
+		handles.push_back(f.onComplete([s](const Try<T> &) { s->notify(); }));
+	}
+
+	{
+		std::unique_lock<std::mutex> l(s->m);
+		auto ready = [&s] { return s->ready; };
+
+		if (deadline)
+		{
+			s->condition.wait_until(l, *deadline, ready);
+		}
+		else
+		{
+			s->condition.wait(l, ready);
+		}
+	}
+
+	for (auto &h : handles)
+	{
+		h.remove();
+	}
+
+	return firstReady(futures);
+}
+
+/**
+ * Takes the value of the first full MVar or gets the result of the first
+ * completed future. The indices of the futures follow the indices of the
+ * MVars.
+ */
+template <typename T>
+std::optional<std::pair<std::size_t, Try<T>>>
+tryFirst(const std::vector<adv_mvar::MVar<T> *> &mvars,
+         std::vector<Future<T>> &futures)
+{
+	auto taken = adv_mvar::detail::tryTakeFirst(mvars);
+
+	if (taken)
+	{
+		return std::make_pair(taken->first, Try<T>(std::move(taken->second)));
+	}
+
+	auto i = firstReady(futures);
+
+	if (i)
+	{
+		return std::make_pair(mvars.size() + *i, futures[*i].get());
+	}
+
+	return std::nullopt;
+}
+
+template <typename T, typename Clock, typename Duration>
+std::optional<std::pair<std::size_t, Try<T>>>
+select(const std::vector<adv_mvar::MVar<T> *> &mvars,
+       std::vector<Future<T>> &futures,
+       const std::optional<std::chrono::time_point<Clock, Duration>> &deadline)
+{
+	if (mvars.empty() && futures.empty())
+	{
+		throw std::invalid_argument(
+		    "Select requires at least one MVar or future.");
+	}
+
+	auto r = tryFirst(mvars, futures);
+
+	if (r)
+	{
+		return r;
+	}
+
+	// The callbacks might still be executed after they have been removed.
+	auto s = std::make_shared<adv_mvar::detail::Selector>();
+	adv_mvar::detail::SelectGuard<T> guard(mvars, s.get());
+	std::vector<CallbackHandle> handles;
+	handles.reserve(futures.size());
+
+	for (auto &f : futures)
+	{
+		handles.push_back(f.onComplete([s](const Try<T> &) { s->notify(); }));
+	}
+
+	while (true)
+	{
+		const auto seen = s->version();
+		r = tryFirst(mvars, futures);
+
+		if (r || !s->waitUntil(seen, deadline))
+		{
+			break;
+		}
+	}
+
+	for (auto &h : handles)
+	{
+		h.remove();
+	}
+
+	return r;
+}
+
+} // namespace detail
+
+/**
+ * Blocks until the first of the futures has been completed. Unlike \ref
+ * Future::first(), it does not create any promise. It registers one waiter at
+ * all futures and removes it from them before it returns, so long-lived futures
+ * do not collect callbacks in loops which select repeatedly.
+ * If several futures have been completed, the one with the lowest index is
+ * chosen.
+ *
+ * The callbacks which wake the thread are executed by the executors of the
+ * futures, so these executors must not depend on the waiting thread.
+ *
+ * @return Returns the index of the future and its result.
+ * @throw std::invalid_argument If futures is empty.
+ */
+template <typename T>
+std::pair<std::size_t, Try<T>> select(std::vector<Future<T>> &futures)
+{
+	const auto i = *detail::select(
+	    futures, std::optional<std::chrono::steady_clock::time_point>());
+
+	return std::make_pair(i, futures[i].get());
+}
+
+/**
+ * Like \ref select() but returns nothing if no future has been completed within
+ * d.
+ */
+template <typename T, typename Rep, typename Period>
+std::optional<std::pair<std::size_t, Try<T>>>
+selectFor(std::vector<Future<T>> &futures,
+          const std::chrono::duration<Rep, Period> &d)
+{
+	const auto i = detail::select(
+	    futures, std::make_optional(std::chrono::steady_clock::now() + d));
+
+	if (!i)
+	{
+		return std::nullopt;
+	}
+
+	return std::make_pair(*i, futures[*i].get());
+}
+
+/**
+ * Waits for several MVars and futures at once like \ref adv_mvar::select() and
+ * \ref select(). Full MVars are preferred to completed futures. The value of
+ * the chosen MVar is taken.
+ *
+ * @return Returns the index and the value or result. The indices of the
+ * futures start after the indices of the MVars.
+ * @throw std::invalid_argument If mvars and futures are both empty.
+ */
+template <typename T>
+std::pair<std::size_t, Try<T>>
+select(const std::vector<adv_mvar::MVar<T> *> &mvars,
+       std::vector<Future<T>> &futures)
+{
+	return std::move(*detail::select(
+	    mvars, futures, std::optional<std::chrono::steady_clock::time_point>()));
+}
+
+/**
+ * Like \ref select() but returns nothing if no MVar has become full and no
+ * future has been completed within d.
+ */
+template <typename T, typename Rep, typename Period>
+std::optional<std::pair<std::size_t, Try<T>>>
+selectFor(const std::vector<adv_mvar::MVar<T> *> &mvars,
+          std::vector<Future<T>> &futures,
+          const std::chrono::duration<Rep, Period> &d)
+{
+	return detail::select(
+	    mvars, futures,
+	    std::make_optional(std::chrono::steady_clock::now() + d));
+}
+
+} // namespace adv
+
+#endif
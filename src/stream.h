@@ -0,0 +1,840 @@
+#ifndef ADV_STREAM_H
+#define ADV_STREAM_H
+
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <variant>
+#include <vector>
+
+#include "future.h"
+#include "loop.h"
+#include "promise.h"
+
+namespace adv
+{
+
+/**
+ * A value which is pushed into a closed \ref Channel fails with this exception.
+ */
+class ChannelClosed : public std::exception
+{
+};
+
+/**
+ * An asynchronous stream of values which are pulled one after another.
+ * The end of the stream is signaled by an empty optional.
+ * Values are only produced when they are pulled or when they fit into the
+ * buffer of a \ref Channel, so a slow consumer slows the producer down.
+ * Streams can be copied around and share their source.
+ */
+template <typename T>
+class Stream
+{
+	public:
+	using Type = T;
+	using Value = std::optional<T>;
+
+	/**
+	 * Produces the values of a stream. It might be pulled concurrently.
+	 */
+	class Source
+	{
+		public:
+		virtual ~Source() = default;
+
+		virtual Future<Value> next() = 0;
+
+		/**
+		 * By default, every batch contains one value.
+		 */
+		virtual Future<std::vector<T>> nextN(std::size_t n)
+		{
+			(void)n;
+
+			return next().then([](const Try<Value> &t) {
+				std::vector<T> r;
+				const auto &v = t.get();
+
+				if (v)
+				{
+					r.push_back(*v);
+				}
+
+				return r;
+			});
+		}
+	};
+
+	Stream() = delete;
+
+	Stream(Executor *ex, std::shared_ptr<Source> source)
+	    : ex(ex), source(std::move(source))
+	{
+	}
+
+	Executor *getExecutor() const
+	{
+		return ex;
+	}
+
+	/**
+	 * @return Returns a future of the next value or of an empty optional if the
+	 * stream has ended.
+	 */
+	Future<Value> next()
+	{
+		return source->next();
+	}
+
+	/**
+	 * @return Returns a future which is completed as soon as at least one value
+	 * is available with at most n values or with no value if the stream has
+	 * ended. Streams of channels return all buffered values at once while other
+	 * streams return one value per batch.
+	 */
+	Future<std::vector<T>> nextN(std::size_t n)
+	{
+		return source->nextN(n);
+	}
+
+	/**
+	 * @return Returns a future of all remaining values.
+	 */
+	Future<std::vector<T>> collect()
+	{
+		auto s = source;
+
+		return detail::runLoop<std::vector<T>>(
+		    ex, std::vector<T>(),
+		    [s](std::vector<T> &) { return s->nextN(BATCH_SIZE); },
+		    [](std::vector<T> &r, const std::vector<T> &batch,
+		       Promise<std::vector<T>> &p) {
+			    if (batch.empty())
+			    {
+				    p.trySuccess(std::move(r));
+
+				    return false;
+			    }
+
+			    r.insert(r.end(), batch.begin(), batch.end());
+
+			    return true;
+		    },
+		    LOOP_INLINE_LIMIT);
+	}
+
+	/**
+	 * @return Returns a stream of the results of f for every value.
+	 */
+	template <typename Func>
+	Stream<typename std::result_of<Func(const T &)>::type> map(Func &&f);
+
+	/**
+	 * @return Returns a stream of the values which fulfill pred.
+	 */
+	template <typename Func>
+	Stream<T> filter(Func &&pred);
+
+	/**
+	 * @return Returns a stream of the first n values. Afterwards, this stream is
+	 * not pulled anymore.
+	 */
+	Stream<T> take(std::size_t n);
+
+	/**
+	 * @return Returns a stream of the values of this and other in the order in
+	 * which they become available. Both streams are pulled eagerly as long as the
+	 * values fit into a buffer with the given capacity.
+	 */
+	Stream<T> merge(Stream<T> other, std::size_t capacity = 1);
+
+	/**
+	 * @return Returns a stream which pulls up to n values ahead of its consumer.
+	 */
+	Stream<T> buffer(std::size_t n);
+
+	private:
+	static constexpr std::size_t BATCH_SIZE = 64;
+
+	Executor *ex;
+	std::shared_ptr<Source> source;
+};
+
+/**
+ * A bounded multi-producer multi-consumer channel.
+ * Producers push values and consumers pull them from \ref stream().
+ * If the buffer is full, the future returned by \ref push() is completed when
+ * the value has been accepted, which provides backpressure. A consumer which
+ * waits for a value gets it directly from the producer.
+ * Channels can be copied around and share their state.
+ */
+template <typename T>
+class Channel
+{
+	public:
+	using Value = typename Stream<T>::Value;
+
+	/**
+	 * @param capacity A capacity of 0 hands every value over directly from a
+	 * producer to a consumer.
+	 */
+	Channel(Executor *ex, std::size_t capacity)
+	    : state(std::make_shared<State>(ex, capacity))
+	{
+	}
+
+	/**
+	 * @return Returns a future which is completed when the value has been
+	 * accepted or fails with \ref ChannelClosed if the channel has been closed.
+	 */
+	Future<Unit> push(T v)
+	{
+		return state->push(std::move(v));
+	}
+
+	/**
+	 * @return Returns false if the buffer is full or the channel has been closed.
+	 */
+	bool tryPush(T v)
+	{
+		return state->tryPush(std::move(v));
+	}
+
+	/**
+	 * Ends the stream after all accepted values have been pulled.
+	 */
+	void close()
+	{
+		state->close(nullptr);
+	}
+
+	/**
+	 * Fails the stream with e after all accepted values have been pulled.
+	 */
+	void fail(std::exception_ptr e)
+	{
+		state->close(std::move(e));
+	}
+
+	Stream<T> stream()
+	{
+		return Stream<T>(state->ex, state);
+	}
+
+	private:
+	class State : public Stream<T>::Source
+	{
+		public:
+		State(Executor *ex, std::size_t capacity) : ex(ex), capacity(capacity)
+		{
+		}
+
+		Future<Unit> push(T &&v)
+		{
+			Promise<Unit> p(ex);
+			std::optional<Taker> taker;
+
+			{
+				std::lock_guard<std::mutex> l(m);
+
+				if (closed)
+				{
+					p.tryFailure(ChannelClosed());
+
+					return p.future();
+				}
+
+				if (!takers.empty())
+				{
+					taker.emplace(std::move(takers.front()));
+					takers.pop_front();
+				}
+				else if (values.size() < capacity)
+				{
+					values.push_back(std::move(v));
+				}
+				else
+				{
+					auto r = p.future();
+					blocked.emplace_back(std::move(v), std::move(p));
+
+					return r;
+				}
+			}
+
+			if (taker)
+			{
+				std::vector<T> batch;
+				batch.push_back(std::move(v));
+				complete(*taker, std::move(batch));
+			}
+
+			p.trySuccess(Unit());
+
+			return p.future();
+		}
+
+		bool tryPush(T &&v)
+		{
+			std::optional<Taker> taker;
+
+			{
+				std::lock_guard<std::mutex> l(m);
+
+				if (closed)
+				{
+					return false;
+				}
+
+				if (!takers.empty())
+				{
+					taker.emplace(std::move(takers.front()));
+					takers.pop_front();
+				}
+				else if (values.size() < capacity)
+				{
+					values.push_back(std::move(v));
+
+					return true;
+				}
+				else
+				{
+					return false;
+				}
+			}
+
+			std::vector<T> batch;
+			batch.push_back(std::move(v));
+			complete(*taker, std::move(batch));
+
+			return true;
+		}
+
+		void close(std::exception_ptr &&e)
+		{
+			std::deque<Taker> ended;
+
+			{
+				std::lock_guard<std::mutex> l(m);
+
+				if (closed)
+				{
+					return;
+				}
+
+				closed = true;
+				error = std::move(e);
+				// Waiting consumers imply that there are no values.
+				ended.swap(takers);
+			}
+
+			for (auto &taker : ended)
+			{
+				if (error)
+				{
+					fail(taker, error);
+				}
+				else
+				{
+					complete(taker, std::vector<T>());
+				}
+			}
+		}
+
+		Future<Value> next() override
+		{
+			Promise<Value> p(ex);
+			auto r = p.future();
+			take(Taker(std::move(p)), 1);
+
+			return r;
+		}
+
+		Future<std::vector<T>> nextN(std::size_t n) override
+		{
+			Promise<std::vector<T>> p(ex);
+			auto r = p.future();
+			take(Taker(std::make_pair(std::move(p), n)), n == 0 ? 1 : n);
+
+			return r;
+		}
+
+		Executor *const ex;
+
+		private:
+		using Producer = std::pair<T, Promise<Unit>>;
+		/*
+		 * A consumer which waits for either one value or for a batch of at most n
+		 * values.
+		 */
+		using Taker = std::variant<Promise<Value>,
+		                           std::pair<Promise<std::vector<T>>, std::size_t>>;
+
+		void take(Taker &&taker, std::size_t n)
+		{
+			std::vector<T> batch;
+			std::vector<Promise<Unit>> accepted;
+			bool ended = false;
+
+			{
+				std::lock_guard<std::mutex> l(m);
+
+				while (batch.size() < n && !values.empty())
+				{
+					batch.push_back(std::move(values.front()));
+					values.pop_front();
+				}
+
+				// Without a buffer, the values are taken from the producers directly.
+				while (batch.size() < n && !blocked.empty())
+				{
+					batch.push_back(std::move(blocked.front().first));
+					accepted.push_back(std::move(blocked.front().second));
+					blocked.pop_front();
+				}
+
+				while (values.size() < capacity && !blocked.empty())
+				{
+					values.push_back(std::move(blocked.front().first));
+					accepted.push_back(std::move(blocked.front().second));
+					blocked.pop_front();
+				}
+
+				if (batch.empty())
+				{
+					if (closed)
+					{
+						ended = true;
+					}
+					else
+					{
+						takers.push_back(std::move(taker));
+
+						return;
+					}
+				}
+			}
+
+			for (auto &p : accepted)
+			{
+				p.trySuccess(Unit());
+			}
+
+			if (ended && error)
+			{
+				fail(taker, error);
+			}
+			else
+			{
+				complete(taker, std::move(batch));
+			}
+		}
+
+		/**
+		 * Completes the taker with the batch which contains at most as many values
+		 * as the taker waits for. An empty batch ends the stream.
+		 */
+		static void complete(Taker &taker, std::vector<T> &&batch)
+		{
+			if (taker.index() == 0)
+			{
+				std::get<0>(taker).trySuccess(
+				    batch.empty() ? Value() : Value(std::move(batch.front())));
+			}
+			else
+			{
+				std::get<1>(taker).first.trySuccess(std::move(batch));
+			}
+		}
+
+		static void fail(Taker &taker, std::exception_ptr e)
+		{
+			if (taker.index() == 0)
+			{
+				std::get<0>(taker).tryFailure(std::move(e));
+			}
+			else
+			{
+				std::get<1>(taker).first.tryFailure(std::move(e));
+			}
+		}
+
+		const std::size_t capacity;
+		std::mutex m;
+		std::deque<T> values;
+		std::deque<Producer> blocked;
+		std::deque<Taker> takers;
+		bool closed{false};
+		std::exception_ptr error;
+	};
+
+	explicit Channel(std::shared_ptr<State> &&state) : state(std::move(state))
+	{
+	}
+
+	std::shared_ptr<State> state;
+
+	public:
+	/**
+	 * A reference to a channel which does not keep the channel alive.
+	 */
+	class Weak
+	{
+		public:
+		explicit Weak(const Channel<T> &channel) : state(channel.state)
+		{
+		}
+
+		/**
+		 * @return Returns an empty optional if the channel and all of its streams
+		 * have been destroyed.
+		 */
+		std::optional<Channel<T>> lock() const
+		{
+			auto s = state.lock();
+
+			if (s == nullptr)
+			{
+				return std::nullopt;
+			}
+
+			return Channel<T>(std::move(s));
+		}
+
+		private:
+		std::weak_ptr<State> state;
+	};
+};
+
+namespace detail
+{
+
+template <typename T>
+Future<T> successful(Executor *ex, T &&v)
+{
+	Promise<T> p(ex);
+	p.trySuccess(std::move(v));
+
+	return p.future();
+}
+
+/**
+ * Pushes all values of source into channel.
+ * The pump only holds the channel weakly, so it stops pulling source as soon
+ * as all streams of the channel have been destroyed.
+ * @return Returns a future which is completed when the source has ended or the
+ * channel has been destroyed.
+ */
+template <typename T>
+Future<Unit> pump(Executor *ex, Stream<T> source,
+                  typename Channel<T>::Weak channel)
+{
+	using Value = typename Stream<T>::Value;
+	using S = Step<Unit, Unit>;
+
+	return loop(ex, Unit(), [ex, source, channel](Unit) mutable -> Future<S> {
+		if (!channel.lock())
+		{
+			return successful(ex, S(Done<Unit>{Unit()}));
+		}
+
+		return source.next().thenWith(
+		    [ex, channel](const Try<Value> &t) mutable -> Future<S> {
+			    if (t.hasValue() && t.get())
+			    {
+				    auto c = channel.lock();
+
+				    if (!c)
+				    {
+					    return successful(ex, S(Done<Unit>{Unit()}));
+				    }
+
+				    return c->push(T(*t.get())).then([](const Try<Unit> &pushed) {
+					    pushed.get();
+
+					    return S(Continue<Unit>{Unit()});
+				    });
+			    }
+
+			    Promise<S> p(ex);
+
+			    try
+			    {
+				    t.get();
+				    p.trySuccess(S(Done<Unit>{Unit()}));
+			    }
+			    catch (...)
+			    {
+				    p.tryFailure(std::current_exception());
+			    }
+
+			    return p.future();
+		    });
+	});
+}
+
+/**
+ * Closes or fails the channel if it still exists when its pump has ended.
+ */
+template <typename T>
+void end(const typename Channel<T>::Weak &channel, const Try<Unit> &t)
+{
+	auto c = channel.lock();
+
+	if (!c)
+	{
+		return;
+	}
+
+	try
+	{
+		t.get();
+		c->close();
+	}
+	catch (...)
+	{
+		c->fail(std::current_exception());
+	}
+}
+
+} // namespace detail
+
+template <typename T>
+template <typename Func>
+Stream<typename std::result_of<Func(const T &)>::type>
+Stream<T>::map(Func &&f)
+{
+	using S = typename std::result_of<Func(const T &)>::type;
+	using F = typename std::decay<Func>::type;
+
+	struct MapSource : public Stream<S>::Source
+	{
+		MapSource(std::shared_ptr<Source> source, F &&f)
+		    : source(std::move(source)), f(std::make_shared<F>(std::move(f)))
+		{
+		}
+
+		Future<std::optional<S>> next() override
+		{
+			return source->next().then(
+			    [f = this->f](const Try<Value> &t) -> std::optional<S> {
+				    const auto &v = t.get();
+
+				    if (!v)
+				    {
+					    return std::nullopt;
+				    }
+
+				    return (*f)(*v);
+			    });
+		}
+
+		Future<std::vector<S>> nextN(std::size_t n) override
+		{
+			return source->nextN(n).then(
+			    [f = this->f](const Try<std::vector<T>> &t) {
+				    std::vector<S> r;
+				    r.reserve(t.get().size());
+
+				    for (const auto &v : t.get())
+				    {
+					    r.push_back((*f)(v));
+				    }
+
+				    return r;
+			    });
+		}
+
+		std::shared_ptr<Source> source;
+		std::shared_ptr<F> f;
+	};
+
+	return Stream<S>(ex, std::make_shared<MapSource>(
+	                         source, F(std::forward<Func>(f))));
+}
+
+template <typename T>
+template <typename Func>
+Stream<T> Stream<T>::filter(Func &&pred)
+{
+	using F = typename std::decay<Func>::type;
+
+	struct FilterSource : public Source
+	{
+		FilterSource(Executor *ex, std::shared_ptr<Source> source, F &&pred)
+		    : ex(ex), source(std::move(source)),
+		      pred(std::make_shared<F>(std::move(pred)))
+		{
+		}
+
+		// Skips values in a loop without a promise per value.
+		Future<Value> next() override
+		{
+			auto s = source;
+
+			return detail::runLoop<Value>(
+			    ex, Unit(), [s](Unit &) { return s->next(); },
+			    [pred = this->pred](Unit &, const Value &v, Promise<Value> &p) {
+				    if (!v || (*pred)(*v))
+				    {
+					    p.trySuccess(Value(v));
+
+					    return false;
+				    }
+
+				    return true;
+			    },
+			    LOOP_INLINE_LIMIT);
+		}
+
+		Executor *ex;
+		std::shared_ptr<Source> source;
+		std::shared_ptr<F> pred;
+	};
+
+	return Stream<T>(
+	    ex, std::make_shared<FilterSource>(ex, source, F(std::forward<Func>(pred))));
+}
+
+template <typename T>
+Stream<T> Stream<T>::take(std::size_t n)
+{
+	struct TakeSource : public Source
+	{
+		TakeSource(Executor *ex, std::shared_ptr<Source> source, std::size_t n)
+		    : ex(ex), source(std::move(source)),
+		      remaining(std::make_shared<std::atomic<std::size_t>>(n))
+		{
+		}
+
+		Future<Value> next() override
+		{
+			return reserve(1) == 0 ? detail::successful(ex, Value())
+			                       : source->next();
+		}
+
+		/**
+		 * Reserved values which are not in the batch are given back.
+		 */
+		Future<std::vector<T>> nextN(std::size_t n) override
+		{
+			const auto r = reserve(n == 0 ? 1 : n);
+
+			if (r == 0)
+			{
+				return detail::successful(ex, std::vector<T>());
+			}
+
+			return source->nextN(r).then(
+			    [remaining = this->remaining, r](const Try<std::vector<T>> &t) {
+				    const auto &batch = t.get();
+				    *remaining += r - batch.size();
+
+				    return batch;
+			    });
+		}
+
+		/**
+		 * @return Returns the number of values which may still be pulled up to n.
+		 */
+		std::size_t reserve(std::size_t n)
+		{
+			auto r = remaining->load();
+
+			while (r > 0 &&
+			       !remaining->compare_exchange_weak(r, r - std::min(r, n)))
+			{
+			}
+
+			return std::min(r, n);
+		}
+
+		Executor *ex;
+		std::shared_ptr<Source> source;
+		std::shared_ptr<std::atomic<std::size_t>> remaining;
+	};
+
+	return Stream<T>(ex, std::make_shared<TakeSource>(ex, source, n));
+}
+
+template <typename T>
+Stream<T> Stream<T>::merge(Stream<T> other, std::size_t capacity)
+{
+	Channel<T> channel(ex, capacity);
+	typename Channel<T>::Weak weak(channel);
+	auto running = std::make_shared<std::atomic<int>>(2);
+	auto ended = [weak, running](const Try<Unit> &t) {
+		if (t.hasException() || --*running == 0)
+		{
+			detail::end<T>(weak, t);
+		}
+	};
+	detail::pump<T>(ex, *this, weak).onComplete(ended);
+	detail::pump<T>(ex, other, weak).onComplete(ended);
+
+	return channel.stream();
+}
+
+template <typename T>
+Stream<T> Stream<T>::buffer(std::size_t n)
+{
+	Channel<T> channel(ex, n);
+	typename Channel<T>::Weak weak(channel);
+	detail::pump<T>(ex, *this, weak).onComplete(
+	    [weak](const Try<Unit> &t) { detail::end<T>(weak, t); });
+
+	return channel.stream();
+}
+
+/**
+ * @return Returns a stream of the indices and results of the futures in the
+ * order of their completion. It ends when all futures have been completed.
+ * Every completion pushes its result into the buffer of a channel in O(1)
+ * without creating a promise, so the results can be processed as soon as they
+ * are available.
+ */
+template <typename T>
+Stream<std::pair<std::size_t, Try<T>>> whenEach(Executor *ex,
+                                                std::vector<Future<T>> futures)
+{
+	using V = std::pair<std::size_t, Try<T>>;
+
+	struct Context
+	{
+		Context(Executor *ex, std::size_t n) : channel(ex, n), remaining(n)
+		{
+		}
+
+		Channel<V> channel;
+		std::atomic<std::size_t> remaining;
+	};
+
+	auto ctx = std::make_shared<Context>(ex, futures.size());
+
+	if (futures.empty())
+	{
+		ctx->channel.close();
+	}
+
+	for (std::size_t i = 0; i < futures.size(); ++i)
+	{
+		futures[i].onComplete([ctx, i](const Try<T> &t) {
+			// The buffer has room for all results.
+			ctx->channel.tryPush(V(i, t));
+
+			if (--ctx->remaining == 0)
+			{
+				ctx->channel.close();
+			}
+		});
+	}
+
+	return ctx->channel.stream();
+}
+
+} // namespace adv
+
+#endif
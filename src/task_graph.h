@@ -0,0 +1,373 @@
+#ifndef ADV_TASK_GRAPH_H
+#define ADV_TASK_GRAPH_H
+
+#include <algorithm>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+
+#include "future.h"
+#include "promise.h"
+
+namespace adv
+{
+
+/**
+ * Is thrown by \ref TaskGraph::run() if the dependencies contain a cycle.
+ */
+class TaskGraphCycle : public std::exception
+{
+};
+
+/**
+ * Is thrown by \ref TaskGraph::run() if the previous run has not finished yet.
+ */
+class TaskGraphRunning : public std::exception
+{
+};
+
+/**
+ * A directed acyclic graph of functions whose edges are dependencies. Unlike
+ * chains of \ref Future::then(), the whole graph is known before it runs, so
+ * ready nodes are not executed in FIFO order but by their longest remaining
+ * path: the sum of the costs of the node and its most expensive chain of
+ * dependent nodes. Nodes on the critical path start first, which keeps the
+ * workers busy until the end of the run.
+ *
+ * A run submits up to parallelism workers to the executor. Every worker
+ * executes the ready node with the highest priority until there is no ready
+ * node. The priorities and the state of a run are allocated when the graph is
+ * run for the first time after it has been changed, so repeated runs do not
+ * reallocate them.
+ *
+ * If a node fails, its dependent nodes are not executed and fail with the same
+ * exception.
+ */
+class TaskGraph
+{
+	public:
+	using Node = std::size_t;
+
+	TaskGraph() : state(std::make_shared<State>())
+	{
+	}
+
+	TaskGraph(const TaskGraph &) = delete;
+	TaskGraph &operator=(const TaskGraph &) = delete;
+
+	/**
+	 * Must not be called during a run.
+	 *
+	 * @param cost An estimate of the duration of f relative to the other nodes.
+	 * @return Returns the node of f.
+	 */
+	Node add(std::function<void()> f, double cost = 1.0)
+	{
+		state->nodes.push_back(NodeData{std::move(f), cost, {}, 0});
+		state->compiled = false;
+
+		return state->nodes.size() - 1;
+	}
+
+	/**
+	 * Node is not executed before dependency has finished. Must not be called
+	 * during a run.
+	 */
+	void dependsOn(Node node, Node dependency)
+	{
+		state->nodes[dependency].dependents.push_back(node);
+		++state->nodes[node].dependencies;
+		state->compiled = false;
+	}
+
+	std::size_t size() const
+	{
+		return state->nodes.size();
+	}
+
+	/**
+	 * @return Returns the longest remaining path of the node which is its
+	 * priority.
+	 * @throw TaskGraphCycle If the dependencies contain a cycle.
+	 */
+	double priority(Node node)
+	{
+		std::lock_guard<std::mutex> l(state->m);
+		state->compile();
+
+		return state->priorities[node];
+	}
+
+	/**
+	 * Executes all nodes.
+	 *
+	 * @return Returns one future per node which is completed when the node has
+	 * finished.
+	 * @throw TaskGraphCycle If the dependencies contain a cycle.
+	 * @throw TaskGraphRunning If the previous run has not finished yet.
+	 */
+	std::vector<Future<Unit>>
+	run(Executor *ex,
+	    std::size_t parallelism = std::max(1u, std::thread::hardware_concurrency()))
+	{
+		std::vector<Future<Unit>> r;
+		r.reserve(state->nodes.size());
+		std::size_t workers = 0;
+
+		{
+			std::lock_guard<std::mutex> l(state->m);
+
+			if (state->unfinished > 0)
+			{
+				throw TaskGraphRunning();
+			}
+
+			state->compile();
+			state->start(ex, std::max<std::size_t>(parallelism, 1));
+
+			for (auto &p : state->promises)
+			{
+				r.push_back(p->future());
+			}
+
+			workers = state->spawn();
+		}
+
+		State::submit(state, ex, workers);
+
+		return r;
+	}
+
+	private:
+	struct NodeData
+	{
+		std::function<void()> f;
+		double cost;
+		std::vector<Node> dependents;
+		std::size_t dependencies;
+	};
+
+	struct State
+	{
+		std::mutex m;
+		std::vector<NodeData> nodes;
+		bool compiled{false};
+
+		// Is allocated by compile():
+		std::vector<double> priorities;
+		std::vector<Node> ready;
+		std::vector<std::size_t> remaining;
+		std::vector<std::exception_ptr> failures;
+		std::vector<std::optional<Promise<Unit>>> promises;
+
+		// The state of the current run:
+		Executor *ex{nullptr};
+		std::size_t parallelism{1};
+		std::size_t workers{0};
+		std::size_t unfinished{0};
+
+		/**
+		 * Computes the priorities in reverse topological order. Requires the lock.
+		 */
+		void compile()
+		{
+			if (compiled)
+			{
+				return;
+			}
+
+			const auto n = nodes.size();
+			priorities.assign(n, 0.0);
+			remaining.assign(n, 0);
+			failures.assign(n, nullptr);
+			promises.clear();
+			promises.resize(n);
+			ready.clear();
+			ready.reserve(n);
+			std::vector<Node> order;
+			order.reserve(n);
+
+			for (Node i = 0; i < n; ++i)
+			{
+				remaining[i] = nodes[i].dependencies;
+
+				if (remaining[i] == 0)
+				{
+					order.push_back(i);
+				}
+			}
+
+			for (std::size_t i = 0; i < order.size(); ++i)
+			{
+				for (auto d : nodes[order[i]].dependents)
+				{
+					if (--remaining[d] == 0)
+					{
+						order.push_back(d);
+					}
+				}
+			}
+
+			if (order.size() != n)
+			{
+				throw TaskGraphCycle();
+			}
+
+			for (auto it = order.rbegin(); it != order.rend(); ++it)
+			{
+				double longest = 0.0;
+
+				for (auto d : nodes[*it].dependents)
+				{
+					longest = std::max(longest, priorities[d]);
+				}
+
+				priorities[*it] = nodes[*it].cost + longest;
+			}
+
+			compiled = true;
+		}
+
+		/**
+		 * Resets the state of the run. Requires the lock.
+		 */
+		void start(Executor *e, std::size_t p)
+		{
+			ex = e;
+			parallelism = p;
+			unfinished = nodes.size();
+			ready.clear();
+
+			for (Node i = 0; i < nodes.size(); ++i)
+			{
+				remaining[i] = nodes[i].dependencies;
+				failures[i] = nullptr;
+				promises[i].emplace(ex);
+
+				if (remaining[i] == 0)
+				{
+					push(i);
+				}
+			}
+		}
+
+		/**
+		 * The heap of ready nodes has the highest priority at the front. Ties are
+		 * broken by the order in which the nodes have been added.
+		 */
+		bool lower(Node a, Node b) const
+		{
+			return priorities[a] < priorities[b] ||
+			       (priorities[a] == priorities[b] && a > b);
+		}
+
+		void push(Node i)
+		{
+			ready.push_back(i);
+			std::push_heap(ready.begin(), ready.end(),
+			               [this](Node a, Node b) { return lower(a, b); });
+		}
+
+		Node pop()
+		{
+			std::pop_heap(ready.begin(), ready.end(),
+			              [this](Node a, Node b) { return lower(a, b); });
+			const auto i = ready.back();
+			ready.pop_back();
+
+			return i;
+		}
+
+		/**
+		 * Requires the lock.
+		 * @return Returns the number of workers which have to be submitted for
+		 * the ready nodes.
+		 */
+		std::size_t spawn()
+		{
+			const auto idle = parallelism > workers ? parallelism - workers : 0;
+			const auto n = std::min(idle, ready.size());
+			workers += n;
+
+			return n;
+		}
+
+		static void submit(const std::shared_ptr<State> &self, Executor *ex,
+		                   std::size_t n)
+		{
+			for (std::size_t i = 0; i < n; ++i)
+			{
+				ex->add([self] { self->work(self); });
+			}
+		}
+
+		void work(const std::shared_ptr<State> &self)
+		{
+			std::unique_lock<std::mutex> l(m);
+
+			while (!ready.empty())
+			{
+				const auto i = pop();
+				auto e = failures[i];
+				auto p = *promises[i];
+				l.unlock();
+
+				if (e == nullptr)
+				{
+					try
+					{
+						nodes[i].f();
+					}
+					catch (...)
+					{
+						e = std::current_exception();
+					}
+				}
+
+				l.lock();
+
+				for (auto d : nodes[i].dependents)
+				{
+					if (e != nullptr && failures[d] == nullptr)
+					{
+						failures[d] = e;
+					}
+
+					if (--remaining[d] == 0)
+					{
+						push(d);
+					}
+				}
+
+				--unfinished;
+				const auto n = spawn();
+				auto current = ex;
+				l.unlock();
+				submit(self, current, n);
+
+				if (e != nullptr)
+				{
+					p.tryFailure(std::move(e));
+				}
+				else
+				{
+					p.trySuccess(Unit());
+				}
+
+				l.lock();
+			}
+
+			--workers;
+		}
+	};
+
+	std::shared_ptr<State> state;
+};
+
+} // namespace adv
+
+#endif
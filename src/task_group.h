@@ -0,0 +1,221 @@
+#ifndef ADV_TASK_GROUP_H
+#define ADV_TASK_GROUP_H
+
+#include <atomic>
+#include <exception>
+#include <memory>
+#include <mutex>
+
+#include "future.h"
+#include "promise.h"
+
+namespace adv
+{
+
+/**
+ * A child of a \ref TaskGroup fails with this exception if the group has been
+ * cancelled before the child has been started.
+ */
+class TaskCancelled : public std::exception
+{
+};
+
+/**
+ * Is thrown by \ref TaskGroup::spawn() if the group has already been completed.
+ */
+class TaskGroupClosed : public std::exception
+{
+};
+
+/**
+ * A scope for asynchronous tasks like a nursery of structured concurrency.
+ * \ref spawn() starts a child on the executor of the group. \ref join() returns
+ * one future which is completed when all children have finished.
+ *
+ * If a child fails, the group is cancelled: children which have not been
+ * started yet fail with \ref TaskCancelled and running children can check
+ * \ref isCancelled(). The future returned by \ref join() fails with the first
+ * exception of a child.
+ *
+ * The destructor joins the group and blocks until all children have finished.
+ * Hence, no child outlives the group and children can refer to memory of the
+ * scope of the group such as local variables without shared pointers.
+ *
+ * Since the destructor waits with \ref Future::get(), a group may only be
+ * destroyed by a task of its own executor if the executor runs other tasks
+ * while waiting, like \ref ThreadPoolExecutor with helpWhileWaiting and
+ * \ref FiberExecutor. On any other executor, the children might need the
+ * blocked thread and the destructor deadlocks. Such tasks should continue the
+ * future of \ref join() instead and keep the group alive until it has been
+ * completed.
+ */
+class TaskGroup
+{
+	public:
+	explicit TaskGroup(Executor *ex) : state(std::make_shared<State>(ex))
+	{
+	}
+
+	TaskGroup(const TaskGroup &) = delete;
+	TaskGroup &operator=(const TaskGroup &) = delete;
+
+	~TaskGroup()
+	{
+		join().get();
+	}
+
+	Executor *getExecutor() const
+	{
+		return state->ex;
+	}
+
+	/**
+	 * Starts f as a child of the group. Children can spawn further children as
+	 * long as the group has not been completed.
+	 *
+	 * @return Returns the future of the result of f.
+	 * @throw TaskGroupClosed If the group has already been completed.
+	 */
+	template <typename Func>
+	Future<typename std::result_of<Func()>::type> spawn(Func &&f)
+	{
+		using T = typename std::result_of<Func()>::type;
+
+		Promise<T> p(state->ex);
+		state->start();
+		state->ex->add(
+		    [s = state, f = std::forward<Func>(f), p]() mutable {
+			    std::exception_ptr e;
+
+			    if (s->cancelled)
+			    {
+				    p.tryFailure(std::make_exception_ptr(TaskCancelled()));
+			    }
+			    else
+			    {
+				    // The function is destroyed before the group can finish.
+				    auto g = std::move(f);
+
+				    try
+				    {
+					    p.trySuccess(g());
+				    }
+				    catch (...)
+				    {
+					    e = std::current_exception();
+					    p.tryFailure(std::exception_ptr(e));
+				    }
+			    }
+
+			    s->finish(e);
+		    });
+
+		return p.future();
+	}
+
+	/**
+	 * @return Returns a future which is completed when all children have
+	 * finished. It fails with the first exception of a child.
+	 */
+	Future<Unit> join()
+	{
+		return state->join();
+	}
+
+	/**
+	 * Children which have not been started yet will fail with \ref
+	 * TaskCancelled.
+	 */
+	void cancel()
+	{
+		state->cancelled = true;
+	}
+
+	bool isCancelled() const
+	{
+		return state->cancelled;
+	}
+
+	private:
+	struct State
+	{
+		explicit State(Executor *ex) : ex(ex), p(ex)
+		{
+		}
+
+		Executor *const ex;
+		std::atomic<bool> cancelled{false};
+		std::mutex m;
+		std::size_t running = 0;
+		bool joined = false;
+		bool completed = false;
+		std::exception_ptr failure;
+		Promise<Unit> p;
+
+		void start()
+		{
+			std::lock_guard<std::mutex> l(m);
+
+			if (completed)
+			{
+				throw TaskGroupClosed();
+			}
+
+			++running;
+		}
+
+		void finish(std::exception_ptr e)
+		{
+			std::unique_lock<std::mutex> l(m);
+
+			if (e != nullptr && failure == nullptr)
+			{
+				failure = e;
+				cancelled = true;
+			}
+
+			--running;
+			tryComplete(l);
+		}
+
+		Future<Unit> join()
+		{
+			std::unique_lock<std::mutex> l(m);
+			joined = true;
+			tryComplete(l);
+
+			return p.future();
+		}
+
+		/**
+		 * Completes the promise without the lock, since its callbacks might spawn
+		 * children.
+		 */
+		void tryComplete(std::unique_lock<std::mutex> &l)
+		{
+			if (completed || !joined || running > 0)
+			{
+				return;
+			}
+
+			completed = true;
+			auto e = failure;
+			l.unlock();
+
+			if (e != nullptr)
+			{
+				p.tryFailure(std::move(e));
+			}
+			else
+			{
+				p.trySuccess(Unit());
+			}
+		}
+	};
+
+	std::shared_ptr<State> state;
+};
+
+} // namespace adv
+
+#endif
@@ -3,6 +3,7 @@
 
 #include <boost/test/included/unit_test.hpp>
 
+#include <algorithm>
 #include <atomic>
 #include <string>
 
@@ -69,6 +70,46 @@ class TestSuite
 		BOOST_CHECK_EQUAL(3, c);
 	}
 
+	void testOnCompleteRemove()
+	{
+		auto p = createPromiseInt();
+		auto f = p.future();
+		auto counter = std::make_shared<int>(0);
+		auto h0 = f.onComplete([counter](const Try<int> &) { ++(*counter); });
+		auto h1 = f.onComplete([counter](const Try<int> &) { ++(*counter); });
+		BOOST_CHECK_EQUAL(3, counter.use_count());
+
+		BOOST_REQUIRE(h0.remove());
+		BOOST_CHECK(!h0.remove());
+		// The removed callback has been destroyed.
+		BOOST_CHECK_EQUAL(2, counter.use_count());
+
+		// The slot of the removed callback is reused.
+		auto h2 = f.onComplete([counter](const Try<int> &) { ++(*counter); });
+		BOOST_CHECK(!h0.remove());
+		BOOST_REQUIRE(h2.remove());
+
+		BOOST_REQUIRE(p.trySuccess(10));
+		BOOST_CHECK_EQUAL(1, *counter);
+		BOOST_CHECK(!h1.remove());
+	}
+
+	void testOnCompleteOrder()
+	{
+		auto p = createPromiseInt();
+		auto f = p.future();
+		std::vector<int> order;
+		f.onComplete([&order](const Try<int> &) { order.push_back(0); });
+		auto h1 = f.onComplete([&order](const Try<int> &) { order.push_back(1); });
+		f.onComplete([&order](const Try<int> &) { order.push_back(2); });
+		BOOST_REQUIRE(h1.remove());
+		// The callback reuses the slot of the removed one but is called last.
+		f.onComplete([&order](const Try<int> &) { order.push_back(3); });
+
+		BOOST_REQUIRE(p.trySuccess(10));
+		BOOST_CHECK(order == std::vector<int>({0, 2, 3}));
+	}
+
 	// implementations are quite different here.
 	void testOnCompleteIsReadyAndGet()
 	{
@@ -176,6 +217,149 @@ class TestSuite
 		BOOST_CHECK_EQUAL(Try<std::string>("11"), f.get());
 	}
 
+	void testThenWithLinked()
+	{
+		auto p = createPromiseInt();
+		auto inner = p.future();
+		int executed = 0;
+		auto h = inner.onComplete([&executed](const Try<int> &) { ++executed; });
+		inner.onComplete([&executed](const Try<int> &) { ++executed; });
+		auto f = successful(1).thenWith([inner](const Try<int> &) { return inner; });
+
+		BOOST_REQUIRE(!f.isReady());
+		// The callbacks have been moved to the core of f but can still be removed.
+		BOOST_CHECK(h.remove());
+		inner.onComplete([&executed](const Try<int> &) { ++executed; });
+		p.trySuccess(10);
+
+		BOOST_CHECK_EQUAL(2, executed);
+		BOOST_CHECK_EQUAL(Try<int>(10), f.get());
+		BOOST_CHECK_EQUAL(Try<int>(10), inner.get());
+	}
+
+	void testThenWithLinkedBrokenPromise()
+	{
+		auto *p = new Promise<int>(createPromiseInt());
+		auto inner = p->future();
+		auto f = successful(1).thenWith([inner](const Try<int> &) { return inner; });
+
+		// The promise of inner keeps f from being broken.
+		BOOST_REQUIRE(!f.isReady());
+		delete p;
+		p = nullptr;
+		auto r = f.get();
+
+		BOOST_REQUIRE(r.hasException());
+		BOOST_CHECK_THROW(r.get(), BrokenPromise);
+	}
+
+	void testThenWithRecursive()
+	{
+		ManualTimerExecutor queue;
+		auto f = countDown(&queue, 10000);
+		queue.advance(std::chrono::milliseconds(0));
+
+		BOOST_CHECK_EQUAL(Try<int>(0), f.get());
+	}
+
+	void testFused()
+	{
+		auto p = createPromiseInt();
+		int called = 0;
+		auto chain = p.future()
+		                 .fuse()
+		                 .then([&called](const Try<int> &t) {
+			                 ++called;
+			                 return t.get() + 1;
+		                 })
+		                 .then([&called](const Try<int> &t) {
+			                 ++called;
+			                 return t.get() * 2;
+		                 })
+		                 .then([&called](const Try<int> &t) {
+			                 ++called;
+			                 return std::to_string(t.get());
+		                 });
+		Future<std::string> f = chain;
+
+		BOOST_CHECK(!f.isReady());
+		p.trySuccess(10);
+		BOOST_CHECK_EQUAL(Try<std::string>("22"), f.get());
+		BOOST_CHECK_EQUAL(3, called);
+		// The chain is materialized only once.
+		BOOST_CHECK_EQUAL(Try<std::string>("22"), chain.get());
+		BOOST_CHECK_EQUAL(3, called);
+	}
+
+	void testFusedFails()
+	{
+		bool skipped = true;
+		auto f = successful(10)
+		             .fuse()
+		             .then([](const Try<int> &t) -> int {
+			             throw std::runtime_error("Failure!");
+		             })
+		             .then([&skipped](const Try<int> &t) {
+			             skipped = false;
+			             return t.get() + 1;
+		             })
+		             .then([](const Try<int> &t) {
+			             return t.hasException() ? -1 : t.get();
+		             })
+		             .future();
+
+		BOOST_CHECK_EQUAL(Try<int>(-1), f.get());
+		BOOST_CHECK(!skipped);
+
+		auto g = successful(10)
+		             .fuse()
+		             .then([](const Try<int> &t) -> int {
+			             throw std::runtime_error("Failure!");
+		             })
+		             .then([](const Try<int> &t) { return t.get() + 1; })
+		             .future();
+
+		BOOST_REQUIRE(g.get().hasException());
+		BOOST_CHECK_THROW(g.get().get(), std::runtime_error);
+	}
+
+	void testFusedShared()
+	{
+		int called = 0;
+		auto shared = successful(10).fuse().then([&called](const Try<int> &t) {
+			++called;
+			return t.get() + 1;
+		});
+		auto f0 = shared.then([](const Try<int> &t) { return t.get() * 2; });
+		auto f1 = shared.then([](const Try<int> &t) { return t.get() * 3; });
+
+		BOOST_CHECK_EQUAL(Try<int>(22), f0.get());
+		BOOST_CHECK_EQUAL(Try<int>(33), f1.get());
+		// The shared intermediate result is computed only once.
+		BOOST_CHECK_EQUAL(1, called);
+	}
+
+	void testFusedAfterMaterialized()
+	{
+		int called = 0;
+		auto chain = successful(10).fuse().then([&called](const Try<int> &t) {
+			++called;
+			return t.get() + 1;
+		});
+		auto f = chain.future();
+		auto factor = std::make_shared<int>(2);
+		auto g = std::move(chain)
+		             .then([factor](const Try<int> &t) { return t.get() * *factor; })
+		             .then([](const Try<int> &t) { return t.get() + 1; });
+
+		BOOST_CHECK_EQUAL(Try<int>(11), f.get());
+		BOOST_CHECK_EQUAL(Try<int>(23), g.get());
+		// The materialized continuation is not called again.
+		BOOST_CHECK_EQUAL(1, called);
+		// A materialized chain does not store its continuations.
+		BOOST_CHECK_EQUAL(1, factor.use_count());
+	}
+
 	void testGuard()
 	{
 		auto p = createPromiseInt();
@@ -235,6 +419,79 @@ class TestSuite
 		BOOST_CHECK_THROW(r.get(), std::runtime_error);
 	}
 
+	void testOrElseLazy()
+	{
+		int forced = 0;
+		auto fallback = lazy(ex, [&forced] {
+			++forced;
+			return 11;
+		});
+		auto f0 = successful(10).fallbackTo(fallback);
+
+		BOOST_CHECK_EQUAL(Try<int>(10), f0.get());
+		BOOST_CHECK_EQUAL(0, forced);
+		BOOST_CHECK(!fallback.isForced());
+
+		auto f1 = failed(std::runtime_error("Failure!")).fallbackTo(fallback);
+
+		BOOST_CHECK_EQUAL(Try<int>(11), f1.get());
+		BOOST_CHECK_EQUAL(1, forced);
+	}
+
+	void testLazy()
+	{
+		int started = 0;
+		auto f = lazy(ex, [&started] {
+			         ++started;
+			         return 10;
+		         }).then([&started](const Try<int> &t) {
+			++started;
+			return t.get() * 2;
+		});
+
+		BOOST_CHECK_EQUAL(0, started);
+		BOOST_CHECK(!f.isReady());
+		BOOST_CHECK_EQUAL(Try<int>(20), f.get());
+		BOOST_CHECK_EQUAL(2, started);
+		// The computation is started only once.
+		BOOST_CHECK_EQUAL(Try<int>(20), f.force().get());
+		BOOST_CHECK_EQUAL(2, started);
+
+		bool executed = false;
+		auto g = lazy(ex, [] { return 1; })
+		             .thenWith([this](const Try<int> &t) {
+			             return successful(t.get() + 1);
+		             });
+		g.onComplete([&executed](const Try<int> &t) {
+			executed = true;
+			BOOST_CHECK_EQUAL(Try<int>(2), t);
+		});
+
+		BOOST_CHECK(executed);
+
+		auto h = lazy(ex, []() -> int { throw std::runtime_error("Failure!"); })
+		             .fallbackTo(lazy(ex, [] { return 3; }));
+
+		BOOST_CHECK(!h.isForced());
+		BOOST_CHECK_EQUAL(Try<int>(3), h.get());
+	}
+
+	void testLazyReentrantForce()
+	{
+		std::optional<LazyFuture<int>> self;
+		LazyFuture<int> l(ex, [this, &self] {
+			// Does not deadlock since the computation runs without the lock.
+			BOOST_CHECK(self->isForced());
+			BOOST_CHECK(!self->force().isReady());
+
+			return successful(10);
+		});
+		self.emplace(l);
+
+		BOOST_CHECK_EQUAL(Try<int>(10), l.get());
+		BOOST_CHECK_EQUAL(Try<int>(10), self->force().get());
+	}
+
 	void testFirst()
 	{
 		auto p0 = createPromiseInt();
@@ -272,6 +529,25 @@ class TestSuite
 		}
 	}
 
+	void testFirstLongLived()
+	{
+		auto p = createPromiseInt();
+		auto longLived = p.future();
+
+		for (int i = 0; i < 10; ++i)
+		{
+			auto f0 = longLived.first(successful(i));
+			BOOST_CHECK_EQUAL(Try<int>(int(i)), f0.get());
+			auto f1 = longLived.firstSucc(successful(i));
+			BOOST_CHECK_EQUAL(Try<int>(int(i)), f1.get());
+		}
+
+		auto other = createPromiseInt();
+		auto f = longLived.first(other.future());
+		BOOST_REQUIRE(p.trySuccess(10));
+		BOOST_CHECK_EQUAL(Try<int>(10), f.get());
+	}
+
 	void testFirstSucc()
 	{
 		auto p0 = createPromiseInt();
@@ -512,69 +788,1713 @@ class TestSuite
 		BOOST_CHECK_THROW(v.get(), std::runtime_error);
 	}
 
-	void testAll()
+	void testTimerWheel()
 	{
-		testTryRuntimeError();
-		testTryValue();
-		testOnComplete();
-		testOnCompleteIsReadyAndGet();
-		testOnSuccess();
-		testOnFailure();
-		testGet();
-		testIsReady();
-		testThen();
-		testThenWith();
-		testGuard();
-		testGuardFails();
-		testOrElseFirstSuccessful();
-		testOrElseSecondSuccessful();
-		testOrElseBothFail();
-		testFirst();
-		testFirstWithException();
-		testFirstSucc();
-		testFirstSuccWithException();
-		testFirstSuccBothFail();
-		testAsync();
-		testBrokenPromise();
-		testTryComplete();
-		testTrySuccess();
-		testTryFailure();
-		testTryCompleteWith();
-		testTryCompleteWithFailure();
-		testTrySuccessWith();
-		testTryFailureWith();
-		testFirstN();
-		testFirstNSucc();
-		testFirstNSuccFails();
+		using Wheel = TimerWheel<std::function<void()>>;
+		Wheel wheel(100);
+		std::vector<Wheel::Tick> expired;
+		Wheel::Tick current = 0;
+		const std::vector<Wheel::Tick> expiries = {
+		    50, 100, 101, 355, 356, 70000, 1u << 24, Wheel::range + 1000};
+
+		for (auto e : expiries)
+		{
+			wheel.add(e, [&expired, &current] { expired.push_back(current); });
+		}
+
+		auto removed =
+		    wheel.add(200, [&expired, &current] { expired.push_back(current); });
+		BOOST_CHECK_EQUAL(expiries.size() + 1, wheel.size());
+		BOOST_REQUIRE(wheel.remove(removed));
+		BOOST_CHECK(!wheel.remove(removed));
+
+		while (!wheel.empty())
+		{
+			current = wheel.nextTick();
+			wheel.advance(current, [](std::function<void()> &&f) { f(); });
+		}
+
+		// Expired timers expire at the current tick.
+		const std::vector<Wheel::Tick> expected = {
+		    100, 100, 101, 355, 356, 70000, 1u << 24, Wheel::range + 1000};
+		BOOST_CHECK(expected == expired);
+		BOOST_CHECK_EQUAL(Wheel::never, wheel.nextTick());
 	}
 
-	private:
-	folly::Executor *follyExecutor;
-	FollyExecutor *ex;
+	void testTimerExecutorSchedule()
+	{
+		std::atomic<int> c(0);
+		auto removed = timer.schedule(std::chrono::milliseconds(10), [&c] { ++c; });
+		auto f = sleep(ex, std::chrono::milliseconds(20), &timer);
+		BOOST_REQUIRE(removed.remove());
+		BOOST_CHECK_EQUAL(Try<Unit>(Unit()), f.get());
+		BOOST_CHECK_EQUAL(0, c);
+	}
 
-	Promise<int> createPromiseInt()
+	void testTimerExecutorException()
 	{
-		return Promise<int>(ex);
+		auto handled = createPromiseInt();
+		TimerExecutor t(std::chrono::milliseconds(1),
+		                [handled](std::exception_ptr e) mutable {
+			                handled.tryFailure(std::move(e));
+		                });
+		auto p = createPromiseInt();
+		t.schedule(std::chrono::milliseconds(1),
+		           [] { throw std::runtime_error("Failure!"); });
+		t.schedule(std::chrono::milliseconds(2), [p]() mutable { p.trySuccess(10); });
+
+		// The exception does not leave the thread of the timer executor.
+		BOOST_CHECK_THROW(handled.future().get().get(), std::runtime_error);
+		BOOST_CHECK_EQUAL(Try<int>(10), p.future().get());
 	}
 
-	Promise<std::string> createPromiseString()
+	void testSleep()
 	{
-		return Promise<std::string>(ex);
+		auto start = std::chrono::steady_clock::now();
+		auto f = sleep(ex, std::chrono::milliseconds(10), &timer);
+		f.get();
+
+		BOOST_CHECK(std::chrono::steady_clock::now() - start >=
+		            std::chrono::milliseconds(10));
 	}
 
-	Future<int> successful(int v)
+	void testWithin()
 	{
+		auto f = successful(10).within(std::chrono::hours(1), &timer);
+		BOOST_CHECK_EQUAL(Try<int>(10), f.get());
+
 		auto p = createPromiseInt();
-		p.trySuccess(std::move(v));
-		return p.future();
+		auto f0 = p.future().within(std::chrono::hours(1), &timer);
+		BOOST_REQUIRE(p.trySuccess(11));
+		BOOST_CHECK_EQUAL(Try<int>(11), f0.get());
 	}
 
-	template <typename Exception>
-	Future<int> failed(Exception &&e)
+	void testWithinTimeout()
 	{
 		auto p = createPromiseInt();
-		p.tryFailure(std::move(e));
-		return p.future();
+		auto f = p.future().within(std::chrono::milliseconds(10), &timer);
+		auto r = f.get();
+
+		BOOST_REQUIRE(r.hasException());
+		BOOST_CHECK_THROW(r.get(), Timeout);
+	}
+
+	void testDelayed()
+	{
+		auto start = std::chrono::steady_clock::now();
+		auto f = successful(10).delayed(std::chrono::milliseconds(10), &timer);
+
+		BOOST_CHECK_EQUAL(Try<int>(10), f.get());
+		BOOST_CHECK(std::chrono::steady_clock::now() - start >=
+		            std::chrono::milliseconds(10));
+
+		auto f0 = failed(std::runtime_error("Failure!"))
+		              .delayed(std::chrono::milliseconds(10), &timer);
+		auto r = f0.get();
+		BOOST_REQUIRE(r.hasException());
+		BOOST_CHECK_THROW(r.get(), std::runtime_error);
+	}
+
+	void testLatencyHistogram()
+	{
+		LatencyHistogram latencies(std::chrono::milliseconds(5));
+		BOOST_CHECK(std::chrono::milliseconds(5) == latencies.percentile(0.95));
+
+		for (int i = 1; i <= 100; ++i)
+		{
+			latencies.record(std::chrono::milliseconds(i));
+		}
+
+		auto p95 = latencies.percentile(0.95);
+		// The buckets have a precision of 25 percent.
+		BOOST_CHECK(p95 >= std::chrono::milliseconds(95));
+		BOOST_CHECK(p95 <= std::chrono::milliseconds(119));
+	}
+
+	void testHedge()
+	{
+		std::vector<Promise<int>> pending;
+		std::atomic<int> attempts(0);
+		auto f = hedge(ex,
+		               [this, &pending, &attempts] {
+			               if (attempts++ == 0)
+			               {
+				               pending.push_back(createPromiseInt());
+				               return pending.back().future();
+			               }
+
+			               return successful(10);
+		               },
+		               {std::chrono::milliseconds(10),
+		                std::chrono::milliseconds(20)},
+		               &timer);
+
+		BOOST_CHECK_EQUAL(Try<int>(10), f.get());
+		sleep(ex, std::chrono::milliseconds(30), &timer).get();
+		// The second duplicate is not started after the first success.
+		BOOST_CHECK_EQUAL(2, attempts);
+	}
+
+	void testHedgeFirstSucceeds()
+	{
+		LatencyHistogram latencies;
+		std::atomic<int> attempts(0);
+		auto f = hedge(ex,
+		               [this, &attempts] {
+			               ++attempts;
+			               return successful(10);
+		               },
+		               latencies, 2, 0.95, &timer);
+
+		BOOST_CHECK_EQUAL(Try<int>(10), f.get());
+		sleep(ex, std::chrono::milliseconds(30), &timer).get();
+		BOOST_CHECK_EQUAL(1, attempts);
+		BOOST_CHECK(latencies.percentile(0.95) < std::chrono::milliseconds(10));
+	}
+
+	void testHedgeAllFail()
+	{
+		std::atomic<int> attempts(0);
+		auto f = hedge(ex,
+		               [this, &attempts] {
+			               ++attempts;
+			               return failed(std::runtime_error("Failure!"));
+		               },
+		               {std::chrono::hours(1), std::chrono::hours(2)}, &timer);
+		auto r = f.get();
+
+		// Failed attempts start the next attempt immediately.
+		BOOST_CHECK_EQUAL(3, attempts);
+		BOOST_REQUIRE(r.hasException());
+		BOOST_CHECK_THROW(r.get(), std::runtime_error);
+	}
+
+	void testHedgeAttemptThrows()
+	{
+		std::atomic<int> attempts(0);
+		auto f = hedge(ex,
+		               [this, &attempts]() -> Future<int> {
+			               if (attempts++ < 2)
+			               {
+				               throw std::runtime_error("Failure!");
+			               }
+
+			               return successful(10);
+		               },
+		               {std::chrono::hours(1), std::chrono::hours(2)}, &timer);
+
+		// Throwing attempts count as failed attempts.
+		BOOST_CHECK_EQUAL(Try<int>(10), f.get());
+		BOOST_CHECK_EQUAL(3, attempts);
+	}
+
+	void testRetryPolicyDelay()
+	{
+		RetryPolicy policy;
+		policy.initialDelay = std::chrono::milliseconds(100);
+		policy.maxDelay = std::chrono::seconds(1);
+		policy.jitter = 0.5;
+
+		BOOST_CHECK(std::chrono::milliseconds(100) == policy.delay(1, 0.0));
+		BOOST_CHECK(std::chrono::milliseconds(200) == policy.delay(2, 0.0));
+		BOOST_CHECK(std::chrono::milliseconds(400) == policy.delay(3, 0.0));
+		BOOST_CHECK(std::chrono::seconds(1) == policy.delay(10, 0.0));
+		BOOST_CHECK(std::chrono::milliseconds(75) == policy.delay(1, 0.5));
+	}
+
+	void testRetry()
+	{
+		ManualTimerExecutor manualTimer;
+		RetryPolicy policy;
+		policy.initialDelay = std::chrono::milliseconds(100);
+		policy.jitter = 0.0;
+		std::atomic<int> attempts(0);
+		auto f = retry(ex,
+		               [this, &attempts] {
+			               if (++attempts < 3)
+			               {
+				               return failed(std::runtime_error("Failure!"));
+			               }
+
+			               return successful(10);
+		               },
+		               policy, &manualTimer);
+
+		BOOST_CHECK_EQUAL(1, attempts);
+		manualTimer.advance(std::chrono::milliseconds(99));
+		BOOST_CHECK_EQUAL(1, attempts);
+		manualTimer.advance(std::chrono::milliseconds(1));
+		BOOST_CHECK_EQUAL(2, attempts);
+		manualTimer.advance(std::chrono::milliseconds(199));
+		BOOST_CHECK_EQUAL(2, attempts);
+		BOOST_REQUIRE(!f.isReady());
+		manualTimer.advance(std::chrono::milliseconds(1));
+		BOOST_CHECK_EQUAL(3, attempts);
+		BOOST_CHECK_EQUAL(Try<int>(10), f.get());
+	}
+
+	void testRetryGivesUp()
+	{
+		RetryPolicy policy;
+		policy.maxAttempts = 100000;
+		policy.initialDelay = std::chrono::milliseconds(0);
+		std::atomic<int> attempts(0);
+		// The inline executor retries synchronously without growing the stack.
+		auto f = retry(ex,
+		               [this, &attempts] {
+			               ++attempts;
+			               return failed(std::runtime_error("Failure!"));
+		               },
+		               policy, &timer);
+		auto r = f.get();
+
+		BOOST_CHECK_EQUAL(100000, attempts);
+		BOOST_REQUIRE(r.hasException());
+		BOOST_CHECK_THROW(r.get(), std::runtime_error);
+	}
+
+	void testRetryOn()
+	{
+		RetryPolicy policy;
+		policy.retryOn = [](const std::exception_ptr &e) {
+			try
+			{
+				std::rethrow_exception(e);
+			}
+			catch (const std::logic_error &)
+			{
+				return false;
+			}
+			catch (...)
+			{
+				return true;
+			}
+		};
+		std::atomic<int> attempts(0);
+		auto f = retry(ex,
+		               [this, &attempts]() -> Future<int> {
+			               ++attempts;
+			               throw std::logic_error("Failure!");
+		               },
+		               policy, &timer);
+		auto r = f.get();
+
+		BOOST_CHECK_EQUAL(1, attempts);
+		BOOST_REQUIRE(r.hasException());
+		BOOST_CHECK_THROW(r.get(), std::logic_error);
+	}
+
+	void testLoop()
+	{
+		// Every step is completed synchronously.
+		auto f = loop(ex, 0, [this](int i) {
+			Promise<Step<int, std::string>> p(ex);
+
+			if (i < 100000)
+			{
+				p.trySuccess(Continue<int>{i + 1});
+			}
+			else
+			{
+				p.trySuccess(Done<std::string>{std::to_string(i)});
+			}
+
+			return p.future();
+		});
+
+		BOOST_CHECK_EQUAL(Try<std::string>("100000"), f.get());
+	}
+
+	void testLoopAsynchronous()
+	{
+		ManualTimerExecutor queue;
+		auto f = loop(&queue, 0, [&queue](int i) {
+			return async(&queue, [i]() -> Step<int, int> {
+				if (i < 1000)
+				{
+					return Continue<int>{i + 1};
+				}
+
+				return Done<int>{i * 2};
+			});
+		});
+		queue.advance(std::chrono::milliseconds(0));
+
+		BOOST_CHECK_EQUAL(Try<int>(2000), f.get());
+	}
+
+	void testLoopFails()
+	{
+		std::atomic<int> steps(0);
+		auto f = loop(ex, 0, [this, &steps](int i) -> Future<Step<int, int>> {
+			++steps;
+
+			if (i == 5)
+			{
+				throw std::runtime_error("Failure!");
+			}
+
+			Promise<Step<int, int>> p(ex);
+			p.trySuccess(Continue<int>{i + 1});
+
+			return p.future();
+		});
+		auto r = f.get();
+
+		BOOST_CHECK_EQUAL(6, steps);
+		BOOST_REQUIRE(r.hasException());
+		BOOST_CHECK_THROW(r.get(), std::runtime_error);
+	}
+
+	void testWhileDo()
+	{
+		int i = 0;
+		auto f = whileDo(ex, [&i] { return i < 1000; },
+		                 [this, &i] { return successful(++i); });
+
+		BOOST_CHECK_EQUAL(Try<Unit>(Unit()), f.get());
+		BOOST_CHECK_EQUAL(1000, i);
+
+		auto g = whileDo(ex, [] { return false; },
+		                 [this] { return failed(std::runtime_error("Failure!")); });
+
+		BOOST_CHECK_EQUAL(Try<Unit>(Unit()), g.get());
+	}
+
+	void testIterateUntil()
+	{
+		auto f = iterateUntil(ex, 1, [this](int i) { return successful(i * 2); },
+		                      [](int i) { return i > 1000; });
+
+		BOOST_CHECK_EQUAL(Try<int>(1024), f.get());
+	}
+
+	void testChannelBackpressure()
+	{
+		Channel<int> channel(ex, 2);
+		auto f0 = channel.push(0);
+		auto f1 = channel.push(1);
+		auto f2 = channel.push(2);
+
+		BOOST_CHECK(f0.isReady());
+		BOOST_CHECK(f1.isReady());
+		BOOST_REQUIRE(!f2.isReady());
+		BOOST_CHECK(!channel.tryPush(3));
+
+		auto stream = channel.stream();
+
+		BOOST_CHECK_EQUAL(0, *stream.next().get().get());
+		// Pulling a value accepts the blocked value.
+		BOOST_CHECK(f2.isReady());
+
+		auto next = stream.nextN(10);
+
+		BOOST_REQUIRE(next.isReady());
+		BOOST_CHECK((std::vector<int>{1, 2}) == next.get().get());
+
+		// A waiting consumer gets the value directly.
+		auto waiting = stream.next();
+
+		BOOST_REQUIRE(!waiting.isReady());
+		BOOST_CHECK(channel.tryPush(4));
+		BOOST_CHECK_EQUAL(4, *waiting.get().get());
+
+		channel.close();
+
+		BOOST_CHECK(!stream.next().get().get());
+		BOOST_CHECK_THROW(channel.push(5).get().get(), ChannelClosed);
+	}
+
+	void testChannelFail()
+	{
+		Channel<int> channel(ex, 1);
+		auto stream = channel.stream();
+		auto waiting = stream.next();
+		channel.fail(std::make_exception_ptr(std::runtime_error("Failure!")));
+
+		BOOST_CHECK_THROW(waiting.get().get(), std::runtime_error);
+	}
+
+	void testStreamCombinators()
+	{
+		Channel<int> channel(ex, 100);
+
+		for (int i = 0; i < 100; ++i)
+		{
+			channel.tryPush(int(i));
+		}
+
+		channel.close();
+
+		auto f = channel.stream()
+		             .filter([](int v) { return v % 2 == 0; })
+		             .map([](int v) { return std::to_string(v); })
+		             .take(3)
+		             .collect();
+
+		BOOST_CHECK((std::vector<std::string>{"0", "2", "4"}) == f.get().get());
+	}
+
+	void testStreamMerge()
+	{
+		Channel<int> c0(ex, 0);
+		Channel<int> c1(ex, 0);
+		auto merged = c0.stream().merge(c1.stream());
+		auto values = merged.collect();
+		c0.push(0);
+		c1.push(1);
+		c0.close();
+		c1.push(2);
+
+		BOOST_REQUIRE(!values.isReady());
+		c1.close();
+
+		auto r = values.get().get();
+		std::sort(r.begin(), r.end());
+
+		BOOST_CHECK((std::vector<int>{0, 1, 2}) == r);
+	}
+
+	void testStreamBuffer()
+	{
+		Channel<int> channel(ex, 0);
+		auto buffered = channel.stream().buffer(10);
+
+		// The buffer accepts the values before they are pulled.
+		for (int i = 0; i < 10; ++i)
+		{
+			BOOST_CHECK(channel.push(int(i)).isReady());
+		}
+
+		BOOST_CHECK_EQUAL(10u, buffered.nextN(100).get().get().size());
+
+		// Ending the source ends the pump of the buffer.
+		channel.close();
+
+		BOOST_CHECK(!buffered.next().get().get());
+	}
+
+	void testStreamPumpStops()
+	{
+		Channel<int> channel(ex, 0);
+
+		{
+			auto buffered = channel.stream().buffer(1);
+			auto merged = channel.stream().merge(channel.stream());
+
+			BOOST_CHECK(channel.push(0).isReady());
+		}
+
+		// The three waiting pumps take one value each and stop since their streams
+		// have been destroyed.
+		BOOST_CHECK(channel.push(1).isReady());
+		BOOST_CHECK(channel.push(2).isReady());
+		BOOST_CHECK(channel.push(3).isReady());
+		BOOST_CHECK(!channel.push(4).isReady());
+	}
+
+	void testWhenEach()
+	{
+		std::vector<Promise<int>> promises;
+		std::vector<Future<int>> futures;
+
+		for (int i = 0; i < 3; ++i)
+		{
+			promises.push_back(createPromiseInt());
+			futures.push_back(promises.back().future());
+		}
+
+		auto stream = whenEach(ex, futures);
+		auto first = stream.next();
+
+		BOOST_REQUIRE(!first.isReady());
+		promises[2].trySuccess(2);
+		promises[0].tryFailure(std::runtime_error("Failure!"));
+
+		BOOST_CHECK_EQUAL(2u, first.get().get()->first);
+		BOOST_CHECK_EQUAL(Try<int>(2), first.get().get()->second);
+
+		auto second = stream.next().get().get();
+
+		BOOST_CHECK_EQUAL(0u, second->first);
+		BOOST_CHECK(second->second.hasException());
+
+		promises[1].trySuccess(1);
+
+		BOOST_CHECK_EQUAL(1u, stream.next().get().get()->first);
+		BOOST_CHECK(!stream.next().get().get());
+	}
+
+	void testWhenEachMany()
+	{
+		std::vector<Promise<int>> promises;
+		std::vector<Future<int>> futures;
+
+		for (int i = 0; i < 10000; ++i)
+		{
+			promises.push_back(createPromiseInt());
+			futures.push_back(promises.back().future());
+		}
+
+		auto stream = whenEach(ex, futures);
+
+		for (int i = 10000; i > 0; --i)
+		{
+			promises[i - 1].trySuccess(int(i));
+		}
+
+		auto r = stream.collect().get().get();
+
+		BOOST_REQUIRE_EQUAL(10000u, r.size());
+		BOOST_CHECK_EQUAL(9999u, r.front().first);
+		BOOST_CHECK_EQUAL(0u, r.back().first);
+		BOOST_CHECK(!whenEach(ex, std::vector<Future<int>>()).next().get().get());
+	}
+
+#if defined(__cpp_impl_coroutine) && __has_include(<coroutine>)
+	void testCoroutineReady()
+	{
+		auto t = addOne(ex, successful(10));
+
+		// The coroutine is not suspended at all.
+		BOOST_REQUIRE(t.isReady());
+		BOOST_CHECK_EQUAL(Try<int>(11), t.get());
+	}
+
+	void testCoroutinePending()
+	{
+		auto p = createPromiseInt();
+		auto t = addOne(ex, p.future());
+
+		BOOST_CHECK(!t.isReady());
+		p.trySuccess(10);
+		BOOST_REQUIRE(t.isReady());
+		BOOST_CHECK_EQUAL(Try<int>(11), t.get());
+	}
+
+	void testCoroutineFails()
+	{
+		auto t0 = addOne(ex, failed(std::runtime_error("Failure!")));
+
+		BOOST_REQUIRE(t0.get().hasException());
+		BOOST_CHECK_THROW(t0.get().get(), std::runtime_error);
+
+		auto p = createPromiseInt();
+		auto t1 = addOne(ex, p.future());
+		p.trySuccess(-1);
+
+		BOOST_REQUIRE(t1.get().hasException());
+		BOOST_CHECK_THROW(t1.get().get(), std::invalid_argument);
+	}
+
+	void testCoroutineResumesOnExecutor()
+	{
+		ThreadPoolExecutor pool(1);
+		Promise<int> p(&pool);
+		auto t = resumedOn(ex, p.future());
+		p.trySuccess(10);
+
+		// The coroutine is resumed by a callback which runs on the pool.
+		BOOST_CHECK(std::this_thread::get_id() != t.get().get());
+	}
+
+	void testCoroutineFrameLifetime()
+	{
+		auto token = std::make_shared<int>(0);
+		auto p0 = createPromiseInt();
+
+		{
+			auto t = addOneKeeping(ex, p0.future(), token);
+			BOOST_CHECK_EQUAL(2, token.use_count());
+		}
+
+		// The suspended coroutine keeps its frame alive without the task.
+		BOOST_CHECK_EQUAL(2, token.use_count());
+		p0.trySuccess(10);
+		BOOST_CHECK_EQUAL(1, token.use_count());
+
+		std::optional<Future<int>> t;
+
+		{
+			auto p1 = createPromiseInt();
+			t.emplace(addOneKeeping(ex, p1.future(), token));
+		}
+
+		// The broken promise finishes the coroutine but the task keeps the frame.
+		BOOST_REQUIRE(t->isReady());
+		BOOST_CHECK_THROW(t->get().get(), BrokenPromise);
+		BOOST_CHECK_EQUAL(2, token.use_count());
+		t.reset();
+		BOOST_CHECK_EQUAL(1, token.use_count());
+	}
+#endif
+
+	void testFiberExecutor()
+	{
+		FiberExecutor fibers(2);
+		Promise<int> p(&fibers);
+		auto f = p.future();
+		std::vector<Future<int>> futures;
+
+		// More blocked tasks than threads.
+		for (int i = 0; i < 1000; ++i)
+		{
+			futures.push_back(async(&fibers, [f]() mutable { return f.get().get() + 1; }));
+		}
+
+		async(&fibers, [p]() mutable { return p.trySuccess(10); });
+
+		for (auto &r : futures)
+		{
+			BOOST_CHECK_EQUAL(Try<int>(11), r.get());
+		}
+	}
+
+	void testFiberExecutorNested()
+	{
+		FiberExecutor fibers(1);
+		auto f = async(&fibers, [&fibers] {
+			auto nested = async(&fibers, [] { return 10; });
+
+			return nested.get().get() + 1;
+		});
+
+		BOOST_CHECK_EQUAL(Try<int>(11), f.get());
+	}
+
+	void testFiberExecutorException()
+	{
+		std::atomic<int> reported(0);
+
+		{
+			FiberExecutor fibers(1, FiberExecutor::DEFAULT_STACK_SIZE,
+			                     [&reported](std::exception_ptr e) {
+				                     try
+				                     {
+					                     std::rethrow_exception(e);
+				                     }
+				                     catch (const std::runtime_error &)
+				                     {
+					                     ++reported;
+				                     }
+			                     });
+			fibers.add([] { throw std::runtime_error("Failure!"); });
+		}
+
+		BOOST_CHECK_EQUAL(1, reported);
+	}
+
+	static int fanOut(Executor *ex, int depth)
+	{
+		if (depth == 0)
+		{
+			return 1;
+		}
+
+		std::vector<Future<int>> children;
+
+		for (int i = 0; i < 4; ++i)
+		{
+			children.push_back(async(ex, [ex, depth] { return fanOut(ex, depth - 1); }));
+		}
+
+		int r = 0;
+
+		for (auto &c : children)
+		{
+			r += c.get().get();
+		}
+
+		return r;
+	}
+
+	void testThreadPoolExecutorHelpWhileWaiting()
+	{
+		ThreadPoolExecutor pool(1);
+		auto f = async(&pool, [&pool] {
+			auto nested = async(&pool, [] { return 10; });
+
+			return nested.get().get() + 1;
+		});
+
+		BOOST_CHECK_EQUAL(Try<int>(11), f.get());
+
+		// 21 tasks wait for their children on 2 threads.
+		ThreadPoolExecutor pool2(2);
+		auto g = async(&pool2, [&pool2] { return fanOut(&pool2, 3); });
+
+		BOOST_CHECK_EQUAL(Try<int>(64), g.get());
+	}
+
+	void testThreadPoolExecutorException()
+	{
+		std::atomic<int> reported(0);
+
+		{
+			ThreadPoolExecutor pool(1, true, [&reported](std::exception_ptr e) {
+				try
+				{
+					std::rethrow_exception(e);
+				}
+				catch (const std::runtime_error &)
+				{
+					++reported;
+				}
+			});
+			pool.add([] { throw std::runtime_error("Failure!"); });
+			// Tasks which are run while waiting report their exceptions, too.
+			auto f = async(&pool, [&pool] {
+				pool.add([] { throw std::runtime_error("Failure!"); });
+
+				return async(&pool, [] { return 10; }).get().get();
+			});
+
+			BOOST_CHECK_EQUAL(Try<int>(10), f.get());
+		}
+
+		BOOST_CHECK_EQUAL(2, reported);
+	}
+
+	void testTaskGroup()
+	{
+		ThreadPoolExecutor pool(2);
+		std::vector<int> results(100, 0);
+
+		{
+			TaskGroup group(&pool);
+
+			for (int i = 0; i < 100; ++i)
+			{
+				// The children borrow results from the stack.
+				group.spawn([&results, &group, i] {
+					group.spawn([&results, i] {
+						results[i] = i;
+						return Unit();
+					});
+
+					return i;
+				});
+			}
+
+			BOOST_CHECK(group.join().get().hasValue());
+		}
+
+		for (int i = 0; i < 100; ++i)
+		{
+			BOOST_CHECK_EQUAL(i, results[i]);
+		}
+	}
+
+	void testTaskGroupDestroyedByTask()
+	{
+		// The only thread of the pool runs the children while the group is joined.
+		ThreadPoolExecutor pool(1);
+		std::atomic<int> finished{0};
+		auto f = async(&pool, [&pool, &finished] {
+			{
+				TaskGroup group(&pool);
+
+				for (int i = 0; i < 10; ++i)
+				{
+					group.spawn([&finished] {
+						++finished;
+						return Unit();
+					});
+				}
+			}
+
+			return finished.load();
+		});
+
+		BOOST_CHECK_EQUAL(Try<int>(10), f.get());
+	}
+
+	void testTaskGroupFails()
+	{
+		ManualTimerExecutor queue;
+		TaskGroup group(&queue);
+		auto f0 = group.spawn([]() -> int { throw std::runtime_error("Failure!"); });
+		auto f1 = group.spawn([] { return 1; });
+		auto joined = group.join();
+		queue.advance(std::chrono::milliseconds(0));
+
+		BOOST_CHECK(group.isCancelled());
+		BOOST_CHECK_THROW(f0.get().get(), std::runtime_error);
+		BOOST_CHECK_THROW(f1.get().get(), TaskCancelled);
+		BOOST_CHECK_THROW(joined.get().get(), std::runtime_error);
+		BOOST_CHECK_THROW(group.spawn([] { return 2; }), TaskGroupClosed);
+	}
+
+	void testAsyncCache()
+	{
+		ManualTimerExecutor queue;
+		int loads = 0;
+		CachePolicy policy;
+		policy.maxBytes = 2;
+		policy.shards = 1;
+		AsyncCache<int, int> cache(
+		    &queue,
+		    [&queue, &loads](const int &key) {
+			    ++loads;
+			    return async(&queue, [key] { return key * 10; });
+		    },
+		    policy, [](const int &, const int &) { return 1; });
+
+		// Concurrent misses share one load.
+		auto f0 = cache.get(1);
+		auto f1 = cache.get(1);
+		queue.advance(std::chrono::milliseconds(0));
+
+		BOOST_CHECK_EQUAL(1, loads);
+		BOOST_CHECK_EQUAL(Try<int>(10), f0.get());
+		BOOST_CHECK_EQUAL(Try<int>(10), f1.get());
+
+		cache.get(2);
+		queue.advance(std::chrono::milliseconds(0));
+		// 1 is used more recently than 2.
+		cache.get(1);
+		cache.get(3);
+		queue.advance(std::chrono::milliseconds(0));
+
+		BOOST_CHECK_EQUAL(3, loads);
+		BOOST_CHECK_EQUAL(2u, cache.size());
+		BOOST_CHECK_EQUAL(2u, cache.weight());
+		BOOST_CHECK(cache.getIfPresent(1));
+		BOOST_CHECK(!cache.getIfPresent(2));
+		BOOST_CHECK(cache.getIfPresent(3));
+
+		// Concurrent hits share the lock of the shard and load nothing.
+		std::atomic<int> hits{0};
+		std::vector<std::thread> threads;
+
+		for (int i = 0; i < 4; ++i)
+		{
+			threads.emplace_back([&cache, &hits] {
+				for (int j = 0; j < 1000; ++j)
+				{
+					if (cache.get(j % 2 == 0 ? 1 : 3).get().get() % 10 == 0)
+					{
+						++hits;
+					}
+				}
+			});
+		}
+
+		for (auto &t : threads)
+		{
+			t.join();
+		}
+
+		BOOST_CHECK_EQUAL(4000, hits.load());
+		BOOST_CHECK_EQUAL(3, loads);
+		BOOST_CHECK_EQUAL(2u, cache.size());
+	}
+
+	void testAsyncCacheRefresh()
+	{
+		ManualTimerExecutor queue;
+		auto now = std::chrono::steady_clock::time_point();
+		int loads = 0;
+		CachePolicy policy;
+		policy.refreshAfterWrite = std::chrono::seconds(1);
+		policy.expireAfterWrite = std::chrono::seconds(10);
+		policy.clock = [&now] { return now; };
+		AsyncCache<int, int> cache(&queue,
+		                           [&queue, &loads](const int &) {
+			                           auto r = ++loads;
+
+			                           if (r == 2)
+			                           {
+				                           throw std::runtime_error("Failure!");
+			                           }
+
+			                           return async(&queue, [r] { return r; });
+		                           },
+		                           policy);
+
+		cache.get(0);
+		queue.advance(std::chrono::milliseconds(0));
+		now += std::chrono::seconds(2);
+
+		// The failed refresh keeps the old value.
+		BOOST_CHECK_EQUAL(Try<int>(1), cache.get(0).get());
+		queue.advance(std::chrono::milliseconds(0));
+		BOOST_CHECK_EQUAL(2, loads);
+
+		// The old value is returned while it is being refreshed.
+		BOOST_CHECK_EQUAL(Try<int>(1), cache.get(0).get());
+		queue.advance(std::chrono::milliseconds(0));
+		BOOST_CHECK_EQUAL(Try<int>(3), cache.get(0).get());
+
+		// An expired entry is loaded again.
+		now += std::chrono::seconds(20);
+		auto f = cache.get(0);
+		queue.advance(std::chrono::milliseconds(0));
+		BOOST_CHECK_EQUAL(Try<int>(4), f.get());
+	}
+
+	void testChan()
+	{
+		adv_mvar::Chan<int> chan;
+		BOOST_CHECK(!chan.tryTake());
+		BOOST_CHECK(!chan.takeFor(std::chrono::milliseconds(10)));
+		chan.put(1);
+		chan.putMany({2, 3, 4});
+		BOOST_CHECK_EQUAL(1, chan.take());
+		BOOST_CHECK(chan.takeMany(2) == std::vector<int>({2, 3}));
+		BOOST_CHECK_EQUAL(4, *chan.tryTake());
+
+		// The waiting futures are completed in their order.
+		auto f0 = chan.takeAsync(ex);
+		auto f1 = chan.takeAsync(ex);
+		BOOST_CHECK(!f0.isReady());
+		chan.putMany({5, 6, 7});
+		BOOST_CHECK_EQUAL(Try<int>(5), f0.get());
+		BOOST_CHECK_EQUAL(Try<int>(6), f1.get());
+		BOOST_CHECK_EQUAL(Try<int>(7), chan.takeAsync(ex).get());
+
+		std::vector<std::thread> threads;
+		std::atomic<long> sum{0};
+
+		for (int i = 0; i < 4; ++i)
+		{
+			threads.emplace_back([&chan] {
+				for (int j = 1; j <= 1000; ++j)
+				{
+					chan.put(j);
+				}
+			});
+			threads.emplace_back([&chan, &sum] {
+				for (int j = 0; j < 1000; ++j)
+				{
+					sum += chan.take();
+				}
+			});
+		}
+
+		for (auto &t : threads)
+		{
+			t.join();
+		}
+
+		BOOST_CHECK_EQUAL(4 * 500500, sum);
+		BOOST_CHECK(!chan.tryTake());
+	}
+
+	void testBoundedChan()
+	{
+		adv_mvar::BoundedChan<int> chan(3);
+		BOOST_CHECK(chan.tryPut(1));
+		BOOST_CHECK(chan.tryPut(2));
+		BOOST_CHECK(chan.tryPut(3));
+		// The capacity is rounded up to four.
+		BOOST_CHECK(chan.tryPut(4));
+		BOOST_CHECK(!chan.tryPut(5));
+		BOOST_CHECK(!chan.putFor(5, std::chrono::milliseconds(10)));
+		BOOST_CHECK(chan.takeMany(10) == std::vector<int>({1, 2, 3, 4}));
+
+		auto f = chan.takeAsync(ex);
+		BOOST_CHECK(!f.isReady());
+		BOOST_CHECK(chan.tryPut(5));
+		BOOST_CHECK_EQUAL(Try<int>(5), f.get());
+
+		// The producers are blocked by the small capacity.
+		std::vector<std::thread> threads;
+		std::atomic<long> sum{0};
+
+		for (int i = 0; i < 4; ++i)
+		{
+			threads.emplace_back([&chan] {
+				std::vector<int> vs;
+
+				for (int j = 1; j <= 1000; ++j)
+				{
+					vs.push_back(j);
+				}
+
+				chan.putMany(std::move(vs));
+			});
+			threads.emplace_back([&chan, &sum] {
+				int n = 0;
+
+				while (n < 1000)
+				{
+					for (auto v : chan.takeMany(1000 - n))
+					{
+						sum += v;
+						++n;
+					}
+				}
+			});
+		}
+
+		for (auto &t : threads)
+		{
+			t.join();
+		}
+
+		BOOST_CHECK_EQUAL(4 * 500500, sum);
+		BOOST_CHECK(!chan.tryTake());
+	}
+
+	void testSelect()
+	{
+		auto p0 = createPromiseInt();
+		auto p1 = createPromiseInt();
+		std::vector<Future<int>> futures{p0.future(), p1.future()};
+		BOOST_CHECK(!selectFor(futures, std::chrono::milliseconds(10)));
+
+		std::thread t([&p1] {
+			std::this_thread::sleep_for(std::chrono::milliseconds(10));
+			p1.trySuccess(1);
+		});
+
+		auto r = select(futures);
+		BOOST_CHECK_EQUAL(1u, r.first);
+		BOOST_CHECK_EQUAL(Try<int>(1), r.second);
+		t.join();
+
+		p0.tryFailure(std::make_exception_ptr(std::runtime_error("Failure!")));
+		r = select(futures);
+		BOOST_CHECK_EQUAL(0u, r.first);
+		BOOST_CHECK(r.second.hasException());
+	}
+
+	void testSelectMVarsAndFutures()
+	{
+		adv_mvar::MVar<int> mvar;
+		const std::vector<adv_mvar::MVar<int> *> mvars{&mvar};
+		auto p = createPromiseInt();
+		std::vector<Future<int>> futures{p.future()};
+		BOOST_CHECK(!selectFor(mvars, futures, std::chrono::milliseconds(10)));
+
+		std::thread t([&mvar] {
+			std::this_thread::sleep_for(std::chrono::milliseconds(10));
+			mvar.put(1);
+		});
+
+		auto r = select(mvars, futures);
+		BOOST_CHECK_EQUAL(0u, r.first);
+		BOOST_CHECK_EQUAL(Try<int>(1), r.second);
+		t.join();
+
+		// The index of the future follows the index of the MVar.
+		p.trySuccess(2);
+		r = select(mvars, futures);
+		BOOST_CHECK_EQUAL(1u, r.first);
+		BOOST_CHECK_EQUAL(Try<int>(2), r.second);
+
+		// The selector has been removed from the MVar.
+		mvar.put(3);
+		BOOST_CHECK_EQUAL(3, mvar.take());
+
+		// Nothing could complete an empty selection.
+		std::vector<Future<int>> empty;
+		BOOST_CHECK_THROW(select(empty), std::invalid_argument);
+		BOOST_CHECK_THROW(select({}, empty), std::invalid_argument);
+	}
+
+	void testAsyncMutex()
+	{
+		AsyncMutex mutex(ex);
+		auto g0 = mutex.lock().get().get().take();
+		BOOST_CHECK(mutex.isLocked());
+		BOOST_CHECK(!mutex.tryLock());
+
+		// The waiting requests get the mutex in their order.
+		std::vector<int> order;
+		auto f1 = mutex.lock().then([&order](const Try<AsyncMutex::Lease> &) {
+			order.push_back(1);
+			return Unit();
+		});
+		auto f2 = mutex.lock().then([&order](const Try<AsyncMutex::Lease> &) {
+			order.push_back(2);
+			return Unit();
+		});
+		BOOST_CHECK(!f1.isReady());
+		g0.release();
+		BOOST_CHECK(!g0.ownsPermits());
+		BOOST_CHECK(f1.isReady());
+		BOOST_CHECK(f2.isReady());
+		BOOST_CHECK(order == std::vector<int>({1, 2}));
+		BOOST_CHECK(!mutex.isLocked());
+
+		// A copy of the future does not keep the mutex locked after its guard.
+		auto locked = mutex.lock();
+		auto copy = locked;
+
+		{
+			auto g1 = locked.get().get().take();
+			BOOST_CHECK(g1.ownsPermits());
+			BOOST_CHECK(!copy.get().get().take().ownsPermits());
+			BOOST_CHECK(mutex.isLocked());
+		}
+
+		BOOST_CHECK(!mutex.isLocked());
+		BOOST_CHECK(mutex.lock().get().get().take().ownsPermits());
+		BOOST_CHECK(copy.isReady());
+	}
+
+	void testAsyncSemaphore()
+	{
+		AsyncSemaphore semaphore(ex, 3);
+		auto g0 = semaphore.tryAcquire(2);
+		BOOST_CHECK(g0);
+		BOOST_CHECK_EQUAL(1u, semaphore.availablePermits());
+
+		auto f1 = semaphore.acquire(2);
+		// A request for fewer permits does not overtake the waiting one.
+		auto f2 = semaphore.acquire(1);
+		BOOST_CHECK(!f1.isReady());
+		BOOST_CHECK(!f2.isReady());
+		BOOST_CHECK_EQUAL(2u, semaphore.waitingRequests());
+
+		g0->release();
+		BOOST_CHECK(f1.isReady());
+		BOOST_CHECK(f2.isReady());
+		BOOST_CHECK_EQUAL(0u, semaphore.availablePermits());
+
+		// The permits are taken out of a lease only once.
+		auto g1 = f1.get().get().take();
+		BOOST_CHECK(!f1.get().get().take().ownsPermits());
+		g1.release();
+		BOOST_CHECK(!g1.ownsPermits());
+		f2.get().get().take().release();
+		BOOST_CHECK_EQUAL(3u, semaphore.availablePermits());
+
+		// A request which could never be granted fails instead of blocking.
+		BOOST_CHECK_THROW(semaphore.acquire(4).get().get(), std::invalid_argument);
+		BOOST_CHECK(!semaphore.tryAcquire(4));
+		BOOST_CHECK_EQUAL(0u, semaphore.waitingRequests());
+		BOOST_CHECK(semaphore.acquire(3).isReady());
+
+		// Many tasks on several threads respect the limit.
+		ThreadPoolExecutor pool(4);
+		AsyncSemaphore limited(&pool, 2);
+		std::atomic<int> running{0};
+		std::atomic<int> maxRunning{0};
+		std::vector<Future<Unit>> futures;
+
+		for (int i = 0; i < 100; ++i)
+		{
+			futures.push_back(limited.acquire().then(
+			    [&running, &maxRunning](const Try<AsyncSemaphore::Lease> &t) {
+				    auto g = t.get().take();
+				    const auto r = ++running;
+				    auto m = maxRunning.load();
+
+				    while (r > m && !maxRunning.compare_exchange_weak(m, r))
+				    {
+				    }
+
+				    --running;
+				    g.release();
+
+				    return Unit();
+			    }));
+		}
+
+		for (auto &f : futures)
+		{
+			f.get();
+		}
+
+		BOOST_CHECK(maxRunning <= 2);
+	}
+
+	void testRateLimiter()
+	{
+		ManualTimerExecutor timer;
+		RateLimiter limiter(ex, 10.0, 2.0, &timer);
+		BOOST_CHECK(limiter.acquire().isReady());
+		BOOST_CHECK(limiter.tryAcquire());
+		BOOST_CHECK(!limiter.tryAcquire());
+
+		auto f0 = limiter.acquire();
+		auto f1 = limiter.acquire();
+		BOOST_CHECK(!f0.isReady());
+		timer.advance(std::chrono::milliseconds(50));
+		BOOST_CHECK(!f0.isReady());
+		timer.advance(std::chrono::milliseconds(60));
+		BOOST_CHECK(f0.isReady());
+		BOOST_CHECK(!f1.isReady());
+		timer.advance(std::chrono::milliseconds(110));
+		BOOST_CHECK(f1.isReady());
+
+		// The bucket is refilled up to the burst capacity.
+		timer.advance(std::chrono::seconds(10));
+		BOOST_CHECK_CLOSE(2.0, limiter.availableTokens(), 0.001);
+
+		// A request which could never be granted fails instead of blocking.
+		BOOST_CHECK_THROW(limiter.acquire(3.0).get().get(), std::invalid_argument);
+		BOOST_CHECK(limiter.acquire(2.0).isReady());
+		BOOST_CHECK_THROW(RateLimiter(ex, 0.0, 1.0, &timer), std::invalid_argument);
+		BOOST_CHECK_THROW(RateLimiter(ex, -1.0, 1.0, &timer), std::invalid_argument);
+	}
+
+	void testLatch()
+	{
+		Latch latch(ex, 3);
+		auto f = latch.future();
+		latch.countDown();
+		latch.countDown();
+		BOOST_CHECK(!f.isReady());
+		BOOST_CHECK_EQUAL(1u, latch.count());
+		latch.countDown(2);
+		BOOST_CHECK(f.isReady());
+		BOOST_CHECK(latch.isReady());
+		BOOST_CHECK(Latch(ex, 0).future().isReady());
+
+		ThreadPoolExecutor pool(4);
+		Latch done(ex, 100);
+
+		for (int i = 0; i < 100; ++i)
+		{
+			pool.add([&done] { done.countDown(); });
+		}
+
+		BOOST_CHECK(done.future().get().hasValue());
+	}
+
+	void testCountdownEvent()
+	{
+		CountdownEvent event(ex, 1);
+		BOOST_CHECK(event.tryAddCount(2));
+		event.signal(2);
+		BOOST_CHECK(!event.future().isReady());
+		BOOST_CHECK_EQUAL(1u, event.count());
+		event.signal(5);
+		BOOST_CHECK(event.future().isReady());
+		BOOST_CHECK_EQUAL(0u, event.count());
+		BOOST_CHECK(!event.tryAddCount());
+	}
+
+	void testBarrier()
+	{
+		Barrier barrier(ex, 2);
+		auto f0 = barrier.arrive();
+		BOOST_CHECK(!f0.isReady());
+		auto f1 = barrier.arrive();
+		BOOST_CHECK(f0.isReady());
+		BOOST_CHECK(f1.isReady());
+		BOOST_CHECK_EQUAL(1u, barrier.phase());
+		auto f2 = barrier.arrive();
+		BOOST_CHECK(!f2.isReady());
+
+		// The participants run in lockstep over many phases.
+		constexpr int participants = 4;
+		constexpr int phases = 100;
+		Barrier cyclic(ex, participants);
+		std::atomic<int> arrivals{0};
+		std::atomic<bool> overtaken{false};
+		std::vector<std::thread> threads;
+
+		for (int i = 0; i < participants; ++i)
+		{
+			threads.emplace_back([&cyclic, &arrivals, &overtaken] {
+				for (int j = 0; j < phases; ++j)
+				{
+					++arrivals;
+					cyclic.arrive().get();
+
+					if (arrivals < (j + 1) * participants)
+					{
+						overtaken = true;
+					}
+				}
+			});
+		}
+
+		for (auto &t : threads)
+		{
+			t.join();
+		}
+
+		BOOST_CHECK(!overtaken);
+		BOOST_CHECK_EQUAL(static_cast<std::uint64_t>(phases), cyclic.phase());
+	}
+
+	void testActor()
+	{
+		ThreadPoolExecutor pool(4);
+		std::atomic<int> exceptions{0};
+		Actor<std::vector<int>> actor(
+		    &pool, std::vector<int>(), 16,
+		    [&exceptions](std::exception_ptr) { ++exceptions; });
+		std::vector<std::thread> threads;
+
+		for (int i = 0; i < 4; ++i)
+		{
+			threads.emplace_back([&actor, i] {
+				for (int j = 0; j < 1000; ++j)
+				{
+					actor.tell([i, j](std::vector<int> &s) { s.push_back(i * 1000 + j); });
+				}
+			});
+		}
+
+		for (auto &t : threads)
+		{
+			t.join();
+		}
+
+		// The messages of every sender are executed in order.
+		auto ordered = actor.ask([](std::vector<int> &s) {
+			std::vector<int> last(4, -1);
+
+			for (auto v : s)
+			{
+				if (v % 1000 <= last[v / 1000])
+				{
+					return false;
+				}
+
+				last[v / 1000] = v % 1000;
+			}
+
+			return s.size() == 4000;
+		});
+		BOOST_CHECK(ordered.get().get());
+		BOOST_CHECK_EQUAL(0u, actor.pendingMessages());
+
+		auto failed = actor.ask([](std::vector<int> &) -> int {
+			throw std::runtime_error("Failure!");
+		});
+		BOOST_CHECK_THROW(failed.get().get(), std::runtime_error);
+
+		// An exception of a told message is passed to the handler of the actor.
+		actor.tell([](std::vector<int> &) { throw std::runtime_error("Failure!"); });
+		BOOST_CHECK_EQUAL(4000u,
+		                  actor.ask([](std::vector<int> &s) { return s.size(); })
+		                      .get()
+		                      .get());
+		BOOST_CHECK_EQUAL(1, exceptions.load());
+
+		// The core of a reply is stored in its node which outlives the actor.
+		auto chained = [&pool] {
+			Actor<int> counter(&pool, 1);
+
+			return counter.ask([](int &s) { return ++s; })
+			    .then([](const Try<int> &t) { return t.get() * 10; });
+		}();
+		BOOST_CHECK_EQUAL(20, chained.get().get());
+	}
+
+	void testPipeline()
+	{
+		ThreadPoolExecutor parsers(3);
+		ThreadPoolExecutor writers(2);
+		auto builder =
+		    PipelineBuilder<std::string>()
+		        .stage(&parsers, 3, 2,
+		               [](std::string &&s) {
+			               // Later values overtake earlier ones.
+			               std::this_thread::sleep_for(
+			                   std::chrono::microseconds((7 - s.size()) * 50));
+			               return std::stoi(s);
+		               })
+		        .stage(&writers, 2, 2, [](int &&v) { return v * 2; });
+
+		std::vector<int> expected;
+
+		for (int i = 0; i < 200; ++i)
+		{
+			expected.push_back(i * 2);
+		}
+
+		for (auto order : {PipelineOrder::Ordered, PipelineOrder::Unordered})
+		{
+			auto pipeline = builder.build(ex, order);
+			auto output = pipeline.output().collect();
+
+			for (int i = 0; i < 200; ++i)
+			{
+				pipeline.push(std::to_string(i)).get();
+			}
+
+			pipeline.close();
+			BOOST_CHECK(pipeline.drained().get().hasValue());
+			auto r = output.get().get();
+
+			if (order == PipelineOrder::Unordered)
+			{
+				std::sort(r.begin(), r.end());
+			}
+
+			BOOST_CHECK(expected == r);
+
+			const auto statistics = pipeline.statistics();
+			BOOST_CHECK_EQUAL(2u, statistics.size());
+
+			for (const auto &s : statistics)
+			{
+				BOOST_CHECK_EQUAL(200u, s.processed);
+				BOOST_CHECK_EQUAL(0u, s.queued);
+				BOOST_CHECK_EQUAL(0u, s.active);
+				// The capacity plus the workers of the previous stage.
+				BOOST_CHECK(s.maxQueued <= 5u);
+			}
+
+			BOOST_CHECK_THROW(pipeline.push("0").get().get(), ChannelClosed);
+		}
+
+		auto failing = PipelineBuilder<int>()
+		                   .stage(&parsers, 2, 1,
+		                          [](int &&v) {
+			                          if (v == 3)
+			                          {
+				                          throw std::runtime_error("Failure!");
+			                          }
+
+			                          return v;
+		                          })
+		                   .build(ex, PipelineOrder::Ordered, 10);
+
+		for (int i = 0; i < 10; ++i)
+		{
+			failing.push(i).get();
+		}
+
+		failing.close();
+		BOOST_CHECK_THROW(failing.drained().get().get(), std::runtime_error);
+		BOOST_CHECK_THROW(failing.output().collect().get().get(),
+		                  std::runtime_error);
+	}
+
+	void testTaskGraph()
+	{
+		ThreadPoolExecutor pool(1);
+		std::mutex m;
+		std::vector<int> order;
+		auto record = [&m, &order](int i) {
+			return [&m, &order, i] {
+				std::lock_guard<std::mutex> l(m);
+				order.push_back(i);
+			};
+		};
+
+		TaskGraph graph;
+		const auto a = graph.add(record(0), 0.5);
+		const auto b1 = graph.add(record(1));
+		const auto b2 = graph.add(record(2));
+		const auto b3 = graph.add(record(3));
+		graph.dependsOn(b2, b1);
+		graph.dependsOn(b3, b2);
+		BOOST_CHECK_EQUAL(3.0, graph.priority(b1));
+		BOOST_CHECK_EQUAL(0.5, graph.priority(a));
+
+		// The critical path is started first although a has been added first.
+		for (int run = 0; run < 2; ++run)
+		{
+			order.clear();
+
+			for (auto &f : graph.run(&pool, 1))
+			{
+				BOOST_CHECK(f.get().hasValue());
+			}
+
+			BOOST_CHECK((std::vector<int>{1, 2, 3, 0}) == order);
+		}
+
+		TaskGraph failing;
+		const auto root = failing.add([] { throw std::runtime_error("Failure!"); });
+		const auto dependent = failing.add(record(4));
+		const auto independent = failing.add(record(5));
+		failing.dependsOn(dependent, root);
+		order.clear();
+		auto futures = failing.run(&pool, 2);
+		BOOST_CHECK_THROW(futures[root].get().get(), std::runtime_error);
+		BOOST_CHECK_THROW(futures[dependent].get().get(), std::runtime_error);
+		BOOST_CHECK(futures[independent].get().hasValue());
+		BOOST_CHECK((std::vector<int>{5}) == order);
+
+		TaskGraph cyclic;
+		const auto x = cyclic.add([] {});
+		const auto y = cyclic.add([] {});
+		cyclic.dependsOn(x, y);
+		cyclic.dependsOn(y, x);
+		BOOST_CHECK_THROW(cyclic.run(&pool), TaskGraphCycle);
+	}
+
+	void testAll()
+	{
+		testTryRuntimeError();
+		testTryValue();
+		testOnComplete();
+		testOnCompleteRemove();
+		testOnCompleteOrder();
+		testOnCompleteIsReadyAndGet();
+		testOnSuccess();
+		testOnFailure();
+		testGet();
+		testIsReady();
+		testThen();
+		testThenWith();
+		testThenWithLinked();
+		testThenWithLinkedBrokenPromise();
+		testThenWithRecursive();
+		testFused();
+		testFusedFails();
+		testFusedShared();
+		testFusedAfterMaterialized();
+		testGuard();
+		testGuardFails();
+		testOrElseFirstSuccessful();
+		testOrElseSecondSuccessful();
+		testOrElseBothFail();
+		testOrElseLazy();
+		testLazy();
+		testLazyReentrantForce();
+		testFirst();
+		testFirstWithException();
+		testFirstLongLived();
+		testFirstSucc();
+		testFirstSuccWithException();
+		testFirstSuccBothFail();
+		testAsync();
+		testBrokenPromise();
+		testTryComplete();
+		testTrySuccess();
+		testTryFailure();
+		testTryCompleteWith();
+		testTryCompleteWithFailure();
+		testTrySuccessWith();
+		testTryFailureWith();
+		testFirstN();
+		testFirstNSucc();
+		testFirstNSuccFails();
+		testTimerWheel();
+		testTimerExecutorSchedule();
+		testTimerExecutorException();
+		testSleep();
+		testWithin();
+		testWithinTimeout();
+		testDelayed();
+		testLatencyHistogram();
+		testHedge();
+		testHedgeFirstSucceeds();
+		testHedgeAllFail();
+		testHedgeAttemptThrows();
+		testRetryPolicyDelay();
+		testRetry();
+		testRetryGivesUp();
+		testRetryOn();
+		testLoop();
+		testLoopAsynchronous();
+		testLoopFails();
+		testWhileDo();
+		testIterateUntil();
+		testChannelBackpressure();
+		testChannelFail();
+		testStreamCombinators();
+		testStreamMerge();
+		testStreamBuffer();
+		testStreamPumpStops();
+		testWhenEach();
+		testWhenEachMany();
+#if defined(__cpp_impl_coroutine) && __has_include(<coroutine>)
+		testCoroutineReady();
+		testCoroutinePending();
+		testCoroutineFails();
+		testCoroutineResumesOnExecutor();
+		testCoroutineFrameLifetime();
+#endif
+		testFiberExecutor();
+		testFiberExecutorNested();
+		testFiberExecutorException();
+		testThreadPoolExecutorHelpWhileWaiting();
+		testThreadPoolExecutorException();
+		testTaskGroup();
+		testTaskGroupDestroyedByTask();
+		testTaskGroupFails();
+		testAsyncCache();
+		testAsyncCacheRefresh();
+		testChan();
+		testBoundedChan();
+		testSelect();
+		testSelectMVarsAndFutures();
+		testAsyncMutex();
+		testAsyncSemaphore();
+		testRateLimiter();
+		testLatch();
+		testCountdownEvent();
+		testBarrier();
+		testActor();
+		testPipeline();
+		testTaskGraph();
+	}
+
+	private:
+	folly::Executor *follyExecutor;
+	FollyExecutor *ex;
+	TimerExecutor timer;
+
+	Promise<int> createPromiseInt()
+	{
+		return Promise<int>(ex);
+	}
+
+	Promise<std::string> createPromiseString()
+	{
+		return Promise<std::string>(ex);
+	}
+
+	Future<int> successful(int v)
+	{
+		auto p = createPromiseInt();
+		p.trySuccess(std::move(v));
+		return p.future();
+	}
+
+	template <typename Exception>
+	Future<int> failed(Exception &&e)
+	{
+		auto p = createPromiseInt();
+		p.tryFailure(std::move(e));
+		return p.future();
+	}
+
+#if defined(__cpp_impl_coroutine) && __has_include(<coroutine>)
+	/**
+	 * Fails with std::invalid_argument for negative values.
+	 */
+	static Task<int> addOne(Executor *e, Future<int> f)
+	{
+		const int v = co_await f;
+
+		if (v < 0)
+		{
+			throw std::invalid_argument("Negative value!");
+		}
+
+		co_return v + 1;
+	}
+
+	static Task<int> addOneKeeping(Executor *e, Future<int> f,
+	                               std::shared_ptr<int> token)
+	{
+		co_return co_await f + 1;
+	}
+
+	static Task<std::thread::id> resumedOn(Executor *e, Future<int> f)
+	{
+		co_await f;
+
+		co_return std::this_thread::get_id();
+	}
+#endif
+
+	/**
+	 * Counts down from n asynchronously with one nested call of thenWith per
+	 * step.
+	 */
+	static Future<int> countDown(Executor *e, int n)
+	{
+		return async(e, [n] { return n; }).thenWith([e](const Try<int> &t) {
+			auto i = t.get();
+
+			return i == 0 ? async(e, [] { return 0; }) : countDown(e, i - 1);
+		});
 	}
 };
 } // namespace adv
@@ -0,0 +1,162 @@
+#ifndef ADV_THREAD_POOL_EXECUTOR_H
+#define ADV_THREAD_POOL_EXECUTOR_H
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "executor.h"
+
+namespace adv
+{
+
+/**
+ * Executes the tasks by a fixed number of threads which share one queue.
+ *
+ * If a task calls \ref Future::get() on a future which has not been completed
+ * and helpWhileWaiting is true, the thread runs other tasks from the queue until
+ * the future has been completed instead of blocking. Hence, tasks can wait for
+ * tasks which they have added to the same pool without deadlocking it, even if
+ * there are more waiting tasks than threads. A waiting task is continued only
+ * after the task which the thread is running for it has finished.
+ *
+ * Exceptions thrown by tasks are passed to onException. Without a handler,
+ * they terminate the program.
+ *
+ * The destructor runs the remaining tasks before it joins the threads.
+ */
+class ThreadPoolExecutor : public Executor
+{
+	public:
+	explicit ThreadPoolExecutor(std::size_t threads,
+	                            bool helpWhileWaiting = true,
+	                            ExceptionHandler onException = nullptr)
+	    : helpWhileWaiting(helpWhileWaiting), onException(std::move(onException))
+	{
+		workers.reserve(threads);
+
+		for (std::size_t i = 0; i < threads; ++i)
+		{
+			workers.emplace_back([this] { run(); });
+		}
+	}
+
+	~ThreadPoolExecutor() override
+	{
+		{
+			std::lock_guard<std::mutex> l(m);
+			stopped = true;
+		}
+
+		changed.notify_all();
+
+		for (auto &t : workers)
+		{
+			t.join();
+		}
+	}
+
+	void add(Function &&f) override
+	{
+		{
+			std::lock_guard<std::mutex> l(m);
+			queue.push_back(std::move(f));
+		}
+
+		changed.notify_one();
+	}
+
+	/**
+	 * Runs tasks from the queue until a has been completed.
+	 */
+	bool wait(Awaited &a) override
+	{
+		if (!helpWhileWaiting)
+		{
+			return false;
+		}
+
+		// Is only accessed with the lock, so it outlives the callback.
+		bool done = false;
+
+		a.onReady([this, &done] {
+			{
+				std::lock_guard<std::mutex> l(m);
+				done = true;
+			}
+
+			changed.notify_all();
+		});
+
+		std::unique_lock<std::mutex> l(m);
+
+		while (!done)
+		{
+			if (queue.empty())
+			{
+				changed.wait(l);
+			}
+			else
+			{
+				runNext(l);
+			}
+		}
+
+		return true;
+	}
+
+	private:
+	const bool helpWhileWaiting;
+	const ExceptionHandler onException;
+	std::vector<std::thread> workers;
+	std::mutex m;
+	// Notifies about new tasks, completed futures and stopping.
+	std::condition_variable changed;
+	std::deque<Function> queue;
+	bool stopped = false;
+
+	void run()
+	{
+		CurrentGuard guard(this);
+		std::unique_lock<std::mutex> l(m);
+
+		while (true)
+		{
+			changed.wait(l, [this] { return stopped || !queue.empty(); });
+
+			if (queue.empty())
+			{
+				return;
+			}
+
+			runNext(l);
+		}
+	}
+
+	/**
+	 * Runs the first task of the queue without the lock.
+	 */
+	void runNext(std::unique_lock<std::mutex> &l)
+	{
+		auto f = std::move(queue.front());
+		queue.pop_front();
+		l.unlock();
+
+		try
+		{
+			f();
+		}
+		catch (...)
+		{
+			handleException(onException);
+		}
+
+		l.lock();
+	}
+};
+
+} // namespace adv
+
+#endif
@@ -0,0 +1,669 @@
+#ifndef ADV_TIMEREXECUTOR_H
+#define ADV_TIMEREXECUTOR_H
+
+#include <array>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <limits>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "core.h"
+#include "executor.h"
+
+namespace adv
+{
+
+/**
+ * A hierarchical timing wheel which stores timers with the resolution of one
+ * tick. Every level has 256 slots and covers 256 times the range of the level
+ * below. Timers of higher levels are cascaded into lower levels when the lower
+ * level wraps around.
+ *
+ * Adding and removing a timer takes O(1), so removing timeouts which are not
+ * required anymore is cheap. The timers are stored in entries which are reused,
+ * hence no allocation is required unless the number of timers grows.
+ *
+ * It is not thread-safe.
+ */
+template <typename Function>
+class TimerWheel
+{
+	public:
+	using Tick = std::uint64_t;
+
+	static constexpr std::size_t slotBits = 8;
+	static constexpr std::size_t slots = std::size_t(1) << slotBits;
+	static constexpr std::size_t levels = 4;
+	static constexpr Tick range = Tick(1) << (slotBits * levels);
+	static constexpr Tick never = std::numeric_limits<Tick>::max();
+
+	explicit TimerWheel(Tick current = 0) : currentTick(current)
+	{
+		heads.fill(nil);
+		counts.fill(0);
+	}
+
+	/**
+	 * @return Returns the next tick which has not been processed yet.
+	 */
+	Tick current() const
+	{
+		return currentTick;
+	}
+
+	bool empty() const
+	{
+		return entries.size() == freeEntries.size();
+	}
+
+	std::size_t size() const
+	{
+		return entries.size() - freeEntries.size();
+	}
+
+	/**
+	 * Timers which expire before the current tick expire at the current tick.
+	 */
+	CallbackKey add(Tick expiry, Function &&f)
+	{
+		std::size_t i;
+
+		if (freeEntries.empty())
+		{
+			i = entries.size();
+			entries.emplace_back();
+		}
+		else
+		{
+			i = freeEntries.back();
+			freeEntries.pop_back();
+		}
+
+		auto &e = entries[i];
+		e.f = std::move(f);
+		e.expiry = std::max(expiry, currentTick);
+		insert(i);
+
+		return CallbackKey{i, e.generation};
+	}
+
+	/**
+	 * Moves the function of the timer out of the wheel.
+	 * @return Returns an empty function if the timer has already expired or has
+	 * been removed.
+	 */
+	Function remove(CallbackKey key)
+	{
+		if (key.index >= entries.size())
+		{
+			return Function();
+		}
+
+		auto &e = entries[key.index];
+
+		if (e.generation != key.generation || e.list == nil)
+		{
+			return Function();
+		}
+
+		unlink(key.index);
+
+		return release(key.index);
+	}
+
+	/**
+	 * @return Returns the first tick which might expire timers or cascade them.
+	 * All ticks before it can be skipped.
+	 */
+	Tick nextTick() const
+	{
+		std::size_t l = 0;
+
+		while (l < levels && counts[l] == 0)
+		{
+			++l;
+		}
+
+		if (l == levels)
+		{
+			return never;
+		}
+
+		if (l == 0)
+		{
+			// Stop at the next wrap around since higher levels might be cascaded.
+			for (Tick t = currentTick;; ++t)
+			{
+				if ((t & mask) == 0 || heads[t & mask] != nil)
+				{
+					return t;
+				}
+			}
+		}
+
+		const Tick step = Tick(1) << (slotBits * l);
+
+		return (currentTick + step - 1) / step * step;
+	}
+
+	/**
+	 * Processes all ticks up to and including now and passes the functions of
+	 * all expired timers to expired.
+	 */
+	template <typename Func>
+	void advance(Tick now, Func &&expired)
+	{
+		while (currentTick <= now)
+		{
+			const auto next = nextTick();
+
+			if (next > now)
+			{
+				currentTick = now + 1;
+
+				return;
+			}
+
+			currentTick = next;
+
+			if ((currentTick & mask) == 0)
+			{
+				cascade(1);
+			}
+
+			auto i = detach(0, currentTick & mask);
+
+			while (i != nil)
+			{
+				auto next = entries[i].next;
+				expired(release(i));
+				i = next;
+			}
+
+			++currentTick;
+		}
+	}
+
+	/**
+	 * Removes all timers and passes their functions to f.
+	 */
+	template <typename Func>
+	void clear(Func &&f)
+	{
+		for (std::size_t i = 0; i < entries.size(); ++i)
+		{
+			if (entries[i].list != nil)
+			{
+				unlink(i);
+				f(release(i));
+			}
+		}
+	}
+
+	private:
+	static constexpr std::size_t nil = std::numeric_limits<std::size_t>::max();
+	static constexpr Tick mask = slots - 1;
+
+	struct Entry
+	{
+		Function f;
+		Tick expiry{0};
+		std::size_t prev{nil};
+		std::size_t next{nil};
+		std::size_t list{nil};
+		std::size_t generation{0};
+	};
+
+	Tick currentTick;
+	std::vector<Entry> entries;
+	std::vector<std::size_t> freeEntries;
+	std::array<std::size_t, levels * slots> heads;
+	std::array<std::size_t, levels> counts;
+
+	void insert(std::size_t i)
+	{
+		const auto expiry = entries[i].expiry;
+		const auto delta = expiry - currentTick;
+		// Timers beyond the range are cascaded until they fit into it.
+		const auto placement = delta < range ? expiry : currentTick + range - 1;
+		std::size_t l = 0;
+
+		while (l + 1 < levels &&
+		       delta >= (Tick(1) << (slotBits * (l + 1))))
+		{
+			++l;
+		}
+
+		link(i, l, (placement >> (slotBits * l)) & mask);
+	}
+
+	void link(std::size_t i, std::size_t level, std::size_t slot)
+	{
+		auto &e = entries[i];
+		e.list = level * slots + slot;
+		e.prev = nil;
+		e.next = heads[e.list];
+
+		if (e.next != nil)
+		{
+			entries[e.next].prev = i;
+		}
+
+		heads[e.list] = i;
+		++counts[level];
+	}
+
+	void unlink(std::size_t i)
+	{
+		auto &e = entries[i];
+
+		if (e.prev != nil)
+		{
+			entries[e.prev].next = e.next;
+		}
+		else
+		{
+			heads[e.list] = e.next;
+		}
+
+		if (e.next != nil)
+		{
+			entries[e.next].prev = e.prev;
+		}
+
+		--counts[e.list / slots];
+		e.list = nil;
+	}
+
+	/**
+	 * Removes all entries from the slot.
+	 * @return Returns the first entry of the detached list.
+	 */
+	std::size_t detach(std::size_t level, std::size_t slot)
+	{
+		auto &head = heads[level * slots + slot];
+		auto i = head;
+		head = nil;
+
+		for (auto j = i; j != nil; j = entries[j].next)
+		{
+			entries[j].list = nil;
+			--counts[level];
+		}
+
+		return i;
+	}
+
+	void cascade(std::size_t level)
+	{
+		if (level >= levels)
+		{
+			return;
+		}
+
+		const auto slot = (currentTick >> (slotBits * level)) & mask;
+		auto i = detach(level, slot);
+
+		while (i != nil)
+		{
+			auto next = entries[i].next;
+			insert(i);
+			i = next;
+		}
+
+		if (slot == 0)
+		{
+			cascade(level + 1);
+		}
+	}
+
+	Function release(std::size_t i)
+	{
+		auto &e = entries[i];
+		Function f = std::move(e.f);
+		e.f = nullptr;
+		++e.generation;
+		freeEntries.push_back(i);
+
+		return f;
+	}
+};
+
+/**
+ * Executes functions after a delay on a dedicated thread.
+ * The timers are stored in a \ref TimerWheel, so it handles millions of
+ * timeouts which are removed before they expire.
+ * Functions which are added without any delay are executed on the same thread
+ * as soon as possible.
+ * Exceptions thrown by functions are passed to onException. Without a handler,
+ * they terminate the program.
+ */
+class TimerExecutor : public Executor
+{
+	public:
+	using Clock = std::chrono::steady_clock;
+	using Duration = Clock::duration;
+
+	explicit TimerExecutor(Duration tick = std::chrono::milliseconds(1),
+	                       ExceptionHandler onException = nullptr)
+	    : TimerExecutor(tick, false, std::move(onException))
+	{
+	}
+
+	TimerExecutor(const TimerExecutor &) = delete;
+	TimerExecutor &operator=(const TimerExecutor &) = delete;
+
+	/**
+	 * Timers which have not expired yet are destroyed without being executed.
+	 * Functions which are added while they are destroyed are dropped, too.
+	 */
+	~TimerExecutor() override
+	{
+		state->stop();
+
+		if (thread.joinable())
+		{
+			thread.join();
+		}
+
+		state->clear();
+	}
+
+	void add(Function &&f) override
+	{
+		state->add(std::move(f));
+	}
+
+	/**
+	 * Executes f after at least d has passed.
+	 * @return Returns a handle which removes the timer in O(1).
+	 */
+	CallbackHandle schedule(Duration d, Function &&f)
+	{
+		return CallbackHandle(state, state->schedule(d, std::move(f)));
+	}
+
+	/**
+	 * @return Returns the time since the timer executor has been started. It is
+	 * faked by \ref ManualTimerExecutor.
+	 */
+	Duration now() const
+	{
+		return state->currentTime();
+	}
+
+	/**
+	 * @return Returns the timer executor which is used when no timer executor is
+	 * passed explicitly.
+	 */
+	static TimerExecutor *getDefault()
+	{
+		static TimerExecutor timer;
+
+		return &timer;
+	}
+
+	protected:
+	/**
+	 * @param manual If it is true, no thread is started and the time is only
+	 * advanced by \ref State::advance().
+	 */
+	TimerExecutor(Duration tick, bool manual, ExceptionHandler onException)
+	    : state(std::make_shared<State>(tick, manual, std::move(onException))),
+	      thread(manual ? std::thread() : std::thread([s = state] { s->run(); }))
+	{
+	}
+
+	class State : public CallbackRegistry
+	{
+		public:
+		using Wheel = TimerWheel<Function>;
+		using Tick = Wheel::Tick;
+
+		State(Duration tick, bool manual, ExceptionHandler &&onException)
+		    : tick(tick), start(Clock::now()), manual(manual),
+		      onException(std::move(onException))
+		{
+		}
+
+		void add(Function &&f)
+		{
+			{
+				std::lock_guard<std::mutex> l(m);
+
+				if (stopping)
+				{
+					return;
+				}
+
+				ready.push_back(std::move(f));
+			}
+
+			condition.notify_one();
+		}
+
+		CallbackKey schedule(Duration d, Function &&f)
+		{
+			CallbackKey key;
+			bool notify = false;
+
+			{
+				std::lock_guard<std::mutex> l(m);
+
+				if (stopping)
+				{
+					return key;
+				}
+
+				// Round up, so the function is never executed too early.
+				const auto expiry =
+				    static_cast<Tick>((now() + d + tick - Duration(1)) / tick);
+				key = wheel.add(expiry, std::move(f));
+
+				if (expiry < wakeTick)
+				{
+					wakeTick = expiry;
+					notify = true;
+				}
+			}
+
+			if (notify)
+			{
+				condition.notify_one();
+			}
+
+			return key;
+		}
+
+		bool removeCallback(CallbackKey key) override
+		{
+			Function f;
+
+			{
+				std::lock_guard<std::mutex> l(m);
+				f = wheel.remove(key);
+			}
+
+			// The function is destroyed without holding the lock.
+			return static_cast<bool>(f);
+		}
+
+		void stop()
+		{
+			{
+				std::lock_guard<std::mutex> l(m);
+				stopping = true;
+			}
+
+			condition.notify_one();
+		}
+
+		/**
+		 * Destroys all functions without holding the lock since their destructors
+		 * might add new functions.
+		 */
+		void clear()
+		{
+			std::vector<Function> dropped;
+
+			{
+				std::lock_guard<std::mutex> l(m);
+				dropped.swap(ready);
+				wheel.clear(
+				    [&dropped](Function &&f) { dropped.push_back(std::move(f)); });
+			}
+		}
+
+		void run()
+		{
+			std::vector<Function> expired;
+			std::unique_lock<std::mutex> l(m);
+
+			while (!stopping)
+			{
+				collect(expired);
+
+				if (!expired.empty())
+				{
+					l.unlock();
+					execute(expired);
+					l.lock();
+
+					continue;
+				}
+
+				wakeTick = wheel.nextTick();
+
+				if (wakeTick == Wheel::never)
+				{
+					condition.wait(l);
+				}
+				else
+				{
+					condition.wait_until(
+					    l, start + tick * static_cast<Duration::rep>(wakeTick));
+				}
+			}
+		}
+
+		Duration currentTime()
+		{
+			std::lock_guard<std::mutex> l(m);
+
+			return now();
+		}
+
+		/**
+		 * @return Returns the time since the start which is faked by manual timer
+		 * executors.
+		 */
+		Duration now() const
+		{
+			return manual ? elapsed : Clock::now() - start;
+		}
+
+		/**
+		 * Moves all ready and expired functions into expired.
+		 */
+		void collect(std::vector<Function> &expired)
+		{
+			expired.swap(ready);
+			wheel.advance(static_cast<Tick>(now() / tick), [&expired](Function &&f) {
+				expired.push_back(std::move(f));
+			});
+		}
+
+		/**
+		 * Advances the fake time of a manual timer executor and executes all
+		 * expired functions in the calling thread.
+		 */
+		void advance(Duration d)
+		{
+			std::vector<Function> expired;
+			std::unique_lock<std::mutex> l(m);
+			elapsed += d;
+
+			// Functions which are added by the expired functions might expire, too.
+			while (!stopping)
+			{
+				collect(expired);
+
+				if (expired.empty())
+				{
+					return;
+				}
+
+				l.unlock();
+				execute(expired);
+				l.lock();
+			}
+		}
+
+		/**
+		 * Executes and clears expired without holding the lock. An exception does
+		 * not prevent the remaining functions from being executed.
+		 */
+		void execute(std::vector<Function> &expired)
+		{
+			for (auto &f : expired)
+			{
+				try
+				{
+					f();
+				}
+				catch (...)
+				{
+					handleException(onException);
+				}
+			}
+
+			expired.clear();
+		}
+
+		private:
+		const Duration tick;
+		const Clock::time_point start;
+		const bool manual;
+		const ExceptionHandler onException;
+		Duration elapsed{0};
+		std::mutex m;
+		std::condition_variable condition;
+		Wheel wheel;
+		std::vector<Function> ready;
+		Tick wakeTick{Wheel::never};
+		bool stopping{false};
+	};
+
+	std::shared_ptr<State> state;
+
+	private:
+	std::thread thread;
+};
+
+/**
+ * A timer executor with a fake clock which does not start any thread.
+ * Its time is only advanced by \ref advance() which executes all ready and
+ * expired functions in the calling thread. This allows testing timeouts
+ * deterministically.
+ */
+class ManualTimerExecutor : public TimerExecutor
+{
+	public:
+	explicit ManualTimerExecutor(Duration tick = std::chrono::milliseconds(1),
+	                             ExceptionHandler onException = nullptr)
+	    : TimerExecutor(tick, true, std::move(onException))
+	{
+	}
+
+	void advance(Duration d)
+	{
+		state->advance(d);
+	}
+};
+
+} // namespace adv
+
+#endif
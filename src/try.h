@@ -10,6 +10,24 @@
 namespace adv
 {
 
+/**
+ * The result value of futures which only signal their completion.
+ * Since Try does not support void, Try<Unit> is used instead.
+ */
+struct Unit
+{
+};
+
+inline bool operator==(const Unit &, const Unit &)
+{
+	return true;
+}
+
+inline std::ostream &operator<<(std::ostream &out, const Unit &)
+{
+	return out << "Unit";
+}
+
 /**
  * Stores either a result value or exception.
  * Other than Folly's type this can never be empty.